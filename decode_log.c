@@ -0,0 +1,48 @@
+// Turns a binary log (see LogConfig.binary) back into text on stdout
+// usage: decode_log [file], reads stdin without one
+#define _XOPEN_SOURCE 700 // nanosleep in the logger under -std=c11
+#include "jp_basic.h"
+
+int main(int argc, char **argv)
+{
+    FILE *in = argc > 1 ? fopen(argv[1], "rb") : stdin;
+    if (!in) {
+        my_eprintfln("decode_log: can't open %", argv[1]);
+        return 1;
+    }
+    LogDecoder d = {0};
+    StringBuilder out = {0};
+    size_t have = 0, offset = 0, cap = 64 * 1024;
+    char *data = malloc(cap);
+    assert(data && "We requested more memory but the computer said \"No\"!");
+    for (;;) {
+        if (have == cap) {
+            // a record bigger than what we've got room for
+            cap *= 2;
+            data = realloc(data, cap);
+            assert(data && "We requested more memory but the computer said \"No\"!");
+        }
+        size_t got = fread(&data[have], 1, cap - have, in);
+        if (!got) break;
+        have += got;
+        size_t used = log_decode(&d, (string){ .data = data, .len = have }, &out);
+        sb_flush(&out, _stdio_handle(STDOUT));
+        offset += used;
+        if (d.error) break;
+        __builtin_memmove(data, &data[used], have - used);
+        have -= used;
+    }
+    int result = 0;
+    if (d.error) {
+        my_eprintfln("decode_log: % at byte %", d.error, offset);
+        result = 1;
+    } else if (have) {
+        my_eprintfln("decode_log: log ends part way through a record at byte %", offset);
+        result = 1;
+    }
+    if (in != stdin) fclose(in);
+    free(data);
+    sb_free(&out);
+    log_decoder_free(&d);
+    return result;
+}
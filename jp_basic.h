@@ -19,11 +19,12 @@
 #include <assert.h>
 #define panic(msg) assert(msg && 0)
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 typedef int8_t  s8;
 typedef int16_t s16;
-typedef int8_t  s32;
-typedef int8_t  s64;
+typedef int32_t s32;
+typedef int64_t s64;
 #define S8_MAX  INT8_MAX
 #define S16_MAX INT16_MAX
 #define S32_MAX INT32_MAX
@@ -57,26 +58,115 @@ typedef uint64_t u64;
     } while (0);
 
 // Strings
+// 3 words, the flags live in the top bits of _cap so slices stay cheap to pass
+// around by value and StringList doesn't pay for padding
 typedef struct string {
-    bool  _owner;  // internal
     char  *data;
     size_t len;
-    size_t _cap;    // internal
-    bool next;
+    size_t _cap   : sizeof(size_t) * 8 - 2; // internal
+    size_t _owner : 1;                      // internal
+    size_t next   : 1;
 } string;
+_Static_assert(sizeof(string) == sizeof(char *) + 2 * sizeof(size_t), "string flags should pack into _cap");
+
+// Owning strings that never allocate, for short keys/names etc.
+// 22 chars + null terminator + length in one 24 byte value, take a slice with small_string_view
+#define SMALL_STRING_MAX 22
+typedef struct {
+    char data[SMALL_STRING_MAX + 1];
+    u8   len;
+} SmallString;
+
+typedef dynarray(string) StringList;
+typedef dynarray(size_t) IndexList;
 
 // String functions
 string cstrlen(char *source);  // Creates slice over source
 
+// Character classes (ASCII only), OR them together to test for several at once
+#define CHAR_SPACE (1 << 0) // ' ' \t \n \v \f \r
+#define CHAR_ALPHA (1 << 1)
+#define CHAR_DIGIT (1 << 2)
+#define CHAR_HEX   (1 << 3)
+#define CHAR_PUNCT (1 << 4) // printable and not alphanumeric or space
+#define CHAR_UPPER (1 << 5)
+#define CHAR_LOWER (1 << 6)
+#define CHAR_ALNUM (CHAR_ALPHA | CHAR_DIGIT)
+
 bool   jp_isspace(char c); // ISO compliant
-bool   jp_isalpha(char c); // mask off bits 32 then check if it's between 65 + 90 (checks)
-                           // this saves 2 comparisons as mask makes upper + lower the same bitwise
+bool   jp_isalpha(char c);
 bool   jp_isnum(char c);
+bool   jp_ishex(char c);
+bool   jp_ispunct(char c);
 
 // String searching
-bool   string_cmp(string a, const string b);
-int    string_indexof(const string haystack, const string needle);
-bool   string_contains(const string haystack, const string needle);
+// The int versions only fit haystacks under 2 GiB, string_find/string_find_char
+// are the same search with an index that doesn't overflow
+bool      string_cmp(string a, const string b);
+int       string_indexof(const string haystack, const string needle);
+int       string_indexof_char(const string haystack, char c);
+ptrdiff_t string_find(const string haystack, const string needle);
+ptrdiff_t string_find_char(const string haystack, char c);
+bool      string_contains(const string haystack, const string needle);
+
+// Same again ignoring ASCII case
+bool   string_eq_nocase(const string a, const string b);
+bool   string_has_prefix_nocase(const string source, const string prefix);
+int    string_indexof_nocase(const string haystack, const string needle);
+
+// UTF-8
+// string_utf8_count assumes valid input, it counts every byte that isn't a continuation byte
+// string_utf8_iter decodes the first codepoint and advances source past it, invalid or
+// truncated sequences give RUNE_ERROR and skip a single byte
+//   while (source.len) { rune r = string_utf8_iter(&source); ... }
+typedef u32 rune;
+#define RUNE_ERROR 0xfffd
+bool   string_utf8_valid(const string source);
+size_t string_utf8_count(const string source);
+rune   string_utf8_iter(string *source);
+
+// Multi-needle searching (Aho-Corasick)
+// Compile once, then search for all needles in a single pass over the haystack
+// Needle ids are their index in the array passed to string_matcher_compile
+typedef struct {
+    u32    *delta;      // internal, nstates * nclasses transitions
+    u32    *match_id;   // internal, needle ending at state or U32_MAX
+    u32    *dict_link;  // internal, next state down the suffix chain with a match, 0 if none
+    size_t *needle_len; // internal
+    u8      classes[256];
+    u32     nclasses;
+    u32     nstates;
+    u32     count;
+    size_t  max_len;
+} StringMatcher;
+
+typedef struct {
+    size_t index; // offset of the match in the haystack
+    size_t len;
+    u32    id;    // which needle
+    bool   next;  // false once there are no more matches
+} StringMatch;
+
+typedef struct {
+    const StringMatcher *m;
+    string haystack;
+    size_t pos;
+    u32    state;
+    u32    pending; // state still to report matches for
+} StringMatchIter;
+
+StringMatcher string_matcher_compile(const string *needles, size_t count); // @Memory
+void          string_matcher_free(StringMatcher *m);
+int           string_indexof_any(const StringMatcher *m, const string haystack, u32 *id); // leftmost match, -1 if none
+StringMatch   string_match_iter(StringMatchIter *it);
+// Iterating every (possibly overlapping) match looks like:
+// ```
+// StringMatchIter it = { .m = &matcher, .haystack = line };
+// StringMatch match;
+// while ((match = string_match_iter(&it)).next) {
+//     printf("needle %u at %zu\n", match.id, match.index);
+// }
+// ```
 
 // Dest is pointer to reduce noise calling API
 // pass NULL to allocate new string
@@ -84,9 +174,13 @@ bool   string_contains(const string haystack, const string needle);
 string string_copy(string *dest, const string source); // @Cleanup remove after string formatted writing is good....
 string string_write(string *dest, const string data) ;
 
+bool   small_string_set(SmallString *dest, const string source); // false (dest untouched) if it doesn't fit
+string small_string_view(const SmallString *source);              // slice, valid while source is
+
 // String manipulation
 // All pass by value and return a new string (slice)
 string string_trim_whitespace(string source);
+string string_skip_whitespace(string source); // only trims the front
 string string_trim_prefix(string source, char *prefix);
 string string_trim_suffix(string source, char *suffix);
 string string_trim_before(string source, char *target);
@@ -105,10 +199,159 @@ string string_split_iter(string *source, string delim);
 // }
 // ```
 
-// StringBuilder functions
-size_t        sb_write(string *sb, char *text);
-void          sb_appendf(string *sb, char *fmt, ...);
-void          sb_appends(string *sb, string slice);
+// Number of leading bytes that are (span) or are not (cspan) in any of the CHAR_* classes given
+size_t string_span_class(const string source, u8 classes);
+size_t string_cspan_class(const string source, u8 classes);
+
+// Bulk versions for when you want everything at once, these index the whole
+// buffer in a single pass which is a lot quicker than calling the above in a loop
+// Like Go's strings.Split N delimiters gives N+1 slices (the last one is whatever is left)
+StringList string_split_all(const string source, const string delim);  // @Memory
+// Appends the offset of every (non-overlapping) needle to out, returns number found
+size_t string_indexof_all(const string haystack, const string needle, IndexList *out); // @Memory
+// Splits around runs of whitespace, never returns empty slices (Go's strings.Fields)
+StringList string_fields(const string source); // @Memory
+
+// Hashing (wyhash), fast and good enough for hash tables, NOT cryptographic
+u64 string_hash(const string source);
+u64 string_hash_seed(const string source, u64 seed);
+
+// Number parsing
+// Parses the number at the front of source, returns the bytes consumed or 0 if there
+// wasn't one (or it overflowed), out is only written on success. No locale, no
+// whitespace skipping and no null terminator needed so it chains with the slice API:
+// ```
+// string field;
+// s64 value;
+// while ((field = string_split_iter(&csv, cstrlen(","))).next) {
+//     if (string_parse_s64(field, &value) != field.len) printf("bad field\n");
+// }
+// ```
+// Floats accept [+-]digits[.digits][e[+-]digits], inf, infinity and nan.
+size_t string_parse_u64(const string source, u64 *out);
+size_t string_parse_s64(const string source, s64 *out);
+size_t string_parse_f64(const string source, double *out);
+
+// Hash maps
+// Swiss table style open addressing: one control byte per slot holding 7 bits of
+// the hash, probed 16 at a time so most lookups touch a single key.
+// Like dynarray, typedef it to pass it around:
+// ```
+// typedef hashmap(string, int) WordCounts;
+// WordCounts counts = {0};
+// int *count = hm_get(counts, word);
+// if (count) (*count)++;
+// else hm_put(counts, word, 1);
+// for (size_t i = 0; hm_next(counts, &i); i++) {
+//     printf("%.*s: %d\n", (int)counts.keys[i].len, counts.keys[i].data, counts.values[i]);
+// }
+// hm_free(counts);
+// ```
+// string keys are hashed/compared by content (the slice is stored, not copied,
+// intern or own them if the source goes away). Every other key type is hashed
+// and compared bytewise so zero any struct padding.
+#define hashmap(K, V) struct { \
+    u8 *ctrl;\
+    K *keys;\
+    V *values;\
+    size_t len;\
+    size_t cap;\
+    size_t growth_left;\
+    K _key;\
+    V _value;\
+    }
+
+// Layout shared with every hashmap(K, V), internal
+typedef struct {
+    u8 *ctrl;
+    void *keys;
+    void *values;
+    size_t len;
+    size_t cap;
+    size_t growth_left;
+} _HashmapRaw;
+
+typedef struct {
+    size_t key_size;
+    size_t value_size;
+    u64  (*hash)(const void *key, size_t size);
+    bool (*eq)(const void *a, const void *b, size_t size);
+} _HashmapType;
+
+u64  _hm_hash_bytes(const void *key, size_t size);
+u64  _hm_hash_string(const void *key, size_t size);
+bool _hm_eq_bytes(const void *a, const void *b, size_t size);
+bool _hm_eq_string(const void *a, const void *b, size_t size);
+void  _hm_reserve(_HashmapRaw *m, _HashmapType t, size_t count);
+void *_hm_put(_HashmapRaw *m, _HashmapType t, const void *key, const void *value);
+void *_hm_get(const _HashmapRaw *m, _HashmapType t, const void *key);
+bool  _hm_remove(_HashmapRaw *m, _HashmapType t, const void *key);
+bool  _hm_next(const _HashmapRaw *m, size_t *index);
+void  _hm_free(_HashmapRaw *m);
+
+#define _hm_type(map) ((_HashmapType){ \
+    sizeof(*(map).keys), \
+    sizeof(*(map).values), \
+    _Generic((map)._key, string: _hm_hash_string, default: _hm_hash_bytes), \
+    _Generic((map)._key, string: _hm_eq_string,   default: _hm_eq_bytes), \
+    })
+
+#define hm_reserve(map, count) _hm_reserve((_HashmapRaw *)&(map), _hm_type(map), (count))          // @Memory
+#define hm_put(map, key, value) ((map)._key = (key), (map)._value = (value), \
+                                 _hm_put((_HashmapRaw *)&(map), _hm_type(map), &(map)._key, &(map)._value)) // @Memory, returns pointer to the stored value
+// Lookups take their own copy of the key so the map isn't touched (and can be const),
+// a one element array because a struct key can't be the whole of a struct's braces
+#define _hm_key(map, key)   ((__typeof__((map)._key)[1]){ (key) })
+#define hm_get(map, key)    _hm_get((const _HashmapRaw *)&(map), _hm_type(map), _hm_key(map, key))    // pointer to value or NULL
+#define hm_contains(map, key) (hm_get(map, key) != NULL)
+#define hm_remove(map, key) _hm_remove((_HashmapRaw *)&(map), _hm_type(map), _hm_key(map, key)) // false if it wasn't there
+#define hm_next(map, index) _hm_next((_HashmapRaw *)&(map), (index)) // moves index to the next filled slot, false at the end
+#define hm_free(map)        _hm_free((_HashmapRaw *)&(map))
+
+// String interning
+// Equal strings get the same id and the same canonical slice, so once interned
+// comparing is just `a.data == b.data` and duplicates are only stored once.
+// Canonical slices stay valid until string_interner_free.
+typedef struct {
+    hashmap(string, u32) ids; // internal, canonical slice -> id
+    StringList   strings;     // id -> canonical slice
+    dynarray(char *) blocks; // internal, storage for the bytes, never moves
+    char        *block;      // internal, block currently being filled
+    size_t       block_used; // internal
+} StringInterner;
+
+u32    string_intern_id(StringInterner *in, const string source); // @Memory
+string string_intern(StringInterner *in, const string source);    // @Memory
+string string_interned(const StringInterner *in, u32 id);
+void   string_interner_free(StringInterner *in);
+
+// StringBuilder
+// Appends into a chain of chunks so growing never copies what is already written,
+// only flatten (one copy) or flush (written straight out chunk by chunk) at the end.
+// Chunks start at SB_CHUNK_SIZE and grow with the builder up to SB_CHUNK_MAX.
+#define SB_CHUNK_SIZE (4 * 1024)
+#define SB_CHUNK_MAX  (1024 * 1024)
+
+typedef struct _SbChunk {
+    struct _SbChunk *next;
+    size_t len;
+    size_t cap;
+    char   data[];
+} _SbChunk;
+
+typedef struct {
+    _SbChunk *head; // internal
+    _SbChunk *tail; // internal
+    size_t    len;  // total bytes written
+} StringBuilder;
+
+void          sb_appends(StringBuilder *sb, const string slice); // @Memory
+size_t        sb_write(StringBuilder *sb, char *text);           // @Memory
+string        sb_flatten(const StringBuilder *sb);               // @Memory owning, null terminated copy
+size_t        sb_flush(StringBuilder *sb, void *dest);           // writes everything to dest then resets
+void          sb_reset(StringBuilder *sb);                       // keeps the first chunk around for reuse
+void          sb_free(StringBuilder *sb);
+// sb_append(sb, ...) / sb_appendf(sb, ...) format like my_print / my_printf (see below)
 
 // Better Printing
 typedef enum {
@@ -140,21 +383,40 @@ typedef enum {
     T_WCHAR,
 
     T_STR,
-    T_PTR
+    T_PTR,
+
+    T_STRING,  // string slice
+    T_CUSTOM,  // anything else with a formatter (StringList too), see arg_custom
+
+    T_FMT,  // internal, a format string with its parsed call site cache
+    T_STRN, // internal, the rest of a padded/truncated string placeholder
+    T_STRREF, // internal, a big string the printer writes from where it is
 } tag_t;
 
+typedef struct FormatCache FormatCache;
+typedef struct FormatSpec FormatSpec;
+typedef struct FormatWriter FormatWriter;
+typedef void (*FormatTypeFn)(FormatWriter *w, const void *value, FormatSpec spec);
+
+// 16 bytes, so a print's args take a cache line per four. Whatever doesn't fit
+// in the 8 byte value goes in aux or lives somewhere else: long doubles and
+// StringLists are boxed by TypedArg and custom formatters are looked up by index.
 typedef struct {
-    tag_t tag;
+    u64 tag : 8;  // tag_t
+    u64 aux : 56; // T_STRING/T_STRN/T_STRREF length, T_FMT position, T_CUSTOM see _format_custom
     union {
-    long long          i;   // signed integers
-    unsigned long long u;   // unsigned integers
-    double             d;   // floats/doubles
-    long double        ld;  // long floats/doubles
-    void              *p;   // pointers
-    char              *s;   // strings
-    bool               b;   // boolean
+    long long          i;     // signed integers
+    unsigned long long u;     // unsigned integers
+    double             d;     // floats/doubles
+    const long double *ld;    // long doubles, boxed
+    void              *p;     // pointers
+    char              *s;     // strings, null terminated for T_STR otherwise aux long
+    bool               b;     // boolean
+    FormatCache       *cache; // T_FMT
+    const void        *value; // T_CUSTOM
     };
 } TypeInfo;
+_Static_assert(sizeof(TypeInfo) == 16, "TypeInfo should be two words");
 
 TypeInfo arg_char(char x)                     { return (TypeInfo){ T_CHAR,    .i   = x }; }
 TypeInfo arg_schar(signed char x)             { return (TypeInfo){ T_SCHAR,   .i  = x }; }
@@ -176,7 +438,7 @@ TypeInfo arg_bool(bool x)                     { return (TypeInfo){ T_BOOL,    .b
 
 TypeInfo arg_float(float x)                   { return (TypeInfo){ T_FLOAT,   .d   = x }; }
 TypeInfo arg_double(double x)                 { return (TypeInfo){ T_DOUBLE,  .d   = x }; }
-TypeInfo arg_ldouble(long double x)            { return (TypeInfo){ T_LDOUBLE, .ld  = x }; }
+TypeInfo arg_ldouble(const long double *x)    { return (TypeInfo){ T_LDOUBLE, .ld  = x }; } // has to outlive the print
 
 TypeInfo arg_str(char *x)                     { return (TypeInfo){ T_STR,     .s   = x }; }
 TypeInfo arg_cstr(const char *x)              { return (TypeInfo){ T_STR,     .s   = (char *)x }; }
@@ -184,7 +446,36 @@ TypeInfo arg_cstr(const char *x)              { return (TypeInfo){ T_STR,     .s
 TypeInfo arg_ptr(void *x)                     { return (TypeInfo){ T_PTR,     .p   = x }; }
 TypeInfo arg_cptr(const void *x)              { return (TypeInfo){ T_PTR,     .p   = (void *)x }; }
 
+TypeInfo arg_string(string x)                 { return (TypeInfo){ T_STRING,  .aux = x.len, .s = x.data }; }
+
+// Types that share a C type with one above, so TypedArg can't tell them apart
+TypeInfo arg_size(size_t x)                   { return (TypeInfo){ T_SIZE,    .u   = x }; }
+TypeInfo arg_ptrdiff(ptrdiff_t x)             { return (TypeInfo){ T_PTRDIFF, .i   = x }; }
+TypeInfo arg_wchar(wchar_t x)                 { return (TypeInfo){ T_WCHAR,   .u   = (u32)x }; } // printed as UTF-8
+
+u64      _format_type_index(FormatTypeFn fn);
+TypeInfo arg_custom(const void *value, FormatTypeFn fn) { return (TypeInfo){ T_CUSTOM, .aux = _format_type_index(fn), .value = value }; }
+
+void     format_string_list(FormatWriter *w, const void *value, FormatSpec spec); // [a, b, c] with spec applied to each item
+TypeInfo arg_string_list(const StringList *x) { return arg_custom(x, format_string_list); }
+
+// Your own types go in here, define it after including us like
+//     #undef  JP_FORMAT_TYPES
+//     #define JP_FORMAT_TYPES Vec2 *: arg_vec2, IntList *: arg_int_list,
+// where the arg_ functions are declared before anything gets printed (see
+// "Custom types" below for writing them)
+#define JP_FORMAT_TYPES
+
+// Long doubles and StringLists don't fit in a TypeInfo, they're copied into a
+// compound literal that lives as long as the args array does
+#define _TYPED_BOX(x, type) ((type[1]){ _Generic((x), type: (x), default: (type){0}) })
 #define TypedArg(x) _Generic((x), \
+    long double: arg_ldouble(_TYPED_BOX(x, long double)), \
+    StringList:  arg_string_list(_TYPED_BOX(x, StringList)), \
+    default:     _TypedArg(_Generic((x), long double: 0.0, StringList: 0.0, default: (x))))
+
+#define _TypedArg(x) _Generic((x), \
+    JP_FORMAT_TYPES \
     char:               arg_char, \
     signed char:        arg_schar, \
     unsigned char:      arg_uchar, \
@@ -192,18 +483,20 @@ TypeInfo arg_cptr(const void *x)              { return (TypeInfo){ T_PTR,     .p
     unsigned short:     arg_ushort, \
     int:                arg_int, \
     unsigned int:       arg_uint, \
-    long:               arg_ulong, \
+    long:               arg_long, \
     unsigned long:      arg_ulong, \
     long long:          arg_llong, \
     unsigned long long: arg_ullong, \
     bool:               arg_bool, \
     float:              arg_float, \
     double:             arg_double, \
-    long double:        arg_ldouble, \
     char *:             arg_str, \
     const char *:       arg_cstr, \
     void *:             arg_ptr, \
-    const void *:       arg_cptr \
+    const void *:       arg_cptr, \
+    string:             arg_string, \
+    StringList *:       arg_string_list, \
+    const StringList *: arg_string_list \
 )(x)
 
 // Macro Helpers
@@ -369,9 +662,141 @@ TypeInfo arg_cptr(const void *x)              { return (TypeInfo){ T_PTR,     .p
 #define FOREACH(m, ...) FOREACH_DO(VA_COUNT(__VA_ARGS__), m, __VA_ARGS__)
 
 void printf_impl(size_t n, TypeInfo *args, bool isf);
+void fprintf_impl(int stream, size_t n, TypeInfo *args, bool isf);
 // void printf_impl(char *fmt, size_t n, const TypeInfo *args);
 void writef_impl(char *fmt, size_t n, const TypeInfo *args, bool isf);
 
+// Number formatting
+// Flags from the format syntax (see "Syntax to add" in the implementation)
+#define FMT_LEFT  (1 << 0) // -
+#define FMT_SIGN  (1 << 1) // +
+#define FMT_SPACE (1 << 2) // ' '
+#define FMT_ZERO  (1 << 3) // 0
+#define FMT_ALT   (1 << 4) // # 0x/0b/0 prefixes
+#define FMT_UPPER (1 << 5) // U
+#define FMT_WIDTH_ARG     (1 << 6) // *  width comes from the next arg
+#define FMT_PRECISION_ARG (1 << 7) // .* precision comes from the next arg
+
+struct FormatSpec {
+    u16 width;     // minimum field width
+    s16 precision; // minimum digits for integers, decimals for floats, max chars for strings, -1 for the default
+    u8  base;      // 2-38 (see _basesystem), 0 is decimal
+    u8  flags;     // FMT_*
+    char conv;     // printf conversion letter if one was given, 0 otherwise
+};
+#define FORMAT_SPEC_DEFAULT ((FormatSpec){ .precision = -1 })
+// Width (and precision for numbers) is clamped to this so any field fits in an
+// empty print buffer, strings can have any precision
+#define FORMAT_WIDTH_MAX 1024
+// Longest integer without width/precision: sign + 0b + 64 binary digits
+#define FORMAT_INT_MAX 67
+
+// Writes magnitude (with a '-' if negative) to out, which must have room for
+// FORMAT_INT_MAX + width + precision bytes. Returns bytes written.
+size_t format_int(char *out, u64 magnitude, bool negative, FormatSpec spec);
+
+// Format strings are split into a literal run followed by an optional placeholder.
+// my_printf and friends parse literal format strings once per call site into a
+// static FormatCache, after that printing only copies spans and formats the args.
+typedef struct {
+    u32        start;    // literal run, offset into the format string
+    u32        len;
+    u32        spec_len; // bytes of placeholder text after the run, 0 at the end
+    bool       arg;      // placeholder consumes an arg ("%%" doesn't)
+    FormatSpec spec;
+} FormatSegment;
+
+#define FORMAT_CACHE_SEGMENTS 16 // more placeholders than this just aren't cached
+struct FormatCache {
+    const char   *fmt;
+    u32           len;
+    u32           count;
+    u32           state; // internal, FORMAT_CACHE_*
+    FormatSegment segments[FORMAT_CACHE_SEGMENTS];
+};
+#define FORMAT_CACHE_EMPTY   0
+#define FORMAT_CACHE_FILLING 1
+#define FORMAT_CACHE_READY   2
+#define FORMAT_CACHE_UNUSED  3
+
+FormatSegment format_parse_segment(const char *fmt, u32 len, u32 pos);
+void _format_use_cache(FormatCache *cache, TypeInfo *args);
+
+// Only literals are cached, a char * variable could point at different text next call
+#define _FORMAT_FIRST(first, ...) first
+#define _FORMAT_CACHE(args, ...) \
+    do { \
+        static FormatCache _cache; \
+        if (__builtin_constant_p(_FORMAT_FIRST(__VA_ARGS__, 0))) _format_use_cache(&_cache, args); \
+    } while (0)
+
+// Custom types
+// A FormatTypeFn writes a value straight into the output, through
+// format_reserve + format_commit or format_write, without worrying about how
+// much room there is. If the output fills up part way it gets called again
+// once there's room, with what already went out skipped, so it has to write
+// the same thing every time. Nothing is allocated along the way.
+// Anything big should format_mark where it could start again from (a list
+// marks each item) and begin at format_resume, otherwise every refill of the
+// output runs it from the top again.
+// ```
+// void format_vec2(FormatWriter *w, const void *value, FormatSpec spec)
+// {
+//     const Vec2 *v = value;
+//     format_write(w, "(", 1);
+//     format_arg(w, arg_float(v->x), spec);
+//     format_write(w, ", ", 2);
+//     format_arg(w, arg_float(v->y), spec);
+//     format_write(w, ")", 1);
+// }
+// TypeInfo arg_vec2(Vec2 *v) { return arg_custom(v, format_vec2); }
+// ```
+// then add Vec2 * to JP_FORMAT_TYPES. Custom values are passed by pointer and
+// have to stay put until the print is done (the async logger formats them at
+// the log call).
+#define FORMAT_RESERVE_MAX 4096 // most format_reserve hands out at once
+
+struct FormatWriter {
+    string *buf;
+    size_t  skip;     // internal, bytes that went out on an earlier go
+    size_t  pos;      // internal, bytes produced so far this go
+    size_t  stop;     // internal, where we ran out of room
+    bool    full;     // internal
+    char   *reserved; // internal
+    u64     resume;   // internal, the mark this go started from
+    u64     mark;     // internal, last format_mark and where it was
+    size_t  mark_pos; // internal
+    u32     depth;    // internal, values inside values don't mark
+    char    scratch[FORMAT_RESERVE_MAX];
+};
+
+char *format_reserve(FormatWriter *w, size_t len); // room for len bytes, NULL if len > FORMAT_RESERVE_MAX, commit before anything else
+void  format_commit(FormatWriter *w, size_t len);  // len of the reserved bytes were written
+void  format_write(FormatWriter *w, const char *data, size_t len);
+void  format_arg(FormatWriter *w, TypeInfo arg, FormatSpec spec); // any printable value, custom ones too
+bool  format_full(const FormatWriter *w);          // nothing else fits this go, long formatters can stop early
+void  format_mark(FormatWriter *w, u64 state);     // output from here is what starting at state writes, use 1 up
+u64   format_resume(const FormatWriter *w);        // the state to start at, 0 for the top
+
+// A formatter and arg_<name> for a typedef'd dynarray, printed like [1, 2, 3]
+// with spec applied to each item. Add name * to JP_FORMAT_TYPES to use it, and
+// since the items go through TypedArg do that before this for lists of custom types.
+#define FORMAT_DYNARRAY(name) \
+    TypeInfo arg_##name(name *arr); \
+    void format_##name(FormatWriter *w, const void *value, FormatSpec spec) \
+    { \
+        const name *arr = (const name *)value; \
+        u64 from = format_resume(w); /* item i is marked i + 1 */ \
+        if (!from) format_write(w, "[", 1); \
+        for (size_t i = from ? from - 1 : 0; i < arr->len && !format_full(w); i++) { \
+            format_mark(w, i + 1); \
+            if (i) format_write(w, ", ", 2); \
+            format_arg(w, TypedArg(arr->data[i]), spec); \
+        } \
+        format_write(w, "]", 1); \
+    } \
+    TypeInfo arg_##name(name *arr) { return arg_custom(arr, format_##name); }
+
 // Better Printing API
 #define my_print(...) \
     do { \
@@ -382,12 +807,151 @@ void writef_impl(char *fmt, size_t n, const TypeInfo *args, bool isf);
 #define my_printf(...) \
     do { \
         TypeInfo _args[] = { FOREACH(TypedArg, __VA_ARGS__) }; \
+        _FORMAT_CACHE(_args, __VA_ARGS__); \
         printf_impl(sizeof(_args)/sizeof(_args[0]), _args, true); \
     } while(0)
 
 #define my_println(...) my_print(__VA_ARGS__, "\n")
 #define my_printfln(...) my_printf(__VA_ARGS__, "\n")
 
+// Same again but to stderr
+#define my_eprint(...) \
+    do { \
+        TypeInfo _args[] = { FOREACH(TypedArg, __VA_ARGS__) }; \
+        fprintf_impl(STDERR, sizeof(_args)/sizeof(_args[0]), _args, false); \
+    } while(0)
+
+#define my_eprintf(...) \
+    do { \
+        TypeInfo _args[] = { FOREACH(TypedArg, __VA_ARGS__) }; \
+        _FORMAT_CACHE(_args, __VA_ARGS__); \
+        fprintf_impl(STDERR, sizeof(_args)/sizeof(_args[0]), _args, true); \
+    } while(0)
+
+#define my_eprintln(...) my_eprint(__VA_ARGS__, "\n")
+#define my_eprintfln(...) my_eprintf(__VA_ARGS__, "\n")
+
+// Output streams
+// Printing goes straight to the OS (write(2) / WriteFile) on every call unless
+// the stream is buffered. Buffered streams format into one process wide buffer
+// per stream and only hit the OS when:
+//   FLUSH_LINE - a print ends up putting a newline in the buffer (like a terminal)
+//   FLUSH_FULL - the buffer fills up (like a file or pipe)
+// or on print_flush(). Buffered output is flushed at exit too.
+#define STDIN  0
+#define STDOUT 1
+#define STDERR 2
+
+typedef enum {
+    FLUSH_NONE, // unbuffered, the default
+    FLUSH_LINE,
+    FLUSH_FULL,
+} FlushMode;
+
+#define PRINT_BUFFER_SIZE (64 * 1024)
+// String args at least this long aren't copied into the print buffer, they're
+// handed to writev (along with the formatted bits around them) where they are
+#define PRINT_ZERO_COPY_MIN 1024
+
+void   print_buffered(int stream, FlushMode mode); // STDOUT or STDERR
+void   print_flush(void);                          // writes out anything buffered on both
+size_t print_write(int stream, const char *data, size_t len); // raw bytes, goes through the buffer
+
+// Async logging
+// log_start spins up a writer thread, then log_print and friends format into the
+// calling thread's own ring buffer and push the record onto a lock-free queue.
+// The writer thread batches records into writev calls, so the caller's cost is
+// formatting + a copy + one atomic exchange. Until log_start (and after
+// log_stop) they just print synchronously. Unix only for now, build with -pthread.
+typedef enum {
+    LOG_FULL_BLOCK, // wait for the writer to catch up (default)
+    LOG_FULL_DROP,  // throw the record away, see log_dropped()
+    LOG_FULL_GROW,  // malloc the record instead
+} LogFullPolicy;
+
+typedef struct {
+    size_t        thread_buffer; // ring size per logging thread, default LOG_THREAD_BUFFER
+    LogFullPolicy on_full;
+    bool          binary;        // write binary records instead of text, see below
+    const char   *path;          // append to this file instead of the stream
+} LogConfig;
+#define LOG_THREAD_BUFFER (64 * 1024)
+
+bool   log_start(int stream, LogConfig config); // false if it's already running
+void   log_stop(void);                          // writes everything queued, stop logging from other threads first
+size_t log_dropped(void);
+void   log_impl(size_t n, TypeInfo *args, bool isf);
+
+#define log_print(...) \
+    do { \
+        TypeInfo _args[] = { FOREACH(TypedArg, __VA_ARGS__) }; \
+        log_impl(sizeof(_args)/sizeof(_args[0]), _args, false); \
+    } while(0)
+
+#define log_printf(...) \
+    do { \
+        TypeInfo _args[] = { FOREACH(TypedArg, __VA_ARGS__) }; \
+        _FORMAT_CACHE(_args, __VA_ARGS__); \
+        log_impl(sizeof(_args)/sizeof(_args[0]), _args, true); \
+    } while(0)
+
+#define log_println(...) log_print(__VA_ARGS__, "\n")
+#define log_printfln(...) log_printf(__VA_ARGS__, "\n")
+
+// Log levels
+// log_error(...) through log_trace(...) are log_printfln with a level. Levels
+// above JP_LOG_LEVEL (define it before including, default LOG_TRACE) are
+// compiled out, their args aren't even evaluated. Levels above the runtime
+// level (LOG_INFO until log_set_level) cost one branch, nothing gets packed.
+// Use log_enabled(level) to skip building something only a log needs.
+#define LOG_OFF   0
+#define LOG_ERROR 1
+#define LOG_WARN  2
+#define LOG_INFO  3
+#define LOG_DEBUG 4
+#define LOG_TRACE 5
+#ifndef JP_LOG_LEVEL
+#define JP_LOG_LEVEL LOG_TRACE
+#endif
+
+void log_set_level(int level);
+
+#define log_enabled(level) ((level) <= JP_LOG_LEVEL && (level) <= __atomic_load_n(&_log_level, __ATOMIC_RELAXED))
+#define _log_at(level, ...) \
+    do { \
+        if (log_enabled(level)) log_printfln(__VA_ARGS__); \
+    } while (0)
+
+#define log_error(...) _log_at(LOG_ERROR, __VA_ARGS__)
+#define log_warn(...)  _log_at(LOG_WARN,  __VA_ARGS__)
+#define log_info(...)  _log_at(LOG_INFO,  __VA_ARGS__)
+#define log_debug(...) _log_at(LOG_DEBUG, __VA_ARGS__)
+#define log_trace(...) _log_at(LOG_TRACE, __VA_ARGS__)
+
+// Binary logging
+// With LogConfig.binary the log_* calls don't format anything, each arg goes
+// into the record as its tag and raw value (strings as their bytes), and a
+// literal format string is just its call site id. The writer thread writes out
+// a call site's format string the first time it comes through. log_decode turns
+// that back into text with the same formatter, decode_log.c wraps it up as a tool.
+// Records are in this machine's byte order and long double, decode them on the
+// same kind of machine.
+typedef hashmap(u64, void *) _LogSites; // site id to its format string
+
+typedef struct {
+    _LogSites    sites;
+    TypeInfo    *args;
+    long double *ldoubles; // what T_LDOUBLE args point at
+    size_t       args_cap;
+    bool         header;   // seen the header record
+    const char  *error;    // set when the data isn't a binary log we understand, decoding stops there
+} LogDecoder;
+
+// Appends the text for every whole record in data to out and returns how many
+// bytes that used, a partial record at the end is left for the next call
+size_t log_decode(LogDecoder *d, string data, StringBuilder *out); // @Memory
+void   log_decoder_free(LogDecoder *d);
+
 // @Incomplete I want thjp_is _Generic write(<type>) and firing off to write_string, write_file, write_output
 #define write_string(dst, ...) \
     do { \
@@ -398,9 +962,63 @@ void writef_impl(char *fmt, size_t n, const TypeInfo *args, bool isf);
 #define writef_string(dst, ...) \
     do { \
         TypeInfo _args[] = { FOREACH(TypedArg, __VA_ARGS__) }; \
+        _FORMAT_CACHE(_args, __VA_ARGS__); \
         writef_string_impl(dst, sizeof(_args)/sizeof(_args[0]), _args, true); \
     } while(0)
 
+// Sizes without writing or allocating, *out is how many bytes the same
+// write_string/writef_string would add: writef_length(&len, "% = %", name, x)
+size_t format_length(size_t argc, TypeInfo *args, bool isf);
+
+#define write_length(out, ...) \
+    do { \
+        TypeInfo _args[] = { FOREACH(TypedArg, __VA_ARGS__) }; \
+        *(out) = format_length(sizeof(_args)/sizeof(_args[0]), _args, false); \
+    } while(0)
+
+#define writef_length(out, ...) \
+    do { \
+        TypeInfo _args[] = { FOREACH(TypedArg, __VA_ARGS__) }; \
+        _FORMAT_CACHE(_args, __VA_ARGS__); \
+        *(out) = format_length(sizeof(_args)/sizeof(_args[0]), _args, true); \
+    } while(0)
+
+// Formatting into memory that's already there (packet headers, shm slots, stack
+// arrays), nothing is allocated. Up to cap bytes go into buf with no null
+// terminator, *need gets the whole length so it was cut short if *need > cap:
+// writef_into(&need, header, sizeof(header), "% %", id, len)
+size_t format_into(char *buf, size_t cap, size_t argc, TypeInfo *args, bool isf);
+
+#define write_into(need, buf, cap, ...) \
+    do { \
+        TypeInfo _args[] = { FOREACH(TypedArg, __VA_ARGS__) }; \
+        *(need) = format_into(buf, cap, sizeof(_args)/sizeof(_args[0]), _args, false); \
+    } while(0)
+
+#define writef_into(need, buf, cap, ...) \
+    do { \
+        TypeInfo _args[] = { FOREACH(TypedArg, __VA_ARGS__) }; \
+        _FORMAT_CACHE(_args, __VA_ARGS__); \
+        *(need) = format_into(buf, cap, sizeof(_args)/sizeof(_args[0]), _args, true); \
+    } while(0)
+
+// Same again into a slice, its len is the room
+#define write_into_slice(need, slice, ...)  write_into(need, (slice).data, (slice).len, __VA_ARGS__)
+#define writef_into_slice(need, slice, ...) writef_into(need, (slice).data, (slice).len, __VA_ARGS__)
+
+#define sb_append(sb, ...) \
+    do { \
+        TypeInfo _args[] = { FOREACH(TypedArg, __VA_ARGS__) }; \
+        sb_append_impl(sb, sizeof(_args)/sizeof(_args[0]), _args, false); \
+    } while(0)
+
+#define sb_appendf(sb, ...) \
+    do { \
+        TypeInfo _args[] = { FOREACH(TypedArg, __VA_ARGS__) }; \
+        _FORMAT_CACHE(_args, __VA_ARGS__); \
+        sb_append_impl(sb, sizeof(_args)/sizeof(_args[0]), _args, true); \
+    } while(0)
+
 // IO 
 #define IO_FILE    1
 #define IO_DIR     2
@@ -410,7 +1028,6 @@ typedef struct {
     bool use_relative; // Don't include PWD if searching inside it
 } readdir_opts;
 
-typedef dynarray(string) StringList;
 StringList read_dir_cstr(string path, readdir_opts opts); // @Memory
 StringList read_dir_string(string path, readdir_opts opts); // @Memory
 
@@ -430,34 +1047,334 @@ string read_entire_file(string filepath); // @Memory
 #include <malloc.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h> // atexit
+
+//
+// SIMD support
+//
+// x86 builds compile every SIMD path with target attributes and pick one at
+// runtime, so the header still works on machines without AVX etc.
+// Define JP_NO_SIMD before including to force the scalar paths everywhere.
+#if !defined(JP_NO_SIMD) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define JP_SIMD_X86 1
+#include <immintrin.h>
+#define JP_TARGET(isa) __attribute__((target(isa)))
+#else
+#define JP_SIMD_X86 0
+#define JP_TARGET(isa)
+#endif
+
+#define CPU_SSE2     (1 << 0)
+#define CPU_SSE42    (1 << 1)
+#define CPU_AVX2     (1 << 2)
+#define CPU_AVX512BW (1 << 3)
+#define CPU_CHECKED  (1u << 31)
+
+u32 _cpu_features = 0; // internal, use cpu_features()
+
+// The dispatch pointers below start at a resolver and get swapped on first
+// call, maybe by several threads at once. They all store the same thing so
+// relaxed is enough, it just has to be atomic
+#define _impl_load(impl)        __atomic_load_n(&(impl), __ATOMIC_RELAXED)
+#define _impl_store(impl, with) __atomic_store_n(&(impl), (with), __ATOMIC_RELAXED)
+
+// Checked once then cached, everything dispatching on ISA goes through here
+u32 cpu_features(void)
+{
+    u32 cached = _impl_load(_cpu_features);
+    if (cached & CPU_CHECKED) return cached;
+    u32 features = CPU_CHECKED;
+#if JP_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2"))     features |= CPU_SSE2;
+    if (__builtin_cpu_supports("sse4.2"))   features |= CPU_SSE42;
+    if (__builtin_cpu_supports("avx2"))     features |= CPU_AVX2;
+    if (__builtin_cpu_supports("avx512bw")) features |= CPU_AVX512BW;
+#endif
+    _impl_store(_cpu_features, features);
+    return features;
+}
+
+// Aligned block reads may touch bytes past the end of the string (but never past
+// the page), which is fine for the hardware but not for AddressSanitizer, or
+// ThreadSanitizer which calls them a use after free
+#if defined(__GNUC__)
+#define JP_NO_ASAN __attribute__((no_sanitize_address, no_sanitize("thread")))
+#else
+#define JP_NO_ASAN
+#endif
+
+#if defined(__GNUC__)
+#define _ctz32(x) ((size_t)__builtin_ctz(x))
+#define _ctz64(x) ((size_t)__builtin_ctzll(x))
+#else
+size_t _ctz64(u64 x) { size_t n = 0; while (!(x & 1)) { x >>= 1; n++; } return n; }
+#define _ctz32(x) _ctz64((u64)(x))
+#endif
+
+// SWAR helpers, work on 8 bytes at a time in a plain register
+#if defined(__GNUC__)
+typedef u64 __attribute__((may_alias)) _u64_alias;
+#else
+typedef u64 _u64_alias;
+#endif
+#define SWAR_ONES  0x0101010101010101ull
+#define SWAR_HIGHS 0x8080808080808080ull
+#define swar_haszero(v)      (((v) - SWAR_ONES) & ~(v) & SWAR_HIGHS)
+#define swar_hasbyte(v, c)   swar_haszero((v) ^ (SWAR_ONES * (u8)(c)))
+
+// Unaligned load, compiles down to a single mov on anything sensible
+u64 _load_u64(const void *p)
+{
+#if defined(__GNUC__)
+    u64 v;
+    __builtin_memcpy(&v, p, sizeof(v));
+    return v;
+#else
+    const u8 *b = (const u8 *)p;
+    u64 v = 0;
+    for (int i = 7; i >= 0; i--) v = (v << 8) | b[i];
+    return v;
+#endif
+}
 
 //
 // libc string.h replacements
 //
 
+// All of these read whole aligned blocks, an aligned load can never cross a
+// page boundary so we never fault even if we read a bit past the terminator
+JP_NO_ASAN
+size_t _cstrlen_scalar(const char *source)
+{
+    const char *p = source;
+    for (; (uintptr_t)p & 7; p++) if (!*p) return p - source;
+    for (;; p += 8) {
+        u64 v = *(const _u64_alias *)p;
+        if (swar_haszero(v)) break;
+    }
+    while (*p) p++;
+    return p - source;
+}
+
+#if JP_SIMD_X86
+JP_TARGET("sse2") JP_NO_ASAN
+size_t _cstrlen_sse2(const char *source)
+{
+    const char *p = (const char *)((uintptr_t)source & ~(uintptr_t)15);
+    __m128i zero = _mm_setzero_si128();
+    u32 mask = (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128((const __m128i *)p), zero));
+    mask >>= (source - p); // ignore bytes before the start of the string
+    if (mask) return _ctz32(mask);
+    for (;;) {
+        p += 16;
+        mask = (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128((const __m128i *)p), zero));
+        if (mask) return (p - source) + _ctz32(mask);
+    }
+}
+
+JP_TARGET("avx2") JP_NO_ASAN
+size_t _cstrlen_avx2(const char *source)
+{
+    const char *p = (const char *)((uintptr_t)source & ~(uintptr_t)31);
+    __m256i zero = _mm256_setzero_si256();
+    u32 mask = (u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_load_si256((const __m256i *)p), zero));
+    mask >>= (source - p);
+    if (mask) return _ctz32(mask);
+    p += 32;
+    // get to 64 byte alignment so the unrolled loop below stays on one cache line per iteration
+    if ((uintptr_t)p & 63) {
+        mask = (u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_load_si256((const __m256i *)p), zero));
+        if (mask) return (p - source) + _ctz32(mask);
+        p += 32;
+    }
+    for (;; p += 64) {
+        __m256i a = _mm256_load_si256((const __m256i *)p);
+        __m256i b = _mm256_load_si256((const __m256i *)(p + 32));
+        // min of the two is zero iff either had a zero byte
+        if (!_mm256_testz_si256(_mm256_cmpeq_epi8(_mm256_min_epu8(a, b), zero), _mm256_set1_epi8(-1))) {
+            u64 lo = (u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, zero));
+            u64 hi = (u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(b, zero));
+            return (p - source) + _ctz64(lo | (hi << 32));
+        }
+    }
+}
+
+JP_TARGET("avx512f,avx512bw") JP_NO_ASAN
+size_t _cstrlen_avx512(const char *source)
+{
+    const char *p = (const char *)((uintptr_t)source & ~(uintptr_t)63);
+    __m512i zero = _mm512_setzero_si512();
+    u64 mask = _mm512_cmpeq_epi8_mask(_mm512_load_si512((const void *)p), zero);
+    mask >>= (source - p);
+    if (mask) return _ctz64(mask);
+    for (;;) {
+        p += 64;
+        mask = _mm512_cmpeq_epi8_mask(_mm512_load_si512((const void *)p), zero);
+        if (mask) return (p - source) + _ctz64(mask);
+    }
+}
+#endif // JP_SIMD_X86
+
+size_t _cstrlen_resolve(const char *source);
+size_t (*_cstrlen_impl)(const char *) = _cstrlen_resolve; // internal
+
+// First call picks the best implementation for this CPU and swaps itself out
+size_t _cstrlen_resolve(const char *source)
+{
+    u32 cpu = cpu_features();
+    (void)cpu;
+    __typeof__(_cstrlen_impl) impl = _cstrlen_scalar;
+#if JP_SIMD_X86
+    if      (cpu & CPU_AVX512BW) impl = _cstrlen_avx512;
+    else if (cpu & CPU_AVX2)     impl = _cstrlen_avx2;
+    else if (cpu & CPU_SSE2)     impl = _cstrlen_sse2;
+#endif
+    _impl_store(_cstrlen_impl, impl);
+    return impl(source);
+}
+
 // Returns string with len **NOT** including null terminator
 string cstrlen(char *source)
 {
-    string result = { .data = source };
-    // @Incomplete - compiler does not optimise this out 
-    // Rewrite using SIMD instructions
-    // These should be gaurded and default to this if not avail
+    return (string){ .data = source, .len = _impl_load(_cstrlen_impl)(source) };
+}
 
-    for (result.len = 0; source[result.len] != '\0' && result.len < SIZE_MAX; result.len++);
-    return result;
+//
+// Character classes
+//
+const u8 _char_class[256] = {
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x01, 0x01, 0x01, 0x01, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x01, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+    0x0c, 0x0c, 0x0c, 0x0c, 0x0c, 0x0c, 0x0c, 0x0c, 0x0c, 0x0c, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+    0x10, 0x2a, 0x2a, 0x2a, 0x2a, 0x2a, 0x2a, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22,
+    0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x10, 0x10, 0x10, 0x10, 0x10,
+    0x10, 0x4a, 0x4a, 0x4a, 0x4a, 0x4a, 0x4a, 0x42, 0x42, 0x42, 0x42, 0x42, 0x42, 0x42, 0x42, 0x42,
+    0x42, 0x42, 0x42, 0x42, 0x42, 0x42, 0x42, 0x42, 0x42, 0x42, 0x42, 0x10, 0x10, 0x10, 0x10, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+bool jp_isspace(char c) { return _char_class[(u8)c] & CHAR_SPACE; }
+bool jp_isalpha(char c) { return _char_class[(u8)c] & CHAR_ALPHA; }
+bool jp_isnum(char c)   { return _char_class[(u8)c] & CHAR_DIGIT; }
+bool jp_ishex(char c)   { return _char_class[(u8)c] & CHAR_HEX; }
+bool jp_ispunct(char c) { return _char_class[(u8)c] & CHAR_PUNCT; }
+
+// Returns the index of the first byte whose membership of classes != member
+size_t _span_class_scalar(const char *data, size_t len, u8 classes, bool member)
+{
+    size_t i = 0;
+    while (i < len && (bool)(_char_class[(u8)data[i]] & classes) == member) i++;
+    return i;
 }
 
-bool jp_isspace(char c)
+#if JP_SIMD_X86
+// Any byte set can be tested 16 bytes at a time with two nibble lookups (Mula's method):
+// lo nibble picks a row of 8 bits per table (one table for hi nibbles 0-7, one for 8-15)
+// hi nibble then picks the bit. The tables are built once per class combination.
+// Whichever thread gets there first publishes its table (0 empty, 1 being
+// copied in, 2 ready), the rest use the one they built into local until then.
+u8 _class_nibbles[256][32]; // internal
+u8 _class_nibbles_state[256];
+
+const u8 *_class_nibbles_get(u8 classes, u8 local[32])
 {
-    // @Incomplete - compiler does not optimise this out 
-    // Rewrite using SIMD instructions
-    // These should be gaurded and default to this if not avail
-    return c == ' '  || 
-           c == '\t' || 
-           c == '\n' || 
-           c == '\r' ||
-           c == '\v' ||
-           c == '\f';
+    if (__atomic_load_n(&_class_nibbles_state[classes], __ATOMIC_ACQUIRE) == 2) return _class_nibbles[classes];
+    __builtin_memset(local, 0, 32);
+    for (size_t b = 0; b < 256; b++) {
+        if (!(_char_class[b] & classes)) continue;
+        local[(b >> 7) * 16 + (b & 15)] |= (u8)(1 << ((b >> 4) & 7));
+    }
+    u8 empty = 0;
+    if (__atomic_compare_exchange_n(&_class_nibbles_state[classes], &empty, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        __builtin_memcpy(_class_nibbles[classes], local, 32);
+        __atomic_store_n(&_class_nibbles_state[classes], 2, __ATOMIC_RELEASE);
+    }
+    return local;
+}
+
+JP_TARGET("sse4.1")
+size_t _span_class_sse41(const char *data, size_t len, u8 classes, bool member)
+{
+    if (len < 16) return _span_class_scalar(data, len, classes, member);
+    u8 local[32];
+    const u8 *tab  = _class_nibbles_get(classes, local);
+    __m128i tab_lo = _mm_loadu_si128((const __m128i *)&tab[0]);
+    __m128i tab_hi = _mm_loadu_si128((const __m128i *)&tab[16]);
+    __m128i bits   = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+    __m128i low4   = _mm_set1_epi8(0x0f);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i x   = _mm_loadu_si128((const __m128i *)&data[i]);
+        __m128i lo  = _mm_and_si128(x, low4);
+        __m128i hi  = _mm_and_si128(_mm_srli_epi16(x, 4), low4);
+        __m128i row = _mm_blendv_epi8(_mm_shuffle_epi8(tab_lo, lo), _mm_shuffle_epi8(tab_hi, lo), x);
+        __m128i bit = _mm_shuffle_epi8(bits, hi);
+        u32 in   = (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(row, bit), bit));
+        u32 stop = member ? (~in & 0xffff) : in;
+        if (stop) return i + _ctz32(stop);
+    }
+    return i + _span_class_scalar(&data[i], len - i, classes, member);
+}
+
+JP_TARGET("avx2")
+size_t _span_class_avx2(const char *data, size_t len, u8 classes, bool member)
+{
+    if (len < 32) return _span_class_scalar(data, len, classes, member);
+    u8 local[32];
+    const u8 *tab  = _class_nibbles_get(classes, local);
+    __m256i tab_lo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)&tab[0]));
+    __m256i tab_hi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)&tab[16]));
+    __m256i bits   = _mm256_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128,
+                                      1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+    __m256i low4   = _mm256_set1_epi8(0x0f);
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i x   = _mm256_loadu_si256((const __m256i *)&data[i]);
+        __m256i lo  = _mm256_and_si256(x, low4);
+        __m256i hi  = _mm256_and_si256(_mm256_srli_epi16(x, 4), low4);
+        __m256i row = _mm256_blendv_epi8(_mm256_shuffle_epi8(tab_lo, lo), _mm256_shuffle_epi8(tab_hi, lo), x);
+        __m256i bit = _mm256_shuffle_epi8(bits, hi);
+        u32 in   = (u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(row, bit), bit));
+        u32 stop = member ? ~in : in;
+        if (stop) return i + _ctz32(stop);
+    }
+    return i + _span_class_scalar(&data[i], len - i, classes, member);
+}
+#endif // JP_SIMD_X86
+
+size_t _span_class_resolve(const char *data, size_t len, u8 classes, bool member);
+size_t (*_span_class_impl)(const char *, size_t, u8, bool) = _span_class_resolve; // internal
+
+size_t _span_class_resolve(const char *data, size_t len, u8 classes, bool member)
+{
+    u32 cpu = cpu_features();
+    (void)cpu;
+    __typeof__(_span_class_impl) impl = _span_class_scalar;
+#if JP_SIMD_X86
+    if      (cpu & CPU_AVX2)  impl = _span_class_avx2;
+    else if (cpu & CPU_SSE42) impl = _span_class_sse41;
+#endif
+    _impl_store(_span_class_impl, impl);
+    return impl(data, len, classes, member);
+}
+
+size_t string_span_class(const string source, u8 classes)
+{
+    return _impl_load(_span_class_impl)(source.data, source.len, classes, true);
+}
+
+size_t string_cspan_class(const string source, u8 classes)
+{
+    return _impl_load(_span_class_impl)(source.data, source.len, classes, false);
 }
 
 string string_copy(string *dest, const string source) 
@@ -503,572 +1420,4003 @@ inline bool string_cmp(const string haystack, const string needle)
 // Assumes you have checked haystack >= needle.len
 bool _string_cmp_unsafe(const char *haystack, const string needle)
 {
-    // @Incomplete - compiler does not optimise this out 
-    // Rewrite using SIMD instructions
-    // These should be gaurded and default to this if not avail
-    for (size_t i = 0; i < needle.len; i++) {
+    size_t i = 0;
+    for (; i + 8 <= needle.len; i += 8) {
+        if (_load_u64(&haystack[i]) != _load_u64(&needle.data[i])) return false;
+    }
+    for (; i < needle.len; i++) {
         if (haystack[i] != needle.data[i]) return false;
     }
     return true;
 }
 
-int string_indexof(const string haystack, const string needle)
+//
+// Searching
+//
+// string_indexof picks an engine based on the needle:
+//   1 byte      -> _memchr (SIMD)
+//   <= 32 bytes -> SIMD first + last byte filter, candidates verified with _string_cmp_unsafe
+//   longer      -> Two-Way, linear time and constant space regardless of input
+// All of the internal helpers return -1 when not found.
+#define TWOWAY_MIN_NEEDLE 32
+
+ptrdiff_t _memchr_scalar(const char *data, size_t len, char c)
 {
-    if (haystack.len < needle.len) return -1;
-    for (size_t i = 0; i < haystack.len - needle.len; i++) {
-        if (haystack.data[i] != *needle.data) continue;
-        if (_string_cmp_unsafe(&haystack.data[i], needle)) return i;
+    size_t i = 0;
+    for (; i < len && ((uintptr_t)&data[i] & 7); i++) if (data[i] == c) return i;
+    for (; i + 8 <= len; i += 8) {
+        if (swar_hasbyte(_load_u64(&data[i]), c)) break;
     }
+    for (; i < len; i++) if (data[i] == c) return i;
     return -1;
 }
 
-inline bool string_contains(const string haystack, const string needle)
+#if JP_SIMD_X86
+JP_TARGET("sse2")
+ptrdiff_t _memchr_sse2(const char *data, size_t len, char c)
 {
-    return string_indexof(haystack, needle) >= 0;
+    __m128i target = _mm_set1_epi8(c);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        u32 mask = (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)&data[i]), target));
+        if (mask) return i + _ctz32(mask);
+    }
+    for (; i < len; i++) if (data[i] == c) return i;
+    return -1;
 }
 
-string string_trim_whitespace(string source)
+JP_TARGET("avx2")
+ptrdiff_t _memchr_avx2(const char *data, size_t len, char c)
 {
-    if (source.len == 0) return source;
-
-    size_t trimstart, trimend;
-    for (trimstart = 0; trimstart < source.len && jp_isspace(source.data[trimstart]); trimstart++);
-    for (trimend = source.len; trimend > trimstart && jp_isspace(source.data[trimend-1]); trimend--);
-    
-    return (string){
-        .data = &source.data[trimstart],
-        .len = trimend - trimstart,
-    };
+    __m256i target = _mm256_set1_epi8(c);
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64) {
+        __m256i a = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)&data[i]), target);
+        __m256i b = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)&data[i + 32]), target);
+        if (!_mm256_testz_si256(_mm256_or_si256(a, b), _mm256_or_si256(a, b))) {
+            u64 lo = (u32)_mm256_movemask_epi8(a);
+            u64 hi = (u32)_mm256_movemask_epi8(b);
+            return i + _ctz64(lo | (hi << 32));
+        }
+    }
+    for (; i + 32 <= len; i += 32) {
+        u32 mask = (u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)&data[i]), target));
+        if (mask) return i + _ctz32(mask);
+    }
+    for (; i < len; i++) if (data[i] == c) return i;
+    return -1;
 }
+#endif // JP_SIMD_X86
 
-// @TODO Wrap this in generic for 2nd arg string/char*
-string string_trim_prefix(string source, char *prefix)
+// Short needles (>= 2 bytes): only verify positions where both the first and last byte match
+ptrdiff_t _find_short_scalar(const char *h, size_t n, const string needle)
 {
-    string needle = cstrlen(prefix);
-    if (!string_cmp(source, needle)) return source;
-
-    return (string){
-        .data = &source.data[needle.len],
-        .len = source.len - needle.len,
-    };
+    size_t m = needle.len;
+    char last = needle.data[m - 1];
+    size_t i = 0;
+    while (i + m <= n) {
+        ptrdiff_t at = _memchr_scalar(&h[i], n - m + 1 - i, needle.data[0]);
+        if (at < 0) return -1;
+        i += at;
+        if (h[i + m - 1] == last && _string_cmp_unsafe(&h[i], needle)) return i;
+        i++;
+    }
+    return -1;
 }
 
-string string_trim_suffix(string source, char *suffix)
+#if JP_SIMD_X86
+JP_TARGET("sse2")
+ptrdiff_t _find_short_sse2(const char *h, size_t n, const string needle)
 {
-    string needle = cstrlen(suffix);
-    if (source.len < needle.len) return source;
-
-    if (!_string_cmp_unsafe(&source.data[source.len-needle.len], needle)) return source;
-    source.len = source.len - needle.len - 1;
-    return source;
+    size_t m = needle.len;
+    __m128i first = _mm_set1_epi8(needle.data[0]);
+    __m128i last  = _mm_set1_epi8(needle.data[m - 1]);
+    size_t i = 0;
+    for (; i + m - 1 + 16 <= n; i += 16) {
+        __m128i bf = _mm_loadu_si128((const __m128i *)&h[i]);
+        __m128i bl = _mm_loadu_si128((const __m128i *)&h[i + m - 1]);
+        u32 mask = (u32)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(bf, first), _mm_cmpeq_epi8(bl, last)));
+        for (; mask; mask &= mask - 1) {
+            size_t at = i + _ctz32(mask);
+            if (_string_cmp_unsafe(&h[at], needle)) return at;
+        }
+    }
+    ptrdiff_t rest = _find_short_scalar(&h[i], n - i, needle);
+    return rest < 0 ? -1 : (ptrdiff_t)i + rest;
 }
 
-string string_trim_before(string source, char *target)
-{
-    string needle = cstrlen(target);
-    size_t index = string_indexof(source, needle);
-    return (string){
-        .data = &source.data[index],
-        .len = source.len - index,
-    };
-}
-string string_trim_after(string source, char *target)
+JP_TARGET("avx2")
+ptrdiff_t _find_short_avx2(const char *h, size_t n, const string needle)
 {
-    string needle = cstrlen(target);
-    size_t index = string_indexof(source, needle);
-    source.len = index;
-    return source;
+    size_t m = needle.len;
+    __m256i first = _mm256_set1_epi8(needle.data[0]);
+    __m256i last  = _mm256_set1_epi8(needle.data[m - 1]);
+    size_t i = 0;
+    for (; i + m - 1 + 32 <= n; i += 32) {
+        __m256i bf = _mm256_loadu_si256((const __m256i *)&h[i]);
+        __m256i bl = _mm256_loadu_si256((const __m256i *)&h[i + m - 1]);
+        u32 mask = (u32)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(bf, first), _mm256_cmpeq_epi8(bl, last)));
+        for (; mask; mask &= mask - 1) {
+            size_t at = i + _ctz32(mask);
+            if (_string_cmp_unsafe(&h[at], needle)) return at;
+        }
+    }
+    ptrdiff_t rest = _find_short_scalar(&h[i], n - i, needle);
+    return rest < 0 ? -1 : (ptrdiff_t)i + rest;
 }
+#endif // JP_SIMD_X86
 
-// String manipulation (owning)
-// Dest is pointer to reduce noise calling API
-// pass NULL to allocate new string
-// pass pointer to string if wanting to append
-string string_write(string *dest, const string source) 
+// Crochemore-Perrin Two-Way, adapted from musl's strstr to work on slices.
+// O(n + m) time, O(1) space (plus a 256 entry shift table to skip quickly on mismatched last bytes)
+ptrdiff_t _find_twoway(const char *haystack, size_t n, const string needle)
 {
-    if (dest == NULL) { *dest = (string){ ._owner = true }; }
-    assert(dest->_owner); 
-    if (dest->len + source.len >= dest->_cap) {
-        if (dest->_cap == 0) dest->_cap = source.len;
-        dest->_cap *= 2;
-        dest->data = (char *)realloc(dest->data, sizeof(char)*dest->_cap);
+    const u8 *h = (const u8 *)haystack;
+    const u8 *hend = h + n;
+    const u8 *nd = (const u8 *)needle.data;
+    size_t l = needle.len;
+    size_t ip, jp, k, p, ms, p0, mem, mem0;
+    size_t byteset[32 / sizeof(size_t)] = {0};
+    size_t shift[256];
+    const size_t bits = 8 * sizeof(size_t);
+
+    for (size_t i = 0; i < l; i++) {
+        byteset[nd[i] / bits] |= (size_t)1 << (nd[i] % bits);
+        shift[nd[i]] = i + 1;
     }
-    for (size_t i = 0; i < source.len; i++) dest->data[dest->len+i] = source.data[i];
-    dest->data[dest->len+1] = '\0'; // In case we ever deal with C apis...
-    dest->len += source.len;
-    return *dest;
+
+    // Maximal suffix
+    ip = (size_t)-1; jp = 0; k = p = 1;
+    while (jp + k < l) {
+        if (nd[ip + k] == nd[jp + k]) {
+            if (k == p) { jp += p; k = 1; }
+            else k++;
+        } else if (nd[ip + k] > nd[jp + k]) {
+            jp += k; k = 1; p = jp - ip;
+        } else {
+            ip = jp++; k = p = 1;
+        }
+    }
+    ms = ip;
+    p0 = p;
+
+    // And again with the opposite comparison
+    ip = (size_t)-1; jp = 0; k = p = 1;
+    while (jp + k < l) {
+        if (nd[ip + k] == nd[jp + k]) {
+            if (k == p) { jp += p; k = 1; }
+            else k++;
+        } else if (nd[ip + k] < nd[jp + k]) {
+            jp += k; k = 1; p = jp - ip;
+        } else {
+            ip = jp++; k = p = 1;
+        }
+    }
+    if (ip + 1 > ms + 1) ms = ip;
+    else p = p0;
+
+    // Periodic needle?
+    string prefix = { .data = needle.data, .len = ms + 1 };
+    if (p + ms + 1 > l || !_string_cmp_unsafe(&needle.data[p], prefix)) {
+        mem0 = 0;
+        p = (ms > l - ms - 1 ? ms : l - ms - 1) + 1;
+    } else {
+        mem0 = l - p;
+    }
+    mem = 0;
+
+    while ((size_t)(hend - h) >= l) {
+        // Check last byte first, skip by the shift table on mismatch
+        u8 c = h[l - 1];
+        if (byteset[c / bits] & ((size_t)1 << (c % bits))) {
+            k = l - shift[c];
+            if (k) {
+                if (k < mem) k = mem;
+                h += k;
+                mem = 0;
+                continue;
+            }
+        } else {
+            h += l;
+            mem = 0;
+            continue;
+        }
+
+        // Right half
+        for (k = (ms + 1 > mem ? ms + 1 : mem); k < l && nd[k] == h[k]; k++);
+        if (k < l) {
+            h += k - ms;
+            mem = 0;
+            continue;
+        }
+        // Left half
+        for (k = ms + 1; k > mem && nd[k - 1] == h[k - 1]; k--);
+        if (k <= mem) return (const char *)h - haystack;
+        h += p;
+        mem = mem0;
+    }
+    return -1;
 }
 
-/*
-void sb_appendf(StringBuilder *sb, const char *fmt, ...)
+ptrdiff_t _memchr_resolve(const char *data, size_t len, char c);
+ptrdiff_t _find_short_resolve(const char *h, size_t n, const string needle);
+ptrdiff_t (*_memchr_impl)(const char *, size_t, char) = _memchr_resolve;               // internal
+ptrdiff_t (*_find_short_impl)(const char *, size_t, const string) = _find_short_resolve; // internal
+
+ptrdiff_t _memchr_resolve(const char *data, size_t len, char c)
+{
+    u32 cpu = cpu_features();
+    (void)cpu;
+    __typeof__(_memchr_impl) impl = _memchr_scalar;
+#if JP_SIMD_X86
+    if      (cpu & CPU_AVX2) impl = _memchr_avx2;
+    else if (cpu & CPU_SSE2) impl = _memchr_sse2;
+#endif
+    _impl_store(_memchr_impl, impl);
+    return impl(data, len, c);
+}
+
+ptrdiff_t _find_short_resolve(const char *h, size_t n, const string needle)
+{
+    u32 cpu = cpu_features();
+    (void)cpu;
+    __typeof__(_find_short_impl) impl = _find_short_scalar;
+#if JP_SIMD_X86
+    if      (cpu & CPU_AVX2) impl = _find_short_avx2;
+    else if (cpu & CPU_SSE2) impl = _find_short_sse2;
+#endif
+    _impl_store(_find_short_impl, impl);
+    return impl(h, n, needle);
+}
+
+ptrdiff_t _memchr(const char *data, size_t len, char c)
+{
+    return _impl_load(_memchr_impl)(data, len, c);
+}
+
+ptrdiff_t _string_find(const char *h, size_t n, const string needle)
+{
+    if (needle.len == 0) return 0;
+    if (n < needle.len)  return -1;
+    if (needle.len == 1) return _memchr(h, n, needle.data[0]);
+    if (needle.len <= TWOWAY_MIN_NEEDLE) return _impl_load(_find_short_impl)(h, n, needle);
+    return _find_twoway(h, n, needle);
+}
+
+// Returns -1 if not found
+int string_indexof(const string haystack, const string needle)
+{
+    return (int)_string_find(haystack.data, haystack.len, needle);
+}
+
+int string_indexof_char(const string haystack, char c)
+{
+    return (int)_memchr(haystack.data, haystack.len, c);
+}
+
+ptrdiff_t string_find(const string haystack, const string needle)
+{
+    return _string_find(haystack.data, haystack.len, needle);
+}
+
+ptrdiff_t string_find_char(const string haystack, char c)
+{
+    return _memchr(haystack.data, haystack.len, c);
+}
+
+inline bool string_contains(const string haystack, const string needle)
+{
+    return _string_find(haystack.data, haystack.len, needle) >= 0;
+}
+
+//
+// Case insensitive (ASCII) compare + search, nothing is copied or allocated.
+// SIMD folding: bytes in 'A'..'Z' land in [-128, -103] after adding 128 - 'A',
+// one signed compare finds them and OR-ing in 0x20 lowers them.
+//
+char _fold(char c)
+{
+    return (char)(c | ((_char_class[(u8)c] & CHAR_UPPER) ? 0x20 : 0));
+}
+
+bool _eq_nocase_scalar(const char *a, const char *b, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        if (_fold(a[i]) != _fold(b[i])) return false;
+    }
+    return true;
+}
+
+#if JP_SIMD_X86
+JP_TARGET("sse2")
+__m128i _fold_sse2(__m128i x)
 {
-    char *cursor = fmt;
-    for (; *cursor; cursor++) {
-        if (*cursor == '%' && *cursor+1 != '%') 
+    __m128i upper = _mm_cmplt_epi8(_mm_add_epi8(x, _mm_set1_epi8(128 - 'A')), _mm_set1_epi8(-128 + 26));
+    return _mm_or_si128(x, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
 
+JP_TARGET("sse2")
+bool _eq_nocase_sse2(const char *a, const char *b, size_t len)
+{
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i fa = _fold_sse2(_mm_loadu_si128((const __m128i *)&a[i]));
+        __m128i fb = _fold_sse2(_mm_loadu_si128((const __m128i *)&b[i]));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(fa, fb)) != 0xffff) return false;
     }
-    if (arr.len >= arr.cap) { \
-        if (arr.cap == 0) arr.cap = 256; \
-        else arr.cap *= 2; \
-            arr.data = realloc(arr.data, arr.cap*sizeof(*arr.data)); \
-                assert(arr.data && "We requested more memory but the computer said \"No\"!"); \
-    } \
-    arr.data[arr.len++] = item; \
+    return _eq_nocase_scalar(&a[i], &b[i], len - i);
+}
 
-   (void)sb;
-   (void)fmt;
+JP_TARGET("sse2")
+ptrdiff_t _find_nocase_sse2(const char *h, size_t n, const string needle)
+{
+    size_t m = needle.len;
+    __m128i first = _mm_set1_epi8(_fold(needle.data[0]));
+    __m128i last  = _mm_set1_epi8(_fold(needle.data[m - 1]));
+    size_t i = 0;
+    for (; i + m - 1 + 16 <= n; i += 16) {
+        __m128i bf = _fold_sse2(_mm_loadu_si128((const __m128i *)&h[i]));
+        __m128i bl = _fold_sse2(_mm_loadu_si128((const __m128i *)&h[i + m - 1]));
+        u32 mask = (u32)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(bf, first), _mm_cmpeq_epi8(bl, last)));
+        for (; mask; mask &= mask - 1) {
+            size_t at = i + _ctz32(mask);
+            if (_eq_nocase_sse2(&h[at], needle.data, m)) return at;
+        }
+    }
+    for (; i + m <= n; i++) {
+        if (_eq_nocase_scalar(&h[i], needle.data, m)) return i;
+    }
+    return -1;
 }
-*/
 
-// void sb_appends(string *sb, string slice)
-// {
-//     assert(sb->_owner);
-//     if (sb->len >= sb->_cap) {
-//         if (sb->_cap == 0) sb->_cap = slice.len;
-//         sb->_cap *= 2;
-//         sb->data = realloc(sb->data, sb->_cap*sizeof(char));
-//         assert(sb->data && "We requested more memory but the computer said \"No\"!");
-//     }
-//     cstrcpy(&sb->data[sb->len], slice.data, slice.len);
-// }
+JP_TARGET("avx2")
+__m256i _fold_avx2(__m256i x)
+{
+    // no unsigned/less-than byte compare in AVX2 either, so same trick with the operands swapped
+    __m256i upper = _mm256_cmpgt_epi8(_mm256_set1_epi8(-128 + 26), _mm256_add_epi8(x, _mm256_set1_epi8(128 - 'A')));
+    return _mm256_or_si256(x, _mm256_and_si256(upper, _mm256_set1_epi8(0x20)));
+}
 
-// @Warning manipulates source string!!
-string string_split_iter(string *source, string delim)
+JP_TARGET("avx2")
+bool _eq_nocase_avx2(const char *a, const char *b, size_t len)
 {
-    assert(delim.len > 0 && "delimiter provided jp_is empty!");
-    if (source->len == 0) return (string){0};
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i fa = _fold_avx2(_mm256_loadu_si256((const __m256i *)&a[i]));
+        __m256i fb = _fold_avx2(_mm256_loadu_si256((const __m256i *)&b[i]));
+        if ((u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(fa, fb)) != 0xffffffffu) return false;
+    }
+    return _eq_nocase_sse2(&a[i], &b[i], len - i);
+}
 
-     for(size_t index = 0; index < source->len; index++) {
-        if (_string_cmp_unsafe(&source->data[index], delim)) {
-            index++;
-            string before = {
-                .data = source->data,
-                .len =  index - 1,
-                .next = true,
-            };
-            source->data = &source->data[index];
-            source->len = source->len - index;
-            return before;
+JP_TARGET("avx2")
+ptrdiff_t _find_nocase_avx2(const char *h, size_t n, const string needle)
+{
+    size_t m = needle.len;
+    __m256i first = _mm256_set1_epi8(_fold(needle.data[0]));
+    __m256i last  = _mm256_set1_epi8(_fold(needle.data[m - 1]));
+    size_t i = 0;
+    for (; i + m - 1 + 32 <= n; i += 32) {
+        __m256i bf = _fold_avx2(_mm256_loadu_si256((const __m256i *)&h[i]));
+        __m256i bl = _fold_avx2(_mm256_loadu_si256((const __m256i *)&h[i + m - 1]));
+        u32 mask = (u32)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(bf, first), _mm256_cmpeq_epi8(bl, last)));
+        for (; mask; mask &= mask - 1) {
+            size_t at = i + _ctz32(mask);
+            if (_eq_nocase_avx2(&h[at], needle.data, m)) return at;
         }
     }
-    return (string){0};
+    ptrdiff_t rest = _find_nocase_sse2(&h[i], n - i, needle);
+    return rest < 0 ? -1 : (ptrdiff_t)i + rest;
 }
+#endif // JP_SIMD_X86
 
-// Better Printing!
-// @Incomplete - basic implementation only atm, we should be writing to buffers to be better practice
-string pct = {
-    .data = "%",
-    .len  = 1,
-};
+ptrdiff_t _find_nocase_scalar(const char *h, size_t n, const string needle)
+{
+    char first = _fold(needle.data[0]);
+    for (size_t i = 0; i + needle.len <= n; i++) {
+        if (_fold(h[i]) == first && _eq_nocase_scalar(&h[i], needle.data, needle.len)) return i;
+    }
+    return -1;
+}
 
-/*
- * Syntax to add (after % for customising)
-    -  = Left-align
-    +  = Always show sign (ignored for strings)
-   ' ' = Space if positive (ignored for strings)
-    0  = Zero-pad (ignored for strings)
-    #  = Alternate form
-    U  = Uppercase (ignored for non-strings)
-    p  = pointer
-    width:
-        Minimum field width.
-            printf("%5d", 42);   // "   42"
-            printf("%-5d", 42);  // "42   "
-        Dynamic width:
-            printf("%*d", 5, 42);
-    precision:
-        For integers
-            Minimum number of digits:
-            printf("%.5d", 42);  // 00042
-        For floats
-            Digits after decimal:
-            printf("%.3f", 3.14159); // 3.142
-        For strings
-            Maximum characters:
-            printf("%.4s", "abcdef"); // abcd
-        Dynamic precision:
-            printf("%.*f", 2, 3.14159);
-    .  = start size logic
-        *  = dynamic width
-        \d = (digit) width
-*/
+bool _eq_nocase_resolve(const char *a, const char *b, size_t len);
+ptrdiff_t _find_nocase_resolve(const char *h, size_t n, const string needle);
+bool (*_eq_nocase_impl)(const char *, const char *, size_t) = _eq_nocase_resolve;                  // internal
+ptrdiff_t (*_find_nocase_impl)(const char *, size_t, const string) = _find_nocase_resolve;         // internal
 
-#if defined(_MSC_VER)
-#  define DLL_IMPORT __declspec(dllimport)
-#elif defined(__GNUC__)
-#  define DLL_IMPORT __attribute__((dllimport))
-#else
-#  define DLL_IMPORT
+bool _eq_nocase_resolve(const char *a, const char *b, size_t len)
+{
+    u32 cpu = cpu_features();
+    (void)cpu;
+    __typeof__(_eq_nocase_impl) impl = _eq_nocase_scalar;
+#if JP_SIMD_X86
+    if      (cpu & CPU_AVX2) impl = _eq_nocase_avx2;
+    else if (cpu & CPU_SSE2) impl = _eq_nocase_sse2;
 #endif
+    _impl_store(_eq_nocase_impl, impl);
+    return impl(a, b, len);
+}
 
-DLL_IMPORT void* __stdcall GetStdHandle(unsigned long);
-DLL_IMPORT int   __stdcall WriteFile(
-    void* h,
-    const void* buf,
-    unsigned long len,
-    unsigned long* written,
-    void* overlapped
-);
+ptrdiff_t _find_nocase_resolve(const char *h, size_t n, const string needle)
+{
+    u32 cpu = cpu_features();
+    (void)cpu;
+    __typeof__(_find_nocase_impl) impl = _find_nocase_scalar;
+#if JP_SIMD_X86
+    if      (cpu & CPU_AVX2) impl = _find_nocase_avx2;
+    else if (cpu & CPU_SSE2) impl = _find_nocase_sse2;
+#endif
+    _impl_store(_find_nocase_impl, impl);
+    return impl(h, n, needle);
+}
 
+bool string_eq_nocase(const string a, const string b)
+{
+    return a.len == b.len && _impl_load(_eq_nocase_impl)(a.data, b.data, a.len);
+}
 
-#ifdef _WIN32
-#define STDIN  0
-#define STDOUT 0
-#define STDERR 0
-#define WIN_STDIN  ((unsigned long)-10)
-#define WIN_STDOUT ((unsigned long)-11)
-#define WIN_STDERR ((unsigned long)-12)
-void *stdio_handles[3] = {0}; // index into to get handle then cast depending on system
-__attribute__((dllimport)) void* __stdcall GetStdHandle(unsigned long);
-__attribute__((dllimport)) int   __stdcall WriteFile(void *, const void*, unsigned long, unsigned long*, void*);
-#elif __linux__
-#endif // _WIN32
+bool string_has_prefix_nocase(const string source, const string prefix)
+{
+    return source.len >= prefix.len && _impl_load(_eq_nocase_impl)(source.data, prefix.data, prefix.len);
+}
 
-size_t __write(void *dest, char *data, size_t len)
+int string_indexof_nocase(const string haystack, const string needle)
 {
-#ifdef _WIN32
-    unsigned long written;
-    WriteFile(dest, data, len, &written, NULL);
-#else
-#error Unsupported OS TODO!!!
-#endif
-    return (size_t)written;
+    if (needle.len == 0) return 0;
+    if (haystack.len < needle.len) return -1;
+    return (int)_impl_load(_find_nocase_impl)(haystack.data, haystack.len, needle);
 }
 
-string __write_string(void *dest, string *source)
-{ 
-    __write(dest, source->data, source->len);
-    source->len = 0;
-    return *source;
+//
+// UTF-8
+//
+// Decodes one codepoint, *advance is how many bytes to skip (1 for invalid sequences)
+rune _utf8_decode(const u8 *p, size_t len, size_t *advance)
+{
+    u8 c = p[0];
+    *advance = 1;
+    if (c < 0x80) return c;
+
+    size_t need;
+    rune r, min;
+    if      (c >= 0xc2 && c <= 0xdf) { need = 1; r = c & 0x1f; min = 0x80; }
+    else if (c >= 0xe0 && c <= 0xef) { need = 2; r = c & 0x0f; min = 0x800; }
+    else if (c >= 0xf0 && c <= 0xf4) { need = 3; r = c & 0x07; min = 0x10000; }
+    else return RUNE_ERROR;
+    if (len < need + 1) return RUNE_ERROR;
+    for (size_t i = 1; i <= need; i++) {
+        if ((p[i] & 0xc0) != 0x80) return RUNE_ERROR;
+        r = (r << 6) | (p[i] & 0x3f);
+    }
+    // overlong, out of range or a UTF-16 surrogate
+    if (r < min || r > 0x10ffff || (r >= 0xd800 && r <= 0xdfff)) return RUNE_ERROR;
+    *advance = need + 1;
+    return r;
 }
 
-size_t __print(char *data, size_t len) {
-#ifdef _WIN32
-    if (!stdio_handles[STDOUT]) {
-        stdio_handles[STDOUT] = GetStdHandle(WIN_STDOUT);
+rune string_utf8_iter(string *source)
+{
+    if (source->len == 0) return RUNE_ERROR;
+    size_t advance;
+    rune r = _utf8_decode((const u8 *)source->data, source->len, &advance);
+    source->data += advance;
+    source->len  -= advance;
+    return r;
+}
+
+bool _utf8_valid_scalar(const char *data, size_t len)
+{
+    const u8 *p = (const u8 *)data;
+    size_t i = 0;
+    while (i < len) {
+        // ASCII runs 8 at a time
+        if (i + 8 <= len && !(_load_u64(&p[i]) & SWAR_HIGHS)) {
+            i += 8;
+            continue;
+        }
+        size_t advance;
+        _utf8_decode(&p[i], len - i, &advance);
+        // a non ASCII byte that only advanced by one was a bad sequence
+        if (advance == 1 && p[i] >= 0x80) return false;
+        i += advance;
+    }
+    return true;
+}
+
+size_t _utf8_count_scalar(const char *data, size_t len)
+{
+    // every byte except continuation bytes (10xxxxxx) starts a codepoint
+    size_t count = 0;
+    for (size_t i = 0; i < len; i++) count += ((u8)data[i] & 0xc0) != 0x80;
+    return count;
+}
+
+#if JP_SIMD_X86
+// Keiser + Lemire "lookup" validator (as used by simdjson). Three nibble lookups
+// flag every bad 2 byte combination, the remaining 3/4 byte length errors fall out
+// of comparing where continuations must be against where they are.
+#define U8_TOO_SHORT   (1 << 0)
+#define U8_TOO_LONG    (1 << 1)
+#define U8_OVERLONG_3  (1 << 2)
+#define U8_TOO_LARGE   (1 << 3)
+#define U8_SURROGATE   (1 << 4)
+#define U8_OVERLONG_2  (1 << 5)
+#define U8_TOO_LARGE_1000 (1 << 6)
+#define U8_OVERLONG_4  (1 << 6)
+#define U8_TWO_CONTS   (1 << 7)
+#define U8_CARRY       (U8_TOO_SHORT | U8_TOO_LONG | U8_TWO_CONTS)
+
+#define U8_TABLE_BYTE_1_HIGH \
+    U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG, \
+    U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG, \
+    U8_TWO_CONTS, U8_TWO_CONTS, U8_TWO_CONTS, U8_TWO_CONTS, \
+    U8_TOO_SHORT | U8_OVERLONG_2, \
+    U8_TOO_SHORT, \
+    U8_TOO_SHORT | U8_OVERLONG_3 | U8_SURROGATE, \
+    U8_TOO_SHORT | U8_TOO_LARGE | U8_TOO_LARGE_1000 | U8_OVERLONG_4
+
+#define U8_TABLE_BYTE_1_LOW \
+    U8_CARRY | U8_OVERLONG_3 | U8_OVERLONG_2 | U8_OVERLONG_4, \
+    U8_CARRY | U8_OVERLONG_2, \
+    U8_CARRY, \
+    U8_CARRY, \
+    U8_CARRY | U8_TOO_LARGE, \
+    U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000, \
+    U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000, \
+    U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000, \
+    U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000, \
+    U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000, \
+    U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000, \
+    U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000, \
+    U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000, \
+    U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000 | U8_SURROGATE, \
+    U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000, \
+    U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000
+
+#define U8_TABLE_BYTE_2_HIGH \
+    U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT, \
+    U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT, \
+    U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_OVERLONG_3 | U8_TOO_LARGE_1000 | U8_OVERLONG_4, \
+    U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_OVERLONG_3 | U8_TOO_LARGE, \
+    U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_SURROGATE  | U8_TOO_LARGE, \
+    U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_SURROGATE  | U8_TOO_LARGE, \
+    U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT
+
+JP_TARGET("sse4.1")
+__m128i _utf8_block_errors_sse41(__m128i input, __m128i prev)
+{
+    __m128i low4  = _mm_set1_epi8(0x0f);
+    __m128i prev1 = _mm_alignr_epi8(input, prev, 15);
+    __m128i prev2 = _mm_alignr_epi8(input, prev, 14);
+    __m128i prev3 = _mm_alignr_epi8(input, prev, 13);
+    __m128i b1_high = _mm_shuffle_epi8(_mm_setr_epi8(U8_TABLE_BYTE_1_HIGH), _mm_and_si128(_mm_srli_epi16(prev1, 4), low4));
+    __m128i b1_low  = _mm_shuffle_epi8(_mm_setr_epi8(U8_TABLE_BYTE_1_LOW),  _mm_and_si128(prev1, low4));
+    __m128i b2_high = _mm_shuffle_epi8(_mm_setr_epi8(U8_TABLE_BYTE_2_HIGH), _mm_and_si128(_mm_srli_epi16(input, 4), low4));
+    __m128i special = _mm_and_si128(_mm_and_si128(b1_high, b1_low), b2_high);
+    // 3rd/4th bytes of a sequence, these must be continuations
+    __m128i must23  = _mm_or_si128(_mm_subs_epu8(prev2, _mm_set1_epi8((char)(0xe0 - 0x80))),
+                                   _mm_subs_epu8(prev3, _mm_set1_epi8((char)(0xf0 - 0x80))));
+    __m128i must23_80 = _mm_and_si128(must23, _mm_set1_epi8((char)0x80));
+    return _mm_xor_si128(must23_80, special);
+}
+
+JP_TARGET("sse4.1")
+bool _utf8_valid_sse41(const char *data, size_t len)
+{
+    __m128i error = _mm_setzero_si128(), prev = _mm_setzero_si128(), incomplete = _mm_setzero_si128();
+    // anything in the last 3 bytes that still needs continuation bytes
+    __m128i max_value = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                      (char)(0xf0 - 1), (char)(0xe0 - 1), (char)(0xc0 - 1));
+    size_t i = 0;
+    for (; i < len; i += 16) {
+        __m128i input;
+        if (i + 16 <= len) {
+            input = _mm_loadu_si128((const __m128i *)&data[i]);
+        } else {
+            // pad the tail with zeros (ASCII) which also flags any sequence cut short at the end
+            char tail[16] = {0};
+            for (size_t j = 0; i + j < len; j++) tail[j] = data[i + j];
+            input = _mm_loadu_si128((const __m128i *)tail);
+        }
+        if (!_mm_movemask_epi8(input)) {
+            // all ASCII, only thing that can be wrong is a sequence left open by the last block
+            error = _mm_or_si128(error, incomplete);
+        } else {
+            error = _mm_or_si128(error, _utf8_block_errors_sse41(input, prev));
+            incomplete = _mm_subs_epu8(input, max_value);
+        }
+        prev = input;
+    }
+    error = _mm_or_si128(error, incomplete);
+    return _mm_testz_si128(error, error);
+}
+
+JP_TARGET("avx2")
+__m256i _utf8_block_errors_avx2(__m256i input, __m256i prev)
+{
+    __m256i low4  = _mm256_set1_epi8(0x0f);
+    // bytes shifted in from the previous block across the 128 bit lanes
+    __m256i carry = _mm256_permute2x128_si256(prev, input, 0x21);
+    __m256i prev1 = _mm256_alignr_epi8(input, carry, 15);
+    __m256i prev2 = _mm256_alignr_epi8(input, carry, 14);
+    __m256i prev3 = _mm256_alignr_epi8(input, carry, 13);
+    __m256i b1_high = _mm256_shuffle_epi8(_mm256_setr_epi8(U8_TABLE_BYTE_1_HIGH, U8_TABLE_BYTE_1_HIGH), _mm256_and_si256(_mm256_srli_epi16(prev1, 4), low4));
+    __m256i b1_low  = _mm256_shuffle_epi8(_mm256_setr_epi8(U8_TABLE_BYTE_1_LOW,  U8_TABLE_BYTE_1_LOW),  _mm256_and_si256(prev1, low4));
+    __m256i b2_high = _mm256_shuffle_epi8(_mm256_setr_epi8(U8_TABLE_BYTE_2_HIGH, U8_TABLE_BYTE_2_HIGH), _mm256_and_si256(_mm256_srli_epi16(input, 4), low4));
+    __m256i special = _mm256_and_si256(_mm256_and_si256(b1_high, b1_low), b2_high);
+    __m256i must23  = _mm256_or_si256(_mm256_subs_epu8(prev2, _mm256_set1_epi8((char)(0xe0 - 0x80))),
+                                      _mm256_subs_epu8(prev3, _mm256_set1_epi8((char)(0xf0 - 0x80))));
+    __m256i must23_80 = _mm256_and_si256(must23, _mm256_set1_epi8((char)0x80));
+    return _mm256_xor_si256(must23_80, special);
+}
+
+JP_TARGET("avx2")
+bool _utf8_valid_avx2(const char *data, size_t len)
+{
+    __m256i error = _mm256_setzero_si256(), prev = _mm256_setzero_si256(), incomplete = _mm256_setzero_si256();
+    __m256i max_value = _mm256_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                         -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                         (char)(0xf0 - 1), (char)(0xe0 - 1), (char)(0xc0 - 1));
+    size_t i = 0;
+    for (; i < len; i += 32) {
+        __m256i input;
+        if (i + 32 <= len) {
+            input = _mm256_loadu_si256((const __m256i *)&data[i]);
+        } else {
+            char tail[32] = {0};
+            for (size_t j = 0; i + j < len; j++) tail[j] = data[i + j];
+            input = _mm256_loadu_si256((const __m256i *)tail);
+        }
+        if (!_mm256_movemask_epi8(input)) {
+            error = _mm256_or_si256(error, incomplete);
+        } else {
+            error = _mm256_or_si256(error, _utf8_block_errors_avx2(input, prev));
+            incomplete = _mm256_subs_epu8(input, max_value);
+        }
+        prev = input;
+    }
+    error = _mm256_or_si256(error, incomplete);
+    return _mm256_testz_si256(error, error);
+}
+
+JP_TARGET("sse2")
+size_t _utf8_count_sse2(const char *data, size_t len)
+{
+    // continuation bytes are 0x80-0xbf, i.e. <= -65 as signed bytes
+    __m128i limit = _mm_set1_epi8(-65);
+    size_t count = 0, i = 0;
+    for (; i + 16 <= len; i += 16) {
+        u32 starts = (u32)_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_loadu_si128((const __m128i *)&data[i]), limit));
+        count += __builtin_popcount(starts);
+    }
+    return count + _utf8_count_scalar(&data[i], len - i);
+}
+
+JP_TARGET("avx2,popcnt")
+size_t _utf8_count_avx2(const char *data, size_t len)
+{
+    __m256i limit = _mm256_set1_epi8(-65);
+    size_t count = 0, i = 0;
+    for (; i + 32 <= len; i += 32) {
+        u32 starts = (u32)_mm256_movemask_epi8(_mm256_cmpgt_epi8(_mm256_loadu_si256((const __m256i *)&data[i]), limit));
+        count += __builtin_popcount(starts);
     }
+    return count + _utf8_count_scalar(&data[i], len - i);
+}
+#endif // JP_SIMD_X86
+
+bool _utf8_valid_resolve(const char *data, size_t len);
+size_t _utf8_count_resolve(const char *data, size_t len);
+bool   (*_utf8_valid_impl)(const char *, size_t) = _utf8_valid_resolve; // internal
+size_t (*_utf8_count_impl)(const char *, size_t) = _utf8_count_resolve; // internal
+
+bool _utf8_valid_resolve(const char *data, size_t len)
+{
+    u32 cpu = cpu_features();
+    (void)cpu;
+    __typeof__(_utf8_valid_impl) impl = _utf8_valid_scalar;
+#if JP_SIMD_X86
+    if      (cpu & CPU_AVX2)  impl = _utf8_valid_avx2;
+    else if (cpu & CPU_SSE42) impl = _utf8_valid_sse41;
+#endif
+    _impl_store(_utf8_valid_impl, impl);
+    return impl(data, len);
+}
+
+size_t _utf8_count_resolve(const char *data, size_t len)
+{
+    u32 cpu = cpu_features();
+    (void)cpu;
+    __typeof__(_utf8_count_impl) impl = _utf8_count_scalar;
+#if JP_SIMD_X86
+    if      (cpu & CPU_AVX2) impl = _utf8_count_avx2;
+    else if (cpu & CPU_SSE2) impl = _utf8_count_sse2;
 #endif
-    return __write(stdio_handles[STDOUT], data, len);
+    _impl_store(_utf8_count_impl, impl);
+    return impl(data, len);
+}
+
+bool string_utf8_valid(const string source)
+{
+    return _impl_load(_utf8_valid_impl)(source.data, source.len);
+}
+
+size_t string_utf8_count(const string source)
+{
+    return _impl_load(_utf8_count_impl)(source.data, source.len);
+}
+
+// Builds a full DFA (failure links already folded into the transitions) so
+// searching is one table lookup per byte. Bytes not used by any needle all
+// share class 0 which keeps the table small for typical keyword sets.
+// If the needles use every byte there is no such class.
+// Empty needles are not allowed.
+StringMatcher string_matcher_compile(const string *needles, size_t count)
+{
+    StringMatcher m = { .count = (u32)count };
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        assert(needles[i].len > 0 && "string_matcher_compile: empty needle");
+        total += needles[i].len;
+        if (needles[i].len > m.max_len) m.max_len = needles[i].len;
+        for (size_t j = 0; j < needles[i].len; j++) m.classes[(u8)needles[i].data[j]] = 1;
+    }
+    // class 0 is only needed when some byte is unused, otherwise the 256 used
+    // bytes take classes 0..255 and still fit in a u8
+    u32 used = 0;
+    for (size_t b = 0; b < 256; b++) used += m.classes[b];
+    m.nclasses = used < 256;
+    for (size_t b = 0; b < 256; b++) {
+        if (m.classes[b]) m.classes[b] = (u8)m.nclasses++;
+    }
+
+    size_t maxstates = total + 1;
+    m.delta      = (u32 *)calloc(maxstates * m.nclasses, sizeof(u32));
+    m.match_id   = (u32 *)malloc(maxstates * sizeof(u32));
+    m.dict_link  = (u32 *)calloc(maxstates, sizeof(u32));
+    m.needle_len = (size_t *)malloc((count ? count : 1) * sizeof(size_t));
+    u32 *fail    = (u32 *)calloc(maxstates, sizeof(u32));
+    u32 *queue   = (u32 *)malloc(maxstates * sizeof(u32));
+    assert(m.delta && m.match_id && m.dict_link && m.needle_len && fail && queue && "We requested more memory but the computer said \"No\"!");
+    for (size_t i = 0; i < maxstates; i++) m.match_id[i] = U32_MAX;
+
+    // Trie, 0 means no edge yet as nothing ever points back to the root here
+    m.nstates = 1;
+    for (size_t i = 0; i < count; i++) {
+        u32 state = 0;
+        for (size_t j = 0; j < needles[i].len; j++) {
+            u32 *edge = &m.delta[state * m.nclasses + m.classes[(u8)needles[i].data[j]]];
+            if (!*edge) *edge = m.nstates++;
+            state = *edge;
+        }
+        if (m.match_id[state] == U32_MAX) m.match_id[state] = (u32)i; // duplicates report the first id
+        m.needle_len[i] = needles[i].len;
+    }
+
+    // BFS, filling the missing edges from the failure state which is always shallower (so already done)
+    size_t head = 0, tail = 0;
+    for (u32 c = 0; c < m.nclasses; c++) {
+        u32 child = m.delta[c];
+        if (child) queue[tail++] = child;
+    }
+    while (head < tail) {
+        u32 state = queue[head++];
+        u32 *row  = &m.delta[state * m.nclasses];
+        u32 *frow = &m.delta[fail[state] * m.nclasses];
+        for (u32 c = 0; c < m.nclasses; c++) {
+            if (row[c]) {
+                u32 child = row[c];
+                fail[child] = frow[c];
+                m.dict_link[child] = m.match_id[fail[child]] != U32_MAX ? fail[child] : m.dict_link[fail[child]];
+                queue[tail++] = child;
+            } else {
+                row[c] = frow[c];
+            }
+        }
+    }
+    free(fail);
+    free(queue);
+    return m;
+}
+
+void string_matcher_free(StringMatcher *m)
+{
+    free(m->delta);
+    free(m->match_id);
+    free(m->dict_link);
+    free(m->needle_len);
+    *m = (StringMatcher){0};
+}
+
+// Reports matches in order of where they end, overlapping matches included
+StringMatch string_match_iter(StringMatchIter *it)
+{
+    const StringMatcher *m = it->m;
+    // finish reporting the suffix chain of the last state first
+    if (it->pending) {
+        u32 state = it->pending;
+        u32 id = m->match_id[state];
+        it->pending = m->dict_link[state];
+        return (StringMatch){ .index = it->pos - m->needle_len[id], .len = m->needle_len[id], .id = id, .next = true };
+    }
+    const u8 *h = (const u8 *)it->haystack.data;
+    u32 state = it->state;
+    while (it->pos < it->haystack.len) {
+        state = m->delta[state * m->nclasses + m->classes[h[it->pos++]]];
+        u32 hit = m->match_id[state] != U32_MAX ? state : m->dict_link[state];
+        if (hit) {
+            it->state = state;
+            u32 id = m->match_id[hit];
+            it->pending = m->dict_link[hit];
+            return (StringMatch){ .index = it->pos - m->needle_len[id], .len = m->needle_len[id], .id = id, .next = true };
+        }
+    }
+    it->state = state;
+    return (StringMatch){0};
+}
+
+// Leftmost starting match, ties go to the longest needle
+int string_indexof_any(const StringMatcher *m, const string haystack, u32 *id)
+{
+    const u8 *h = (const u8 *)haystack.data;
+    u32 state = 0;
+    size_t best = SIZE_MAX;
+    u32 best_id = U32_MAX;
+    for (size_t pos = 0; pos < haystack.len; pos++) {
+        // nothing starting after best can beat it, and anything starting before it ends by now
+        if (best != SIZE_MAX && pos >= best + m->max_len) break;
+        state = m->delta[state * m->nclasses + m->classes[h[pos]]];
+        for (u32 hit = m->match_id[state] != U32_MAX ? state : m->dict_link[state]; hit; hit = m->dict_link[hit]) {
+            u32 hid = m->match_id[hit];
+            size_t start = pos + 1 - m->needle_len[hid];
+            if (start < best || (start == best && m->needle_len[hid] > m->needle_len[best_id])) {
+                best = start;
+                best_id = hid;
+            }
+        }
+    }
+    if (best == SIZE_MAX) return -1;
+    if (id) *id = best_id;
+    return (int)best;
 }
 
-const char _basesystem[] = "0123456789abcdefghijklmnopqrstuvwxyz_#";
+string string_trim_whitespace(string source)
+{
+    if (source.len == 0) return source;
 
-#define FMTOPT_UPPER
-#define FMTOPT_LOWER
-#define FMTOPT_LOWER
+    size_t trimstart, trimend;
+    trimstart = _impl_load(_span_class_impl)(source.data, source.len, CHAR_SPACE, true);
+    // trailing whitespace is almost always short, table lookups are fine here
+    for (trimend = source.len; trimend > trimstart && jp_isspace(source.data[trimend-1]); trimend--);
+    
+    return (string){
+        .data = &source.data[trimstart],
+        .len = trimend - trimstart,
+    };
+}
+
+string string_skip_whitespace(string source)
+{
+    size_t skip = _impl_load(_span_class_impl)(source.data, source.len, CHAR_SPACE, true);
+    source.data += skip;
+    source.len  -= skip;
+    return source;
+}
+
+StringList string_fields(const string source)
+{
+    StringList result = {0};
+    string rest = source;
+    for (;;) {
+        rest = string_skip_whitespace(rest);
+        if (rest.len == 0) break;
+        size_t field = _impl_load(_span_class_impl)(rest.data, rest.len, CHAR_SPACE, false);
+        string item = { .data = rest.data, .len = field };
+        da_append(result, item);
+        rest.data += field;
+        rest.len  -= field;
+    }
+    return result;
+}
+
+// @TODO Wrap this in generic for 2nd arg string/char*
+string string_trim_prefix(string source, char *prefix)
+{
+    string needle = cstrlen(prefix);
+    if (!string_cmp(source, needle)) return source;
+
+    return (string){
+        .data = &source.data[needle.len],
+        .len = source.len - needle.len,
+    };
+}
+
+string string_trim_suffix(string source, char *suffix)
+{
+    string needle = cstrlen(suffix);
+    if (source.len < needle.len) return source;
+
+    if (!_string_cmp_unsafe(&source.data[source.len-needle.len], needle)) return source;
+    source.len = source.len - needle.len - 1;
+    return source;
+}
+
+string string_trim_before(string source, char *target)
+{
+    string needle = cstrlen(target);
+    ptrdiff_t index = string_find(source, needle);
+    if (index < 0) return source;
+    return (string){
+        .data = &source.data[index],
+        .len = source.len - index,
+    };
+}
+string string_trim_after(string source, char *target)
+{
+    string needle = cstrlen(target);
+    ptrdiff_t index = string_find(source, needle);
+    if (index < 0) return source;
+    source.len = index;
+    return source;
+}
+
+// String manipulation (owning)
+// Dest is pointer to reduce noise calling API
+// pass NULL to allocate new string
+// pass pointer to string if wanting to append
+string string_write(string *dest, const string source) 
+{
+    if (dest == NULL) { *dest = (string){ ._owner = true }; }
+    assert(dest->_owner); 
+    if (dest->len + source.len >= dest->_cap) {
+        if (dest->_cap == 0) dest->_cap = source.len;
+        dest->_cap *= 2;
+        dest->data = (char *)realloc(dest->data, sizeof(char)*dest->_cap);
+    }
+    for (size_t i = 0; i < source.len; i++) dest->data[dest->len+i] = source.data[i];
+    dest->data[dest->len+1] = '\0'; // In case we ever deal with C apis...
+    dest->len += source.len;
+    return *dest;
+}
+
+bool small_string_set(SmallString *dest, const string source)
+{
+    if (source.len > SMALL_STRING_MAX) return false;
+    for (size_t i = 0; i < source.len; i++) dest->data[i] = source.data[i];
+    dest->data[source.len] = '\0';
+    dest->len = (u8)source.len;
+    return true;
+}
+
+string small_string_view(const SmallString *source)
+{
+    return (string){ .data = (char *)source->data, .len = source->len };
+}
+
+//
+// StringBuilder
+//
+_SbChunk *_sb_new_chunk(StringBuilder *sb)
+{
+    size_t cap = sb->len / 2;
+    if (cap < SB_CHUNK_SIZE) cap = SB_CHUNK_SIZE;
+    if (cap > SB_CHUNK_MAX)  cap = SB_CHUNK_MAX;
+    _SbChunk *chunk = (_SbChunk *)malloc(sizeof(_SbChunk) + cap);
+    assert(chunk && "We requested more memory but the computer said \"No\"!");
+    *chunk = (_SbChunk){ .cap = cap };
+    if (sb->tail) sb->tail->next = chunk;
+    else          sb->head = chunk;
+    sb->tail = chunk;
+    return chunk;
+}
+
+void sb_appends(StringBuilder *sb, const string slice)
+{
+    _SbChunk *chunk = sb->tail;
+    size_t done = 0;
+    while (done < slice.len) {
+        if (!chunk || chunk->len == chunk->cap) chunk = _sb_new_chunk(sb);
+        size_t n = chunk->cap - chunk->len;
+        if (n > slice.len - done) n = slice.len - done;
+        char *dest = &chunk->data[chunk->len];
+        for (size_t i = 0; i < n; i++) dest[i] = slice.data[done + i];
+        chunk->len += n;
+        sb->len    += n;
+        done       += n;
+    }
+}
+
+size_t sb_write(StringBuilder *sb, char *text)
+{
+    string slice = cstrlen(text);
+    sb_appends(sb, slice);
+    return slice.len;
+}
+
+string sb_flatten(const StringBuilder *sb)
+{
+    string result = { ._owner = true, ._cap = sb->len + 1 };
+    result.data = (char *)malloc(sb->len + 1);
+    assert(result.data && "We requested more memory but the computer said \"No\"!");
+    for (_SbChunk *chunk = sb->head; chunk; chunk = chunk->next) {
+        for (size_t i = 0; i < chunk->len; i++) result.data[result.len + i] = chunk->data[i];
+        result.len += chunk->len;
+    }
+    result.data[result.len] = '\0';
+    return result;
+}
+
+void sb_reset(StringBuilder *sb)
+{
+    if (!sb->head) return;
+    _SbChunk *chunk = sb->head->next;
+    while (chunk) {
+        _SbChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    sb->head->next = NULL;
+    sb->head->len  = 0;
+    sb->tail = sb->head;
+    sb->len  = 0;
+}
+
+void sb_free(StringBuilder *sb)
+{
+    _SbChunk *chunk = sb->head;
+    while (chunk) {
+        _SbChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    *sb = (StringBuilder){0};
+}
+
+// @Warning manipulates source string!!
+string string_split_iter(string *source, string delim)
+{
+    assert(delim.len > 0 && "delimiter provided jp_is empty!");
+    if (source->len == 0) return (string){0};
+
+    ptrdiff_t index = _string_find(source->data, source->len, delim);
+    if (index < 0) return (string){0};
+    string before = {
+        .data = source->data,
+        .len  = index,
+        .next = true,
+    };
+    source->data = &source->data[index + delim.len];
+    source->len  = source->len - index - delim.len;
+    return before;
+}
+
+// One bit per byte of a 64 byte block that equals c, bit 0 is p[0]
+// (same trick simdjson uses to find its structural characters)
+u64 _bytemask64_scalar(const char *p, char c)
+{
+    u64 mask = 0;
+    for (size_t i = 0; i < 64; i++) mask |= (u64)(p[i] == c) << i;
+    return mask;
+}
+
+#if JP_SIMD_X86
+JP_TARGET("sse2")
+u64 _bytemask64_sse2(const char *p, char c)
+{
+    __m128i target = _mm_set1_epi8(c);
+    u64 m0 = (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)&p[0]),  target));
+    u64 m1 = (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)&p[16]), target));
+    u64 m2 = (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)&p[32]), target));
+    u64 m3 = (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)&p[48]), target));
+    return m0 | (m1 << 16) | (m2 << 32) | (m3 << 48);
+}
+
+JP_TARGET("avx2")
+u64 _bytemask64_avx2(const char *p, char c)
+{
+    __m256i target = _mm256_set1_epi8(c);
+    u64 lo = (u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)&p[0]),  target));
+    u64 hi = (u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)&p[32]), target));
+    return lo | (hi << 32);
+}
+
+JP_TARGET("avx512f,avx512bw")
+u64 _bytemask64_avx512(const char *p, char c)
+{
+    return _mm512_cmpeq_epi8_mask(_mm512_loadu_si512((const void *)p), _mm512_set1_epi8(c));
+}
+#endif // JP_SIMD_X86
+
+u64 _bytemask64_resolve(const char *p, char c);
+u64 (*_bytemask64_impl)(const char *, char) = _bytemask64_resolve; // internal
+
+u64 _bytemask64_resolve(const char *p, char c)
+{
+    u32 cpu = cpu_features();
+    (void)cpu;
+    __typeof__(_bytemask64_impl) impl = _bytemask64_scalar;
+#if JP_SIMD_X86
+    if      (cpu & CPU_AVX512BW) impl = _bytemask64_avx512;
+    else if (cpu & CPU_AVX2)     impl = _bytemask64_avx2;
+    else if (cpu & CPU_SSE2)     impl = _bytemask64_sse2;
+#endif
+    _impl_store(_bytemask64_impl, impl);
+    return impl(p, c);
+}
+
+void _index_list_reserve(IndexList *list, size_t extra)
+{
+    if (list->len + extra <= list->cap) return;
+    if (list->cap == 0) list->cap = 256;
+    while (list->len + extra > list->cap) list->cap *= 2;
+    list->data = (size_t *)realloc(list->data, list->cap * sizeof(*list->data));
+    assert(list->data && "We requested more memory but the computer said \"No\"!");
+}
+
+size_t string_indexof_all(const string haystack, const string needle, IndexList *out)
+{
+    assert(needle.len > 0 && "needle provided is empty!");
+    const char *h = haystack.data;
+    size_t n = haystack.len, m = needle.len;
+    size_t start = out->len;
+    if (n < m) return 0;
+
+    size_t i = 0;
+    size_t skip_until = 0; // matches can't overlap, anything before here is inside the last one
+    for (; i + m - 1 + 64 <= n; i += 64) {
+        u64 mask = _impl_load(_bytemask64_impl)(&h[i], needle.data[0]);
+        if (m > 1 && mask) mask &= _impl_load(_bytemask64_impl)(&h[i + m - 1], needle.data[m - 1]);
+        if (!mask) continue;
+        // worst case every bit is a match so reserve up front and keep the bit loop branch light
+        _index_list_reserve(out, 64);
+        for (; mask; mask &= mask - 1) {
+            size_t at = i + _ctz64(mask);
+            if (m > 1) {
+                if (at < skip_until || !_string_cmp_unsafe(&h[at], needle)) continue;
+                skip_until = at + m;
+            }
+            out->data[out->len++] = at;
+        }
+    }
+    if (i < skip_until) i = skip_until;
+    for (ptrdiff_t at; i + m <= n && (at = _string_find(&h[i], n - i, needle)) >= 0; i += at + m) {
+        _index_list_reserve(out, 1);
+        out->data[out->len++] = i + at;
+    }
+    return out->len - start;
+}
+
+StringList string_split_all(const string source, const string delim)
+{
+    IndexList index = {0};
+    size_t count = string_indexof_all(source, delim, &index);
+
+    StringList result = { .len = count + 1, .cap = count + 1 };
+    result.data = (string *)malloc(result.cap * sizeof(string));
+    assert(result.data && "We requested more memory but the computer said \"No\"!");
+    size_t prev = 0;
+    for (size_t i = 0; i < count; i++) {
+        result.data[i] = (string){ .data = &source.data[prev], .len = index.data[i] - prev };
+        prev = index.data[i] + delim.len;
+    }
+    result.data[count] = (string){ .data = &source.data[prev], .len = source.len - prev };
+    free(index.data);
+    return result;
+}
+
+//
+// Hashing
+//
+// wyhash (final version 4) by Wang Yi, public domain.
+// The 48 byte loop runs 3 independent multiply chains which keeps the
+// multiplier busy on long inputs, short keys are a couple of loads + 2 multiplies.
+const u64 _wyp[4] = { 0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull, 0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull };
+
+void _wymum(u64 *a, u64 *b)
+{
+#if defined(__SIZEOF_INT128__)
+    __uint128_t r = (__uint128_t)*a * *b;
+    *a = (u64)r;
+    *b = (u64)(r >> 64);
+#else
+    u64 ha = *a >> 32, hb = *b >> 32, la = (u32)*a, lb = (u32)*b;
+    u64 rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    u64 t = rl + (rm0 << 32), c = t < rl;
+    u64 lo = t + (rm1 << 32);
+    c += lo < t;
+    *a = lo;
+    *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+u64 _wymix(u64 a, u64 b)
+{
+    _wymum(&a, &b);
+    return a ^ b;
+}
+
+u64 _load_u32(const void *p)
+{
+    const u8 *b = (const u8 *)p;
+    return (u64)b[0] | (u64)b[1] << 8 | (u64)b[2] << 16 | (u64)b[3] << 24;
+}
+
+u64 string_hash_seed(const string source, u64 seed)
+{
+    const u8 *p = (const u8 *)source.data;
+    size_t len = source.len;
+    u64 a, b;
+    seed ^= _wymix(seed ^ _wyp[0], _wyp[1]);
+    if (len <= 16) {
+        if (len >= 4) {
+            a = (_load_u32(p) << 32) | _load_u32(p + ((len >> 3) << 2));
+            b = (_load_u32(p + len - 4) << 32) | _load_u32(p + len - 4 - ((len >> 3) << 2));
+        } else if (len > 0) {
+            a = ((u64)p[0] << 16) | ((u64)p[len >> 1] << 8) | p[len - 1];
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t i = len;
+        if (i >= 48) {
+            u64 see1 = seed, see2 = seed;
+            do {
+                seed = _wymix(_load_u64(p)      ^ _wyp[1], _load_u64(p + 8)  ^ seed);
+                see1 = _wymix(_load_u64(p + 16) ^ _wyp[2], _load_u64(p + 24) ^ see1);
+                see2 = _wymix(_load_u64(p + 32) ^ _wyp[3], _load_u64(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i >= 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = _wymix(_load_u64(p) ^ _wyp[1], _load_u64(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = _load_u64(p + i - 16);
+        b = _load_u64(p + i - 8);
+    }
+    a ^= _wyp[1];
+    b ^= seed;
+    _wymum(&a, &b);
+    return _wymix(a ^ _wyp[0] ^ len, b ^ _wyp[1]);
+}
+
+u64 string_hash(const string source)
+{
+    return string_hash_seed(source, 0);
+}
+
+//
+// Hash maps
+//
+// Control bytes: high bit clear = full (low 7 bits of the hash), EMPTY and DELETED have it set.
+// Slots are split into aligned groups of 16, probing goes group by group
+// (triangular steps so every group is visited) and stops at the first group with an EMPTY.
+#define HM_GROUP   16
+#define HM_EMPTY   0x80
+#define HM_DELETED 0xfe
+
+#if JP_SIMD_X86 && defined(__SSE2__)
+// SSE2 is baseline on x86_64 so no need to dispatch, it's a handful of instructions per probe
+u32 _hm_group_match(const u8 *ctrl, u8 h2)
+{
+    __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+    return (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char)h2)));
+}
+
+u32 _hm_group_empty(const u8 *ctrl)
+{
+    __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+    return (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char)HM_EMPTY)));
+}
+
+// EMPTY or DELETED, which are the only bytes with the high bit set
+u32 _hm_group_free(const u8 *ctrl)
+{
+    return (u32)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)ctrl));
+}
+#else
+u32 _hm_group_match(const u8 *ctrl, u8 h2)
+{
+    u32 mask = 0;
+    for (u32 i = 0; i < HM_GROUP; i++) mask |= (u32)(ctrl[i] == h2) << i;
+    return mask;
+}
+
+u32 _hm_group_empty(const u8 *ctrl)
+{
+    return _hm_group_match(ctrl, HM_EMPTY);
+}
+
+u32 _hm_group_free(const u8 *ctrl)
+{
+    u32 mask = 0;
+    for (u32 i = 0; i < HM_GROUP; i++) mask |= (u32)(ctrl[i] >> 7) << i;
+    return mask;
+}
+#endif
+
+u64 _hm_hash_bytes(const void *key, size_t size)
+{
+    return string_hash((string){ .data = (char *)key, .len = size });
+}
+
+u64 _hm_hash_string(const void *key, size_t size)
+{
+    (void)size;
+    return string_hash(*(const string *)key);
+}
+
+bool _hm_eq_bytes(const void *a, const void *b, size_t size)
+{
+    return _string_cmp_unsafe((const char *)a, (string){ .data = (char *)b, .len = size });
+}
+
+bool _hm_eq_string(const void *a, const void *b, size_t size)
+{
+    (void)size;
+    const string *sa = (const string *)a, *sb = (const string *)b;
+    return sa->len == sb->len && _string_cmp_unsafe(sa->data, *sb);
+}
+
+// Returns slot index of key or -1
+ptrdiff_t _hm_find(const _HashmapRaw *m, _HashmapType t, const void *key, u64 hash)
+{
+    if (m->cap == 0) return -1;
+    size_t groups = m->cap / HM_GROUP;
+    size_t g = (hash >> 7) & (groups - 1);
+    u8 h2 = hash & 0x7f;
+    for (size_t step = 1; step <= groups; step++) {
+        const u8 *ctrl = &m->ctrl[g * HM_GROUP];
+        for (u32 match = _hm_group_match(ctrl, h2); match; match &= match - 1) {
+            size_t i = g * HM_GROUP + _ctz32(match);
+            if (t.eq((const char *)m->keys + i * t.key_size, key, t.key_size)) return i;
+        }
+        if (_hm_group_empty(ctrl)) return -1;
+        g = (g + step) & (groups - 1);
+    }
+    return -1;
+}
+
+// First EMPTY or DELETED slot on the probe sequence, there always is one while growth_left > 0
+size_t _hm_find_free(const _HashmapRaw *m, u64 hash)
+{
+    size_t groups = m->cap / HM_GROUP;
+    size_t g = (hash >> 7) & (groups - 1);
+    for (size_t step = 1;; step++) {
+        u32 free_mask = _hm_group_free(&m->ctrl[g * HM_GROUP]);
+        if (free_mask) return g * HM_GROUP + _ctz32(free_mask);
+        g = (g + step) & (groups - 1);
+    }
+}
+
+void _hm_resize(_HashmapRaw *m, _HashmapType t, size_t cap)
+{
+    _HashmapRaw old = *m;
+    m->cap = cap;
+    m->len = 0;
+    m->growth_left = cap - cap / 8;
+    m->ctrl   = (u8 *)malloc(cap);
+    m->keys   = malloc(cap * t.key_size);
+    m->values = malloc(cap * t.value_size);
+    assert(m->ctrl && m->keys && m->values && "We requested more memory but the computer said \"No\"!");
+    for (size_t i = 0; i < cap; i++) m->ctrl[i] = HM_EMPTY;
+
+    // everything is unique already so no need to look for existing keys
+    for (size_t i = 0; i < old.cap; i++) {
+        if (old.ctrl[i] & 0x80) continue;
+        const char *key = (const char *)old.keys + i * t.key_size;
+        u64 hash = t.hash(key, t.key_size);
+        size_t at = _hm_find_free(m, hash);
+        m->ctrl[at] = hash & 0x7f;
+        for (size_t b = 0; b < t.key_size; b++)   ((char *)m->keys)[at * t.key_size + b]     = key[b];
+        for (size_t b = 0; b < t.value_size; b++) ((char *)m->values)[at * t.value_size + b] = ((const char *)old.values)[i * t.value_size + b];
+        m->len++;
+        m->growth_left--;
+    }
+    free(old.ctrl);
+    free(old.keys);
+    free(old.values);
+}
+
+void _hm_reserve(_HashmapRaw *m, _HashmapType t, size_t count)
+{
+    size_t cap = m->cap ? m->cap : HM_GROUP;
+    while (cap - cap / 8 < count) cap *= 2;
+    if (cap > m->cap) _hm_resize(m, t, cap);
+}
+
+void *_hm_put(_HashmapRaw *m, _HashmapType t, const void *key, const void *value)
+{
+    u64 hash = t.hash(key, t.key_size);
+    ptrdiff_t found = _hm_find(m, t, key, hash);
+    size_t at;
+    if (found >= 0) {
+        at = found;
+    } else {
+        if (m->cap == 0) _hm_resize(m, t, HM_GROUP);
+        at = _hm_find_free(m, hash);
+        if (m->growth_left == 0 && m->ctrl[at] == HM_EMPTY) {
+            // full of tombstones -> rehash in place, otherwise grow
+            _hm_resize(m, t, m->len * 2 < m->cap - m->cap / 8 ? m->cap : m->cap * 2);
+            at = _hm_find_free(m, hash);
+        }
+        if (m->ctrl[at] == HM_EMPTY) m->growth_left--;
+        m->ctrl[at] = hash & 0x7f;
+        m->len++;
+        for (size_t b = 0; b < t.key_size; b++) ((char *)m->keys)[at * t.key_size + b] = ((const char *)key)[b];
+    }
+    char *dest = (char *)m->values + at * t.value_size;
+    for (size_t b = 0; b < t.value_size; b++) dest[b] = ((const char *)value)[b];
+    return dest;
+}
+
+void *_hm_get(const _HashmapRaw *m, _HashmapType t, const void *key)
+{
+    ptrdiff_t found = _hm_find(m, t, key, t.hash(key, t.key_size));
+    return found < 0 ? NULL : (char *)m->values + found * t.value_size;
+}
+
+bool _hm_remove(_HashmapRaw *m, _HashmapType t, const void *key)
+{
+    ptrdiff_t found = _hm_find(m, t, key, t.hash(key, t.key_size));
+    if (found < 0) return false;
+    // If the group still has an EMPTY no probe ever went past it, so we don't need a tombstone
+    const u8 *group = &m->ctrl[(found / HM_GROUP) * HM_GROUP];
+    if (_hm_group_empty(group)) {
+        m->ctrl[found] = HM_EMPTY;
+        m->growth_left++;
+    } else {
+        m->ctrl[found] = HM_DELETED;
+    }
+    m->len--;
+    return true;
+}
+
+bool _hm_next(const _HashmapRaw *m, size_t *index)
+{
+    for (; *index < m->cap; (*index)++) {
+        if (!(m->ctrl[*index] & 0x80)) return true;
+    }
+    return false;
+}
+
+void _hm_free(_HashmapRaw *m)
+{
+    free(m->ctrl);
+    free(m->keys);
+    free(m->values);
+    *m = (_HashmapRaw){0};
+}
+
+//
+// String interning
+//
+#define INTERN_BLOCK_SIZE (64 * 1024)
+
+char *_intern_store(StringInterner *in, const string source)
+{
+    char *dest;
+    // an empty one would share its address with whatever comes next
+    if (!source.len) return (char *)"";
+    if (source.len > INTERN_BLOCK_SIZE / 4) {
+        // big strings get a block to themselves so we don't waste the rest of the current one
+        dest = (char *)malloc(source.len);
+        assert(dest && "We requested more memory but the computer said \"No\"!");
+        da_append(in->blocks, dest);
+    } else {
+        if (!in->block || in->block_used + source.len > INTERN_BLOCK_SIZE) {
+            in->block = (char *)malloc(INTERN_BLOCK_SIZE);
+            assert(in->block && "We requested more memory but the computer said \"No\"!");
+            da_append(in->blocks, in->block);
+            in->block_used = 0;
+        }
+        dest = &in->block[in->block_used];
+        in->block_used += source.len;
+    }
+    for (size_t i = 0; i < source.len; i++) dest[i] = source.data[i];
+    return dest;
+}
+
+u32 string_intern_id(StringInterner *in, const string source)
+{
+    u32 *id = hm_get(in->ids, source);
+    if (id) return *id;
+    string canonical = { .data = _intern_store(in, source), .len = source.len };
+    da_append(in->strings, canonical);
+    hm_put(in->ids, canonical, (u32)(in->strings.len - 1));
+    return (u32)(in->strings.len - 1);
+}
+
+string string_intern(StringInterner *in, const string source)
+{
+    u32 id = string_intern_id(in, source); // before reading strings.data, this can grow it
+    return in->strings.data[id];
+}
+
+string string_interned(const StringInterner *in, u32 id)
+{
+    assert(id < in->strings.len && "string_interned: unknown id");
+    return in->strings.data[id];
+}
+
+void string_interner_free(StringInterner *in)
+{
+    for (size_t i = 0; i < in->blocks.len; i++) free(in->blocks.data[i]);
+    free(in->blocks.data);
+    free(in->strings.data);
+    hm_free(in->ids);
+    *in = (StringInterner){0};
+}
+
+//
+// Number parsing
+//
+// No locale, no null terminator, no whitespace skipping, just the number at the
+// front of the slice. Integers eat 8 digits at a time with SWAR, floats are
+// Eisel-Lemire (the fast_float flavour) which is exact for up to 19 significant digits.
+
+// 8 ASCII digits in a little endian u64?
+bool _is_8digits(u64 v)
+{
+    return !(((v + 0x4646464646464646ull) | (v - 0x3030303030303030ull)) & SWAR_HIGHS);
+}
+
+// Combine pairs, then pairs of pairs, then the two halves with 3 multiplies total
+u32 _parse_8digits(u64 v)
+{
+    v -= 0x3030303030303030ull;
+    v = (v * 10) + (v >> 8);
+    v = (((v & 0x000000ff000000ffull) * (100 + (1000000ull << 32))) +
+         (((v >> 16) & 0x000000ff000000ffull) * (1 + (10000ull << 32)))) >> 32;
+    return (u32)v;
+}
+
+// Accumulates digits onto *value (wrapping), returns how many were read
+size_t _parse_digits(const char *p, size_t len, u64 *value)
+{
+    u64 v = *value;
+    size_t i = 0;
+    while (i + 8 <= len && _is_8digits(_load_u64(&p[i]))) {
+        v = v * 100000000 + _parse_8digits(_load_u64(&p[i]));
+        i += 8;
+    }
+    while (i < len && (u8)(p[i] - '0') < 10) {
+        v = v * 10 + (u8)(p[i] - '0');
+        i++;
+    }
+    *value = v;
+    return i;
+}
+
+size_t string_parse_u64(const string source, u64 *out)
+{
+    const char *p = source.data;
+    size_t len = source.len, i = 0;
+    u64 v = 0;
+    while (i + 8 <= len && _is_8digits(_load_u64(&p[i]))) {
+        if (__builtin_mul_overflow(v, 100000000, &v) ||
+            __builtin_add_overflow(v, _parse_8digits(_load_u64(&p[i])), &v)) return 0;
+        i += 8;
+    }
+    while (i < len && (u8)(p[i] - '0') < 10) {
+        if (__builtin_mul_overflow(v, 10, &v) ||
+            __builtin_add_overflow(v, (u8)(p[i] - '0'), &v)) return 0;
+        i++;
+    }
+    if (i == 0) return 0;
+    *out = v;
+    return i;
+}
+
+size_t string_parse_s64(const string source, s64 *out)
+{
+    if (source.len == 0) return 0;
+    bool negative = source.data[0] == '-';
+    size_t sign = negative || source.data[0] == '+';
+    u64 v;
+    size_t n = string_parse_u64((string){ .data = source.data + sign, .len = source.len - sign }, &v);
+    if (n == 0) return 0;
+    if (v > (u64)S64_MAX + negative) return 0;
+    *out = negative ? (s64)(0 - v) : (s64)v;
+    return sign + n;
+}
+
+// Truncated 128 bit powers of five 5^-342 .. 5^326, normalised so the top bit is set
+// (rounded up for the negative powers). Generated the same way as fast_float's table,
+// the float formatter also uses it (up to 10^326 for the smallest subnormals).
+#define POW5_SMALLEST -342
+#define POW5_LARGEST   326
+const u64 _pow5_128[2 * (POW5_LARGEST - POW5_SMALLEST + 1)] = {
+    0xeef453d6923bd65aull, 0x113faa2906a13b3full, 0x9558b4661b6565f8ull, 0x4ac7ca59a424c507ull,
+    0xbaaee17fa23ebf76ull, 0x5d79bcf00d2df649ull, 0xe95a99df8ace6f53ull, 0xf4d82c2c107973dcull,
+    0x91d8a02bb6c10594ull, 0x79071b9b8a4be869ull, 0xb64ec836a47146f9ull, 0x9748e2826cdee284ull,
+    0xe3e27a444d8d98b7ull, 0xfd1b1b2308169b25ull, 0x8e6d8c6ab0787f72ull, 0xfe30f0f5e50e20f7ull,
+    0xb208ef855c969f4full, 0xbdbd2d335e51a935ull, 0xde8b2b66b3bc4723ull, 0xad2c788035e61382ull,
+    0x8b16fb203055ac76ull, 0x4c3bcb5021afcc31ull, 0xaddcb9e83c6b1793ull, 0xdf4abe242a1bbf3dull,
+    0xd953e8624b85dd78ull, 0xd71d6dad34a2af0dull, 0x87d4713d6f33aa6bull, 0x8672648c40e5ad68ull,
+    0xa9c98d8ccb009506ull, 0x680efdaf511f18c2ull, 0xd43bf0effdc0ba48ull, 0x0212bd1b2566def2ull,
+    0x84a57695fe98746dull, 0x014bb630f7604b57ull, 0xa5ced43b7e3e9188ull, 0x419ea3bd35385e2dull,
+    0xcf42894a5dce35eaull, 0x52064cac828675b9ull, 0x818995ce7aa0e1b2ull, 0x7343efebd1940993ull,
+    0xa1ebfb4219491a1full, 0x1014ebe6c5f90bf8ull, 0xca66fa129f9b60a6ull, 0xd41a26e077774ef6ull,
+    0xfd00b897478238d0ull, 0x8920b098955522b4ull, 0x9e20735e8cb16382ull, 0x55b46e5f5d5535b0ull,
+    0xc5a890362fddbc62ull, 0xeb2189f734aa831dull, 0xf712b443bbd52b7bull, 0xa5e9ec7501d523e4ull,
+    0x9a6bb0aa55653b2dull, 0x47b233c92125366eull, 0xc1069cd4eabe89f8ull, 0x999ec0bb696e840aull,
+    0xf148440a256e2c76ull, 0xc00670ea43ca250dull, 0x96cd2a865764dbcaull, 0x380406926a5e5728ull,
+    0xbc807527ed3e12bcull, 0xc605083704f5ecf2ull, 0xeba09271e88d976bull, 0xf7864a44c633682eull,
+    0x93445b8731587ea3ull, 0x7ab3ee6afbe0211dull, 0xb8157268fdae9e4cull, 0x5960ea05bad82964ull,
+    0xe61acf033d1a45dfull, 0x6fb92487298e33bdull, 0x8fd0c16206306babull, 0xa5d3b6d479f8e056ull,
+    0xb3c4f1ba87bc8696ull, 0x8f48a4899877186cull, 0xe0b62e2929aba83cull, 0x331acdabfe94de87ull,
+    0x8c71dcd9ba0b4925ull, 0x9ff0c08b7f1d0b14ull, 0xaf8e5410288e1b6full, 0x07ecf0ae5ee44dd9ull,
+    0xdb71e91432b1a24aull, 0xc9e82cd9f69d6150ull, 0x892731ac9faf056eull, 0xbe311c083a225cd2ull,
+    0xab70fe17c79ac6caull, 0x6dbd630a48aaf406ull, 0xd64d3d9db981787dull, 0x092cbbccdad5b108ull,
+    0x85f0468293f0eb4eull, 0x25bbf56008c58ea5ull, 0xa76c582338ed2621ull, 0xaf2af2b80af6f24eull,
+    0xd1476e2c07286faaull, 0x1af5af660db4aee1ull, 0x82cca4db847945caull, 0x50d98d9fc890ed4dull,
+    0xa37fce126597973cull, 0xe50ff107bab528a0ull, 0xcc5fc196fefd7d0cull, 0x1e53ed49a96272c8ull,
+    0xff77b1fcbebcdc4full, 0x25e8e89c13bb0f7aull, 0x9faacf3df73609b1ull, 0x77b191618c54e9acull,
+    0xc795830d75038c1dull, 0xd59df5b9ef6a2417ull, 0xf97ae3d0d2446f25ull, 0x4b0573286b44ad1dull,
+    0x9becce62836ac577ull, 0x4ee367f9430aec32ull, 0xc2e801fb244576d5ull, 0x229c41f793cda73full,
+    0xf3a20279ed56d48aull, 0x6b43527578c1110full, 0x9845418c345644d6ull, 0x830a13896b78aaa9ull,
+    0xbe5691ef416bd60cull, 0x23cc986bc656d553ull, 0xedec366b11c6cb8full, 0x2cbfbe86b7ec8aa8ull,
+    0x94b3a202eb1c3f39ull, 0x7bf7d71432f3d6a9ull, 0xb9e08a83a5e34f07ull, 0xdaf5ccd93fb0cc53ull,
+    0xe858ad248f5c22c9ull, 0xd1b3400f8f9cff68ull, 0x91376c36d99995beull, 0x23100809b9c21fa1ull,
+    0xb58547448ffffb2dull, 0xabd40a0c2832a78aull, 0xe2e69915b3fff9f9ull, 0x16c90c8f323f516cull,
+    0x8dd01fad907ffc3bull, 0xae3da7d97f6792e3ull, 0xb1442798f49ffb4aull, 0x99cd11cfdf41779cull,
+    0xdd95317f31c7fa1dull, 0x40405643d711d583ull, 0x8a7d3eef7f1cfc52ull, 0x482835ea666b2572ull,
+    0xad1c8eab5ee43b66ull, 0xda3243650005eecfull, 0xd863b256369d4a40ull, 0x90bed43e40076a82ull,
+    0x873e4f75e2224e68ull, 0x5a7744a6e804a291ull, 0xa90de3535aaae202ull, 0x711515d0a205cb36ull,
+    0xd3515c2831559a83ull, 0x0d5a5b44ca873e03ull, 0x8412d9991ed58091ull, 0xe858790afe9486c2ull,
+    0xa5178fff668ae0b6ull, 0x626e974dbe39a872ull, 0xce5d73ff402d98e3ull, 0xfb0a3d212dc8128full,
+    0x80fa687f881c7f8eull, 0x7ce66634bc9d0b99ull, 0xa139029f6a239f72ull, 0x1c1fffc1ebc44e80ull,
+    0xc987434744ac874eull, 0xa327ffb266b56220ull, 0xfbe9141915d7a922ull, 0x4bf1ff9f0062baa8ull,
+    0x9d71ac8fada6c9b5ull, 0x6f773fc3603db4a9ull, 0xc4ce17b399107c22ull, 0xcb550fb4384d21d3ull,
+    0xf6019da07f549b2bull, 0x7e2a53a146606a48ull, 0x99c102844f94e0fbull, 0x2eda7444cbfc426dull,
+    0xc0314325637a1939ull, 0xfa911155fefb5308ull, 0xf03d93eebc589f88ull, 0x793555ab7eba27caull,
+    0x96267c7535b763b5ull, 0x4bc1558b2f3458deull, 0xbbb01b9283253ca2ull, 0x9eb1aaedfb016f16ull,
+    0xea9c227723ee8bcbull, 0x465e15a979c1cadcull, 0x92a1958a7675175full, 0x0bfacd89ec191ec9ull,
+    0xb749faed14125d36ull, 0xcef980ec671f667bull, 0xe51c79a85916f484ull, 0x82b7e12780e7401aull,
+    0x8f31cc0937ae58d2ull, 0xd1b2ecb8b0908810ull, 0xb2fe3f0b8599ef07ull, 0x861fa7e6dcb4aa15ull,
+    0xdfbdcece67006ac9ull, 0x67a791e093e1d49aull, 0x8bd6a141006042bdull, 0xe0c8bb2c5c6d24e0ull,
+    0xaecc49914078536dull, 0x58fae9f773886e18ull, 0xda7f5bf590966848ull, 0xaf39a475506a899eull,
+    0x888f99797a5e012dull, 0x6d8406c952429603ull, 0xaab37fd7d8f58178ull, 0xc8e5087ba6d33b83ull,
+    0xd5605fcdcf32e1d6ull, 0xfb1e4a9a90880a64ull, 0x855c3be0a17fcd26ull, 0x5cf2eea09a55067full,
+    0xa6b34ad8c9dfc06full, 0xf42faa48c0ea481eull, 0xd0601d8efc57b08bull, 0xf13b94daf124da26ull,
+    0x823c12795db6ce57ull, 0x76c53d08d6b70858ull, 0xa2cb1717b52481edull, 0x54768c4b0c64ca6eull,
+    0xcb7ddcdda26da268ull, 0xa9942f5dcf7dfd09ull, 0xfe5d54150b090b02ull, 0xd3f93b35435d7c4cull,
+    0x9efa548d26e5a6e1ull, 0xc47bc5014a1a6dafull, 0xc6b8e9b0709f109aull, 0x359ab6419ca1091bull,
+    0xf867241c8cc6d4c0ull, 0xc30163d203c94b62ull, 0x9b407691d7fc44f8ull, 0x79e0de63425dcf1dull,
+    0xc21094364dfb5636ull, 0x985915fc12f542e4ull, 0xf294b943e17a2bc4ull, 0x3e6f5b7b17b2939dull,
+    0x979cf3ca6cec5b5aull, 0xa705992ceecf9c42ull, 0xbd8430bd08277231ull, 0x50c6ff782a838353ull,
+    0xece53cec4a314ebdull, 0xa4f8bf5635246428ull, 0x940f4613ae5ed136ull, 0x871b7795e136be99ull,
+    0xb913179899f68584ull, 0x28e2557b59846e3full, 0xe757dd7ec07426e5ull, 0x331aeada2fe589cfull,
+    0x9096ea6f3848984full, 0x3ff0d2c85def7621ull, 0xb4bca50b065abe63ull, 0x0fed077a756b53a9ull,
+    0xe1ebce4dc7f16dfbull, 0xd3e8495912c62894ull, 0x8d3360f09cf6e4bdull, 0x64712dd7abbbd95cull,
+    0xb080392cc4349decull, 0xbd8d794d96aacfb3ull, 0xdca04777f541c567ull, 0xecf0d7a0fc5583a0ull,
+    0x89e42caaf9491b60ull, 0xf41686c49db57244ull, 0xac5d37d5b79b6239ull, 0x311c2875c522ced5ull,
+    0xd77485cb25823ac7ull, 0x7d633293366b828bull, 0x86a8d39ef77164bcull, 0xae5dff9c02033197ull,
+    0xa8530886b54dbdebull, 0xd9f57f830283fdfcull, 0xd267caa862a12d66ull, 0xd072df63c324fd7bull,
+    0x8380dea93da4bc60ull, 0x4247cb9e59f71e6dull, 0xa46116538d0deb78ull, 0x52d9be85f074e608ull,
+    0xcd795be870516656ull, 0x67902e276c921f8bull, 0x806bd9714632dff6ull, 0x00ba1cd8a3db53b6ull,
+    0xa086cfcd97bf97f3ull, 0x80e8a40eccd228a4ull, 0xc8a883c0fdaf7df0ull, 0x6122cd128006b2cdull,
+    0xfad2a4b13d1b5d6cull, 0x796b805720085f81ull, 0x9cc3a6eec6311a63ull, 0xcbe3303674053bb0ull,
+    0xc3f490aa77bd60fcull, 0xbedbfc4411068a9cull, 0xf4f1b4d515acb93bull, 0xee92fb5515482d44ull,
+    0x991711052d8bf3c5ull, 0x751bdd152d4d1c4aull, 0xbf5cd54678eef0b6ull, 0xd262d45a78a0635dull,
+    0xef340a98172aace4ull, 0x86fb897116c87c34ull, 0x9580869f0e7aac0eull, 0xd45d35e6ae3d4da0ull,
+    0xbae0a846d2195712ull, 0x8974836059cca109ull, 0xe998d258869facd7ull, 0x2bd1a438703fc94bull,
+    0x91ff83775423cc06ull, 0x7b6306a34627ddcfull, 0xb67f6455292cbf08ull, 0x1a3bc84c17b1d542ull,
+    0xe41f3d6a7377eecaull, 0x20caba5f1d9e4a93ull, 0x8e938662882af53eull, 0x547eb47b7282ee9cull,
+    0xb23867fb2a35b28dull, 0xe99e619a4f23aa43ull, 0xdec681f9f4c31f31ull, 0x6405fa00e2ec94d4ull,
+    0x8b3c113c38f9f37eull, 0xde83bc408dd3dd04ull, 0xae0b158b4738705eull, 0x9624ab50b148d445ull,
+    0xd98ddaee19068c76ull, 0x3badd624dd9b0957ull, 0x87f8a8d4cfa417c9ull, 0xe54ca5d70a80e5d6ull,
+    0xa9f6d30a038d1dbcull, 0x5e9fcf4ccd211f4cull, 0xd47487cc8470652bull, 0x7647c3200069671full,
+    0x84c8d4dfd2c63f3bull, 0x29ecd9f40041e073ull, 0xa5fb0a17c777cf09ull, 0xf468107100525890ull,
+    0xcf79cc9db955c2ccull, 0x7182148d4066eeb4ull, 0x81ac1fe293d599bfull, 0xc6f14cd848405530ull,
+    0xa21727db38cb002full, 0xb8ada00e5a506a7cull, 0xca9cf1d206fdc03bull, 0xa6d90811f0e4851cull,
+    0xfd442e4688bd304aull, 0x908f4a166d1da663ull, 0x9e4a9cec15763e2eull, 0x9a598e4e043287feull,
+    0xc5dd44271ad3cdbaull, 0x40eff1e1853f29fdull, 0xf7549530e188c128ull, 0xd12bee59e68ef47cull,
+    0x9a94dd3e8cf578b9ull, 0x82bb74f8301958ceull, 0xc13a148e3032d6e7ull, 0xe36a52363c1faf01ull,
+    0xf18899b1bc3f8ca1ull, 0xdc44e6c3cb279ac1ull, 0x96f5600f15a7b7e5ull, 0x29ab103a5ef8c0b9ull,
+    0xbcb2b812db11a5deull, 0x7415d448f6b6f0e7ull, 0xebdf661791d60f56ull, 0x111b495b3464ad21ull,
+    0x936b9fcebb25c995ull, 0xcab10dd900beec34ull, 0xb84687c269ef3bfbull, 0x3d5d514f40eea742ull,
+    0xe65829b3046b0afaull, 0x0cb4a5a3112a5112ull, 0x8ff71a0fe2c2e6dcull, 0x47f0e785eaba72abull,
+    0xb3f4e093db73a093ull, 0x59ed216765690f56ull, 0xe0f218b8d25088b8ull, 0x306869c13ec3532cull,
+    0x8c974f7383725573ull, 0x1e414218c73a13fbull, 0xafbd2350644eeacfull, 0xe5d1929ef90898faull,
+    0xdbac6c247d62a583ull, 0xdf45f746b74abf39ull, 0x894bc396ce5da772ull, 0x6b8bba8c328eb783ull,
+    0xab9eb47c81f5114full, 0x066ea92f3f326564ull, 0xd686619ba27255a2ull, 0xc80a537b0efefebdull,
+    0x8613fd0145877585ull, 0xbd06742ce95f5f36ull, 0xa798fc4196e952e7ull, 0x2c48113823b73704ull,
+    0xd17f3b51fca3a7a0ull, 0xf75a15862ca504c5ull, 0x82ef85133de648c4ull, 0x9a984d73dbe722fbull,
+    0xa3ab66580d5fdaf5ull, 0xc13e60d0d2e0ebbaull, 0xcc963fee10b7d1b3ull, 0x318df905079926a8ull,
+    0xffbbcfe994e5c61full, 0xfdf17746497f7052ull, 0x9fd561f1fd0f9bd3ull, 0xfeb6ea8bedefa633ull,
+    0xc7caba6e7c5382c8ull, 0xfe64a52ee96b8fc0ull, 0xf9bd690a1b68637bull, 0x3dfdce7aa3c673b0ull,
+    0x9c1661a651213e2dull, 0x06bea10ca65c084eull, 0xc31bfa0fe5698db8ull, 0x486e494fcff30a62ull,
+    0xf3e2f893dec3f126ull, 0x5a89dba3c3efccfaull, 0x986ddb5c6b3a76b7ull, 0xf89629465a75e01cull,
+    0xbe89523386091465ull, 0xf6bbb397f1135823ull, 0xee2ba6c0678b597full, 0x746aa07ded582e2cull,
+    0x94db483840b717efull, 0xa8c2a44eb4571cdcull, 0xba121a4650e4ddebull, 0x92f34d62616ce413ull,
+    0xe896a0d7e51e1566ull, 0x77b020baf9c81d17ull, 0x915e2486ef32cd60ull, 0x0ace1474dc1d122eull,
+    0xb5b5ada8aaff80b8ull, 0x0d819992132456baull, 0xe3231912d5bf60e6ull, 0x10e1fff697ed6c69ull,
+    0x8df5efabc5979c8full, 0xca8d3ffa1ef463c1ull, 0xb1736b96b6fd83b3ull, 0xbd308ff8a6b17cb2ull,
+    0xddd0467c64bce4a0ull, 0xac7cb3f6d05ddbdeull, 0x8aa22c0dbef60ee4ull, 0x6bcdf07a423aa96bull,
+    0xad4ab7112eb3929dull, 0x86c16c98d2c953c6ull, 0xd89d64d57a607744ull, 0xe871c7bf077ba8b7ull,
+    0x87625f056c7c4a8bull, 0x11471cd764ad4972ull, 0xa93af6c6c79b5d2dull, 0xd598e40d3dd89bcfull,
+    0xd389b47879823479ull, 0x4aff1d108d4ec2c3ull, 0x843610cb4bf160cbull, 0xcedf722a585139baull,
+    0xa54394fe1eedb8feull, 0xc2974eb4ee658828ull, 0xce947a3da6a9273eull, 0x733d226229feea32ull,
+    0x811ccc668829b887ull, 0x0806357d5a3f525full, 0xa163ff802a3426a8ull, 0xca07c2dcb0cf26f7ull,
+    0xc9bcff6034c13052ull, 0xfc89b393dd02f0b5ull, 0xfc2c3f3841f17c67ull, 0xbbac2078d443ace2ull,
+    0x9d9ba7832936edc0ull, 0xd54b944b84aa4c0dull, 0xc5029163f384a931ull, 0x0a9e795e65d4df11ull,
+    0xf64335bcf065d37dull, 0x4d4617b5ff4a16d5ull, 0x99ea0196163fa42eull, 0x504bced1bf8e4e45ull,
+    0xc06481fb9bcf8d39ull, 0xe45ec2862f71e1d6ull, 0xf07da27a82c37088ull, 0x5d767327bb4e5a4cull,
+    0x964e858c91ba2655ull, 0x3a6a07f8d510f86full, 0xbbe226efb628afeaull, 0x890489f70a55368bull,
+    0xeadab0aba3b2dbe5ull, 0x2b45ac74ccea842eull, 0x92c8ae6b464fc96full, 0x3b0b8bc90012929dull,
+    0xb77ada0617e3bbcbull, 0x09ce6ebb40173744ull, 0xe55990879ddcaabdull, 0xcc420a6a101d0515ull,
+    0x8f57fa54c2a9eab6ull, 0x9fa946824a12232dull, 0xb32df8e9f3546564ull, 0x47939822dc96abf9ull,
+    0xdff9772470297ebdull, 0x59787e2b93bc56f7ull, 0x8bfbea76c619ef36ull, 0x57eb4edb3c55b65aull,
+    0xaefae51477a06b03ull, 0xede622920b6b23f1ull, 0xdab99e59958885c4ull, 0xe95fab368e45ecedull,
+    0x88b402f7fd75539bull, 0x11dbcb0218ebb414ull, 0xaae103b5fcd2a881ull, 0xd652bdc29f26a119ull,
+    0xd59944a37c0752a2ull, 0x4be76d3346f0495full, 0x857fcae62d8493a5ull, 0x6f70a4400c562ddbull,
+    0xa6dfbd9fb8e5b88eull, 0xcb4ccd500f6bb952ull, 0xd097ad07a71f26b2ull, 0x7e2000a41346a7a7ull,
+    0x825ecc24c873782full, 0x8ed400668c0c28c8ull, 0xa2f67f2dfa90563bull, 0x728900802f0f32faull,
+    0xcbb41ef979346bcaull, 0x4f2b40a03ad2ffb9ull, 0xfea126b7d78186bcull, 0xe2f610c84987bfa8ull,
+    0x9f24b832e6b0f436ull, 0x0dd9ca7d2df4d7c9ull, 0xc6ede63fa05d3143ull, 0x91503d1c79720dbbull,
+    0xf8a95fcf88747d94ull, 0x75a44c6397ce912aull, 0x9b69dbe1b548ce7cull, 0xc986afbe3ee11abaull,
+    0xc24452da229b021bull, 0xfbe85badce996168ull, 0xf2d56790ab41c2a2ull, 0xfae27299423fb9c3ull,
+    0x97c560ba6b0919a5ull, 0xdccd879fc967d41aull, 0xbdb6b8e905cb600full, 0x5400e987bbc1c920ull,
+    0xed246723473e3813ull, 0x290123e9aab23b68ull, 0x9436c0760c86e30bull, 0xf9a0b6720aaf6521ull,
+    0xb94470938fa89bceull, 0xf808e40e8d5b3e69ull, 0xe7958cb87392c2c2ull, 0xb60b1d1230b20e04ull,
+    0x90bd77f3483bb9b9ull, 0xb1c6f22b5e6f48c2ull, 0xb4ecd5f01a4aa828ull, 0x1e38aeb6360b1af3ull,
+    0xe2280b6c20dd5232ull, 0x25c6da63c38de1b0ull, 0x8d590723948a535full, 0x579c487e5a38ad0eull,
+    0xb0af48ec79ace837ull, 0x2d835a9df0c6d851ull, 0xdcdb1b2798182244ull, 0xf8e431456cf88e65ull,
+    0x8a08f0f8bf0f156bull, 0x1b8e9ecb641b58ffull, 0xac8b2d36eed2dac5ull, 0xe272467e3d222f3full,
+    0xd7adf884aa879177ull, 0x5b0ed81dcc6abb0full, 0x86ccbb52ea94baeaull, 0x98e947129fc2b4e9ull,
+    0xa87fea27a539e9a5ull, 0x3f2398d747b36224ull, 0xd29fe4b18e88640eull, 0x8eec7f0d19a03aadull,
+    0x83a3eeeef9153e89ull, 0x1953cf68300424acull, 0xa48ceaaab75a8e2bull, 0x5fa8c3423c052dd7ull,
+    0xcdb02555653131b6ull, 0x3792f412cb06794dull, 0x808e17555f3ebf11ull, 0xe2bbd88bbee40bd0ull,
+    0xa0b19d2ab70e6ed6ull, 0x5b6aceaeae9d0ec4ull, 0xc8de047564d20a8bull, 0xf245825a5a445275ull,
+    0xfb158592be068d2eull, 0xeed6e2f0f0d56712ull, 0x9ced737bb6c4183dull, 0x55464dd69685606bull,
+    0xc428d05aa4751e4cull, 0xaa97e14c3c26b886ull, 0xf53304714d9265dfull, 0xd53dd99f4b3066a8ull,
+    0x993fe2c6d07b7fabull, 0xe546a8038efe4029ull, 0xbf8fdb78849a5f96ull, 0xde98520472bdd033ull,
+    0xef73d256a5c0f77cull, 0x963e66858f6d4440ull, 0x95a8637627989aadull, 0xdde7001379a44aa8ull,
+    0xbb127c53b17ec159ull, 0x5560c018580d5d52ull, 0xe9d71b689dde71afull, 0xaab8f01e6e10b4a6ull,
+    0x9226712162ab070dull, 0xcab3961304ca70e8ull, 0xb6b00d69bb55c8d1ull, 0x3d607b97c5fd0d22ull,
+    0xe45c10c42a2b3b05ull, 0x8cb89a7db77c506aull, 0x8eb98a7a9a5b04e3ull, 0x77f3608e92adb242ull,
+    0xb267ed1940f1c61cull, 0x55f038b237591ed3ull, 0xdf01e85f912e37a3ull, 0x6b6c46dec52f6688ull,
+    0x8b61313bbabce2c6ull, 0x2323ac4b3b3da015ull, 0xae397d8aa96c1b77ull, 0xabec975e0a0d081aull,
+    0xd9c7dced53c72255ull, 0x96e7bd358c904a21ull, 0x881cea14545c7575ull, 0x7e50d64177da2e54ull,
+    0xaa242499697392d2ull, 0xdde50bd1d5d0b9e9ull, 0xd4ad2dbfc3d07787ull, 0x955e4ec64b44e864ull,
+    0x84ec3c97da624ab4ull, 0xbd5af13bef0b113eull, 0xa6274bbdd0fadd61ull, 0xecb1ad8aeacdd58eull,
+    0xcfb11ead453994baull, 0x67de18eda5814af2ull, 0x81ceb32c4b43fcf4ull, 0x80eacf948770ced7ull,
+    0xa2425ff75e14fc31ull, 0xa1258379a94d028dull, 0xcad2f7f5359a3b3eull, 0x096ee45813a04330ull,
+    0xfd87b5f28300ca0dull, 0x8bca9d6e188853fcull, 0x9e74d1b791e07e48ull, 0x775ea264cf55347eull,
+    0xc612062576589ddaull, 0x95364afe032a819eull, 0xf79687aed3eec551ull, 0x3a83ddbd83f52205ull,
+    0x9abe14cd44753b52ull, 0xc4926a9672793543ull, 0xc16d9a0095928a27ull, 0x75b7053c0f178294ull,
+    0xf1c90080baf72cb1ull, 0x5324c68b12dd6339ull, 0x971da05074da7beeull, 0xd3f6fc16ebca5e04ull,
+    0xbce5086492111aeaull, 0x88f4bb1ca6bcf585ull, 0xec1e4a7db69561a5ull, 0x2b31e9e3d06c32e6ull,
+    0x9392ee8e921d5d07ull, 0x3aff322e62439fd0ull, 0xb877aa3236a4b449ull, 0x09befeb9fad487c3ull,
+    0xe69594bec44de15bull, 0x4c2ebe687989a9b4ull, 0x901d7cf73ab0acd9ull, 0x0f9d37014bf60a11ull,
+    0xb424dc35095cd80full, 0x538484c19ef38c95ull, 0xe12e13424bb40e13ull, 0x2865a5f206b06fbaull,
+    0x8cbccc096f5088cbull, 0xf93f87b7442e45d4ull, 0xafebff0bcb24aafeull, 0xf78f69a51539d749ull,
+    0xdbe6fecebdedd5beull, 0xb573440e5a884d1cull, 0x89705f4136b4a597ull, 0x31680a88f8953031ull,
+    0xabcc77118461cefcull, 0xfdc20d2b36ba7c3eull, 0xd6bf94d5e57a42bcull, 0x3d32907604691b4dull,
+    0x8637bd05af6c69b5ull, 0xa63f9a49c2c1b110ull, 0xa7c5ac471b478423ull, 0x0fcf80dc33721d54ull,
+    0xd1b71758e219652bull, 0xd3c36113404ea4a9ull, 0x83126e978d4fdf3bull, 0x645a1cac083126eaull,
+    0xa3d70a3d70a3d70aull, 0x3d70a3d70a3d70a4ull, 0xccccccccccccccccull, 0xcccccccccccccccdull,
+    0x8000000000000000ull, 0x0000000000000000ull, 0xa000000000000000ull, 0x0000000000000000ull,
+    0xc800000000000000ull, 0x0000000000000000ull, 0xfa00000000000000ull, 0x0000000000000000ull,
+    0x9c40000000000000ull, 0x0000000000000000ull, 0xc350000000000000ull, 0x0000000000000000ull,
+    0xf424000000000000ull, 0x0000000000000000ull, 0x9896800000000000ull, 0x0000000000000000ull,
+    0xbebc200000000000ull, 0x0000000000000000ull, 0xee6b280000000000ull, 0x0000000000000000ull,
+    0x9502f90000000000ull, 0x0000000000000000ull, 0xba43b74000000000ull, 0x0000000000000000ull,
+    0xe8d4a51000000000ull, 0x0000000000000000ull, 0x9184e72a00000000ull, 0x0000000000000000ull,
+    0xb5e620f480000000ull, 0x0000000000000000ull, 0xe35fa931a0000000ull, 0x0000000000000000ull,
+    0x8e1bc9bf04000000ull, 0x0000000000000000ull, 0xb1a2bc2ec5000000ull, 0x0000000000000000ull,
+    0xde0b6b3a76400000ull, 0x0000000000000000ull, 0x8ac7230489e80000ull, 0x0000000000000000ull,
+    0xad78ebc5ac620000ull, 0x0000000000000000ull, 0xd8d726b7177a8000ull, 0x0000000000000000ull,
+    0x878678326eac9000ull, 0x0000000000000000ull, 0xa968163f0a57b400ull, 0x0000000000000000ull,
+    0xd3c21bcecceda100ull, 0x0000000000000000ull, 0x84595161401484a0ull, 0x0000000000000000ull,
+    0xa56fa5b99019a5c8ull, 0x0000000000000000ull, 0xcecb8f27f4200f3aull, 0x0000000000000000ull,
+    0x813f3978f8940984ull, 0x4000000000000000ull, 0xa18f07d736b90be5ull, 0x5000000000000000ull,
+    0xc9f2c9cd04674edeull, 0xa400000000000000ull, 0xfc6f7c4045812296ull, 0x4d00000000000000ull,
+    0x9dc5ada82b70b59dull, 0xf020000000000000ull, 0xc5371912364ce305ull, 0x6c28000000000000ull,
+    0xf684df56c3e01bc6ull, 0xc732000000000000ull, 0x9a130b963a6c115cull, 0x3c7f400000000000ull,
+    0xc097ce7bc90715b3ull, 0x4b9f100000000000ull, 0xf0bdc21abb48db20ull, 0x1e86d40000000000ull,
+    0x96769950b50d88f4ull, 0x1314448000000000ull, 0xbc143fa4e250eb31ull, 0x17d955a000000000ull,
+    0xeb194f8e1ae525fdull, 0x5dcfab0800000000ull, 0x92efd1b8d0cf37beull, 0x5aa1cae500000000ull,
+    0xb7abc627050305adull, 0xf14a3d9e40000000ull, 0xe596b7b0c643c719ull, 0x6d9ccd05d0000000ull,
+    0x8f7e32ce7bea5c6full, 0xe4820023a2000000ull, 0xb35dbf821ae4f38bull, 0xdda2802c8a800000ull,
+    0xe0352f62a19e306eull, 0xd50b2037ad200000ull, 0x8c213d9da502de45ull, 0x4526f422cc340000ull,
+    0xaf298d050e4395d6ull, 0x9670b12b7f410000ull, 0xdaf3f04651d47b4cull, 0x3c0cdd765f114000ull,
+    0x88d8762bf324cd0full, 0xa5880a69fb6ac800ull, 0xab0e93b6efee0053ull, 0x8eea0d047a457a00ull,
+    0xd5d238a4abe98068ull, 0x72a4904598d6d880ull, 0x85a36366eb71f041ull, 0x47a6da2b7f864750ull,
+    0xa70c3c40a64e6c51ull, 0x999090b65f67d924ull, 0xd0cf4b50cfe20765ull, 0xfff4b4e3f741cf6dull,
+    0x82818f1281ed449full, 0xbff8f10e7a8921a4ull, 0xa321f2d7226895c7ull, 0xaff72d52192b6a0dull,
+    0xcbea6f8ceb02bb39ull, 0x9bf4f8a69f764490ull, 0xfee50b7025c36a08ull, 0x02f236d04753d5b4ull,
+    0x9f4f2726179a2245ull, 0x01d762422c946590ull, 0xc722f0ef9d80aad6ull, 0x424d3ad2b7b97ef5ull,
+    0xf8ebad2b84e0d58bull, 0xd2e0898765a7deb2ull, 0x9b934c3b330c8577ull, 0x63cc55f49f88eb2full,
+    0xc2781f49ffcfa6d5ull, 0x3cbf6b71c76b25fbull, 0xf316271c7fc3908aull, 0x8bef464e3945ef7aull,
+    0x97edd871cfda3a56ull, 0x97758bf0e3cbb5acull, 0xbde94e8e43d0c8ecull, 0x3d52eeed1cbea317ull,
+    0xed63a231d4c4fb27ull, 0x4ca7aaa863ee4bddull, 0x945e455f24fb1cf8ull, 0x8fe8caa93e74ef6aull,
+    0xb975d6b6ee39e436ull, 0xb3e2fd538e122b44ull, 0xe7d34c64a9c85d44ull, 0x60dbbca87196b616ull,
+    0x90e40fbeea1d3a4aull, 0xbc8955e946fe31cdull, 0xb51d13aea4a488ddull, 0x6babab6398bdbe41ull,
+    0xe264589a4dcdab14ull, 0xc696963c7eed2dd1ull, 0x8d7eb76070a08aecull, 0xfc1e1de5cf543ca2ull,
+    0xb0de65388cc8ada8ull, 0x3b25a55f43294bcbull, 0xdd15fe86affad912ull, 0x49ef0eb713f39ebeull,
+    0x8a2dbf142dfcc7abull, 0x6e3569326c784337ull, 0xacb92ed9397bf996ull, 0x49c2c37f07965404ull,
+    0xd7e77a8f87daf7fbull, 0xdc33745ec97be906ull, 0x86f0ac99b4e8dafdull, 0x69a028bb3ded71a3ull,
+    0xa8acd7c0222311bcull, 0xc40832ea0d68ce0cull, 0xd2d80db02aabd62bull, 0xf50a3fa490c30190ull,
+    0x83c7088e1aab65dbull, 0x792667c6da79e0faull, 0xa4b8cab1a1563f52ull, 0x577001b891185938ull,
+    0xcde6fd5e09abcf26ull, 0xed4c0226b55e6f86ull, 0x80b05e5ac60b6178ull, 0x544f8158315b05b4ull,
+    0xa0dc75f1778e39d6ull, 0x696361ae3db1c721ull, 0xc913936dd571c84cull, 0x03bc3a19cd1e38e9ull,
+    0xfb5878494ace3a5full, 0x04ab48a04065c723ull, 0x9d174b2dcec0e47bull, 0x62eb0d64283f9c76ull,
+    0xc45d1df942711d9aull, 0x3ba5d0bd324f8394ull, 0xf5746577930d6500ull, 0xca8f44ec7ee36479ull,
+    0x9968bf6abbe85f20ull, 0x7e998b13cf4e1ecbull, 0xbfc2ef456ae276e8ull, 0x9e3fedd8c321a67eull,
+    0xefb3ab16c59b14a2ull, 0xc5cfe94ef3ea101eull, 0x95d04aee3b80ece5ull, 0xbba1f1d158724a12ull,
+    0xbb445da9ca61281full, 0x2a8a6e45ae8edc97ull, 0xea1575143cf97226ull, 0xf52d09d71a3293bdull,
+    0x924d692ca61be758ull, 0x593c2626705f9c56ull, 0xb6e0c377cfa2e12eull, 0x6f8b2fb00c77836cull,
+    0xe498f455c38b997aull, 0x0b6dfb9c0f956447ull, 0x8edf98b59a373fecull, 0x4724bd4189bd5eacull,
+    0xb2977ee300c50fe7ull, 0x58edec91ec2cb657ull, 0xdf3d5e9bc0f653e1ull, 0x2f2967b66737e3edull,
+    0x8b865b215899f46cull, 0xbd79e0d20082ee74ull, 0xae67f1e9aec07187ull, 0xecd8590680a3aa11ull,
+    0xda01ee641a708de9ull, 0xe80e6f4820cc9495ull, 0x884134fe908658b2ull, 0x3109058d147fdcddull,
+    0xaa51823e34a7eedeull, 0xbd4b46f0599fd415ull, 0xd4e5e2cdc1d1ea96ull, 0x6c9e18ac7007c91aull,
+    0x850fadc09923329eull, 0x03e2cf6bc604ddb0ull, 0xa6539930bf6bff45ull, 0x84db8346b786151cull,
+    0xcfe87f7cef46ff16ull, 0xe612641865679a63ull, 0x81f14fae158c5f6eull, 0x4fcb7e8f3f60c07eull,
+    0xa26da3999aef7749ull, 0xe3be5e330f38f09dull, 0xcb090c8001ab551cull, 0x5cadf5bfd3072cc5ull,
+    0xfdcb4fa002162a63ull, 0x73d9732fc7c8f7f6ull, 0x9e9f11c4014dda7eull, 0x2867e7fddcdd9afaull,
+    0xc646d63501a1511dull, 0xb281e1fd541501b8ull, 0xf7d88bc24209a565ull, 0x1f225a7ca91a4226ull,
+    0x9ae757596946075full, 0x3375788de9b06958ull, 0xc1a12d2fc3978937ull, 0x0052d6b1641c83aeull,
+    0xf209787bb47d6b84ull, 0xc0678c5dbd23a49aull, 0x9745eb4d50ce6332ull, 0xf840b7ba963646e0ull,
+    0xbd176620a501fbffull, 0xb650e5a93bc3d898ull, 0xec5d3fa8ce427affull, 0xa3e51f138ab4cebeull,
+    0x93ba47c980e98cdfull, 0xc66f336c36b10137ull, 0xb8a8d9bbe123f017ull, 0xb80b0047445d4184ull,
+    0xe6d3102ad96cec1dull, 0xa60dc059157491e5ull, 0x9043ea1ac7e41392ull, 0x87c89837ad68db2full,
+    0xb454e4a179dd1877ull, 0x29babe4598c311fbull, 0xe16a1dc9d8545e94ull, 0xf4296dd6fef3d67aull,
+    0x8ce2529e2734bb1dull, 0x1899e4a65f58660cull, 0xb01ae745b101e9e4ull, 0x5ec05dcff72e7f8full,
+    0xdc21a1171d42645dull, 0x76707543f4fa1f73ull, 0x899504ae72497ebaull, 0x6a06494a791c53a8ull,
+    0xabfa45da0edbde69ull, 0x0487db9d17636892ull, 0xd6f8d7509292d603ull, 0x45a9d2845d3c42b6ull,
+    0x865b86925b9bc5c2ull, 0x0b8a2392ba45a9b2ull, 0xa7f26836f282b732ull, 0x8e6cac7768d7141eull,
+    0xd1ef0244af2364ffull, 0x3207d795430cd926ull, 0x8335616aed761f1full, 0x7f44e6bd49e807b8ull,
+    0xa402b9c5a8d3a6e7ull, 0x5f16206c9c6209a6ull, 0xcd036837130890a1ull, 0x36dba887c37a8c0full,
+    0x802221226be55a64ull, 0xc2494954da2c9789ull, 0xa02aa96b06deb0fdull, 0xf2db9baa10b7bd6cull,
+    0xc83553c5c8965d3dull, 0x6f92829494e5acc7ull, 0xfa42a8b73abbf48cull, 0xcb772339ba1f17f9ull,
+    0x9c69a97284b578d7ull, 0xff2a760414536efbull, 0xc38413cf25e2d70dull, 0xfef5138519684abaull,
+    0xf46518c2ef5b8cd1ull, 0x7eb258665fc25d69ull, 0x98bf2f79d5993802ull, 0xef2f773ffbd97a61ull,
+    0xbeeefb584aff8603ull, 0xaafb550ffacfd8faull, 0xeeaaba2e5dbf6784ull, 0x95ba2a53f983cf38ull,
+    0x952ab45cfa97a0b2ull, 0xdd945a747bf26183ull, 0xba756174393d88dfull, 0x94f971119aeef9e4ull,
+    0xe912b9d1478ceb17ull, 0x7a37cd5601aab85dull, 0x91abb422ccb812eeull, 0xac62e055c10ab33aull,
+    0xb616a12b7fe617aaull, 0x577b986b314d6009ull, 0xe39c49765fdf9d94ull, 0xed5a7e85fda0b80bull,
+    0x8e41ade9fbebc27dull, 0x14588f13be847307ull, 0xb1d219647ae6b31cull, 0x596eb2d8ae258fc8ull,
+    0xde469fbd99a05fe3ull, 0x6fca5f8ed9aef3bbull, 0x8aec23d680043beeull, 0x25de7bb9480d5854ull,
+    0xada72ccc20054ae9ull, 0xaf561aa79a10ae6aull, 0xd910f7ff28069da4ull, 0x1b2ba1518094da04ull,
+    0x87aa9aff79042286ull, 0x90fb44d2f05d0842ull, 0xa99541bf57452b28ull, 0x353a1607ac744a53ull,
+    0xd3fa922f2d1675f2ull, 0x42889b8997915ce8ull, 0x847c9b5d7c2e09b7ull, 0x69956135febada11ull,
+    0xa59bc234db398c25ull, 0x43fab9837e699095ull, 0xcf02b2c21207ef2eull, 0x94f967e45e03f4bbull,
+    0x8161afb94b44f57dull, 0x1d1be0eebac278f5ull, 0xa1ba1ba79e1632dcull, 0x6462d92a69731732ull,
+    0xca28a291859bbf93ull, 0x7d7b8f7503cfdcfeull, 0xfcb2cb35e702af78ull, 0x5cda735244c3d43eull,
+    0x9defbf01b061adabull, 0x3a0888136afa64a7ull, 0xc56baec21c7a1916ull, 0x088aaa1845b8fdd0ull,
+    0xf6c69a72a3989f5bull, 0x8aad549e57273d45ull, 0x9a3c2087a63f6399ull, 0x36ac54e2f678864bull,
+    0xc0cb28a98fcf3c7full, 0x84576a1bb416a7ddull, 0xf0fdf2d3f3c30b9full, 0x656d44a2a11c51d5ull,
+    0x969eb7c47859e743ull, 0x9f644ae5a4b1b325ull, 0xbc4665b596706114ull, 0x873d5d9f0dde1feeull,
+    0xeb57ff22fc0c7959ull, 0xa90cb506d155a7eaull, 0x9316ff75dd87cbd8ull, 0x09a7f12442d588f2ull,
+    0xb7dcbf5354e9beceull, 0x0c11ed6d538aeb2full, 0xe5d3ef282a242e81ull, 0x8f1668c8a86da5faull,
+    0x8fa475791a569d10ull, 0xf96e017d694487bcull, 0xb38d92d760ec4455ull, 0x37c981dcc395a9acull,
+    0xe070f78d3927556aull, 0x85bbe253f47b1417ull, 0x8c469ab843b89562ull, 0x93956d7478ccec8eull,
+    0xaf58416654a6babbull, 0x387ac8d1970027b2ull, 0xdb2e51bfe9d0696aull, 0x06997b05fcc0319eull,
+    0x88fcf317f22241e2ull, 0x441fece3bdf81f03ull, 0xab3c2fddeeaad25aull, 0xd527e81cad7626c3ull,
+    0xd60b3bd56a5586f1ull, 0x8a71e223d8d3b074ull, 0x85c7056562757456ull, 0xf6872d5667844e49ull,
+    0xa738c6bebb12d16cull, 0xb428f8ac016561dbull, 0xd106f86e69d785c7ull, 0xe13336d701beba52ull,
+    0x82a45b450226b39cull, 0xecc0024661173473ull, 0xa34d721642b06084ull, 0x27f002d7f95d0190ull,
+    0xcc20ce9bd35c78a5ull, 0x31ec038df7b441f4ull, 0xff290242c83396ceull, 0x7e67047175a15271ull,
+    0x9f79a169bd203e41ull, 0x0f0062c6e984d386ull, 0xc75809c42c684dd1ull, 0x52c07b78a3e60868ull,
+    0xf92e0c3537826145ull, 0xa7709a56ccdf8a82ull, 0x9bbcc7a142b17ccbull, 0x88a66076400bb691ull,
+    0xc2abf989935ddbfeull, 0x6acff893d00ea435ull, 0xf356f7ebf83552feull, 0x0583f6b8c4124d43ull,
+    0x98165af37b2153deull, 0xc3727a337a8b704aull, 0xbe1bf1b059e9a8d6ull, 0x744f18c0592e4c5cull,
+    0xeda2ee1c7064130cull, 0x1162def06f79df73ull, 0x9485d4d1c63e8be7ull, 0x8addcb5645ac2ba8ull,
+    0xb9a74a0637ce2ee1ull, 0x6d953e2bd7173692ull, 0xe8111c87c5c1ba99ull, 0xc8fa8db6ccdd0437ull,
+    0x910ab1d4db9914a0ull, 0x1d9c9892400a22a2ull, 0xb54d5e4a127f59c8ull, 0x2503beb6d00cab4bull,
+    0xe2a0b5dc971f303aull, 0x2e44ae64840fd61dull, 0x8da471a9de737e24ull, 0x5ceaecfed289e5d2ull,
+    0xb10d8e1456105dadull, 0x7425a83e872c5f47ull, 0xdd50f1996b947518ull, 0xd12f124e28f77719ull,
+    0x8a5296ffe33cc92full, 0x82bd6b70d99aaa6full, 0xace73cbfdc0bfb7bull, 0x636cc64d1001550bull,
+    0xd8210befd30efa5aull, 0x3c47f7e05401aa4eull, 0x8714a775e3e95c78ull, 0x65acfaec34810a71ull,
+    0xa8d9d1535ce3b396ull, 0x7f1839a741a14d0dull, 0xd31045a8341ca07cull, 0x1ede48111209a050ull,
+    0x83ea2b892091e44dull, 0x934aed0aab460432ull, 0xa4e4b66b68b65d60ull, 0xf81da84d5617853full,
+    0xce1de40642e3f4b9ull, 0x36251260ab9d668eull, 0x80d2ae83e9ce78f3ull, 0xc1d72b7c6b426019ull,
+    0xa1075a24e4421730ull, 0xb24cf65b8612f81full, 0xc94930ae1d529cfcull, 0xdee033f26797b627ull,
+    0xfb9b7cd9a4a7443cull, 0x169840ef017da3b1ull, 0x9d412e0806e88aa5ull, 0x8e1f289560ee864eull,
+    0xc491798a08a2ad4eull, 0xf1a6f2bab92a27e2ull, 0xf5b5d7ec8acb58a2ull, 0xae10af696774b1dbull,
+    0x9991a6f3d6bf1765ull, 0xacca6da1e0a8ef29ull, 0xbff610b0cc6edd3full, 0x17fd090a58d32af3ull,
+    0xeff394dcff8a948eull, 0xddfc4b4cef07f5b0ull, 0x95f83d0a1fb69cd9ull, 0x4abdaf101564f98eull,
+    0xbb764c4ca7a4440full, 0x9d6d1ad41abe37f1ull, 0xea53df5fd18d5513ull, 0x84c86189216dc5edull,
+    0x92746b9be2f8552cull, 0x32fd3cf5b4e49bb4ull, 0xb7118682dbb66a77ull, 0x3fbc8c33221dc2a1ull,
+    0xe4d5e82392a40515ull, 0x0fabaf3feaa5334aull, 0x8f05b1163ba6832dull, 0x29cb4d87f2a7400eull,
+    0xb2c71d5bca9023f8ull, 0x743e20e9ef511012ull, 0xdf78e4b2bd342cf6ull, 0x914da9246b255416ull,
+    0x8bab8eefb6409c1aull, 0x1ad089b6c2f7548eull, 0xae9672aba3d0c320ull, 0xa184ac2473b529b1ull,
+    0xda3c0f568cc4f3e8ull, 0xc9e5d72d90a2741eull, 0x8865899617fb1871ull, 0x7e2fa67c7a658892ull,
+    0xaa7eebfb9df9de8dull, 0xddbb901b98feeab7ull, 0xd51ea6fa85785631ull, 0x552a74227f3ea565ull,
+    0x8533285c936b35deull, 0xd53a88958f87275full, 0xa67ff273b8460356ull, 0x8a892abaf368f137ull,
+    0xd01fef10a657842cull, 0x2d2b7569b0432d85ull, 0x8213f56a67f6b29bull, 0x9c3b29620e29fc73ull,
+    0xa298f2c501f45f42ull, 0x8349f3ba91b47b8full, 0xcb3f2f7642717713ull, 0x241c70a936219a73ull,
+    0xfe0efb53d30dd4d7ull, 0xed238cd383aa0110ull, 0x9ec95d1463e8a506ull, 0xf4363804324a40aaull,
+    0xc67bb4597ce2ce48ull, 0xb143c6053edcd0d5ull, 0xf81aa16fdc1b81daull, 0xdd94b7868e94050aull,
+    0x9b10a4e5e9913128ull, 0xca7cf2b4191c8326ull, 0xc1d4ce1f63f57d72ull, 0xfd1c2f611f63a3f0ull,
+    0xf24a01a73cf2dccfull, 0xbc633b39673c8cecull, 0x976e41088617ca01ull, 0xd5be0503e085d813ull,
+    0xbd49d14aa79dbc82ull, 0x4b2d8644d8a74e18ull, 0xec9c459d51852ba2ull, 0xddf8e7d60ed1219eull,
+    0x93e1ab8252f33b45ull, 0xcabb90e5c942b503ull, 0xb8da1662e7b00a17ull, 0x3d6a751f3b936243ull,
+    0xe7109bfba19c0c9dull, 0x0cc512670a783ad4ull, 0x906a617d450187e2ull, 0x27fb2b80668b24c5ull,
+    0xb484f9dc9641e9daull, 0xb1f9f660802dedf6ull, 0xe1a63853bbd26451ull, 0x5e7873f8a0396973ull,
+    0x8d07e33455637eb2ull, 0xdb0b487b6423e1e8ull, 0xb049dc016abc5e5full, 0x91ce1a9a3d2cda62ull,
+    0xdc5c5301c56b75f7ull, 0x7641a140cc7810fbull, 0x89b9b3e11b6329baull, 0xa9e904c87fcb0a9dull,
+    0xac2820d9623bf429ull, 0x546345fa9fbdcd44ull, 0xd732290fbacaf133ull, 0xa97c177947ad4095ull,
+    0x867f59a9d4bed6c0ull, 0x49ed8eabcccc485dull, 0xa81f301449ee8c70ull, 0x5c68f256bfff5a74ull,
+    0xd226fc195c6a2f8cull, 0x73832eec6fff3111ull, 0x83585d8fd9c25db7ull, 0xc831fd53c5ff7eabull,
+    0xa42e74f3d032f525ull, 0xba3e7ca8b77f5e55ull, 0xcd3a1230c43fb26full, 0x28ce1bd2e55f35ebull,
+    0x80444b5e7aa7cf85ull, 0x7980d163cf5b81b3ull, 0xa0555e361951c366ull, 0xd7e105bcc332621full,
+    0xc86ab5c39fa63440ull, 0x8dd9472bf3fefaa7ull, 0xfa856334878fc150ull, 0xb14f98f6f0feb951ull,
+    0x9c935e00d4b9d8d2ull, 0x6ed1bf9a569f33d3ull, 0xc3b8358109e84f07ull, 0x0a862f80ec4700c8ull,
+    0xf4a642e14c6262c8ull, 0xcd27bb612758c0faull, 0x98e7e9cccfbd7dbdull, 0x8038d51cb897789cull,
+    0xbf21e44003acdd2cull, 0xe0470a63e6bd56c3ull, 0xeeea5d5004981478ull, 0x1858ccfce06cac74ull,
+    0x95527a5202df0ccbull, 0x0f37801e0c43ebc8ull, 0xbaa718e68396cffdull, 0xd30560258f54e6baull,
+    0xe950df20247c83fdull, 0x47c6b82ef32a2069ull, 0x91d28b7416cdd27eull, 0x4cdc331d57fa5441ull,
+    0xb6472e511c81471dull, 0xe0133fe4adf8e952ull, 0xe3d8f9e563a198e5ull, 0x58180fddd97723a6ull,
+    0x8e679c2f5e44ff8full, 0x570f09eaa7ea7648ull, 0xb201833b35d63f73ull, 0x2cd2cc6551e513daull,
+    0xde81e40a034bcf4full, 0xf8077f7ea65e58d1ull, 0x8b112e86420f6191ull, 0xfb04afaf27faf782ull,
+    0xadd57a27d29339f6ull, 0x79c5db9af1f9b563ull, 0xd94ad8b1c7380874ull, 0x18375281ae7822bcull,
+    0x87cec76f1c830548ull, 0x8f2293910d0b15b5ull, 0xa9c2794ae3a3c69aull, 0xb2eb3875504ddb22ull,
+    0xd433179d9c8cb841ull, 0x5fa60692a46151ebull, 0x849feec281d7f328ull, 0xdbc7c41ba6bcd333ull,
+    0xa5c7ea73224deff3ull, 0x12b9b522906c0800ull, 0xcf39e50feae16befull, 0xd768226b34870a00ull,
+    0x81842f29f2cce375ull, 0xe6a1158300d46640ull, 0xa1e53af46f801c53ull, 0x60495ae3c1097fd0ull,
+    0xca5e89b18b602368ull, 0x385bb19cb14bdfc4ull, 0xfcf62c1dee382c42ull, 0x46729e03dd9ed7b5ull,
+    0x9e19db92b4e31ba9ull, 0x6c07a2c26a8346d1ull, 0xc5a05277621be293ull, 0xc7098b7305241885ull,
+    0xf70867153aa2db38ull, 0xb8cbee4fc66d1ea7ull,
+};
+
+// Eisel-Lemire: w * 10^q as a double, returns the biased exponent and 52 bit
+// mantissa. Always correct when w is exact, see Mushtak & Lemire 2023.
+void _eisel_lemire(s64 q, u64 w, u64 *mantissa, s32 *power2)
+{
+    *mantissa = 0;
+    *power2 = 0;
+    if (w == 0 || q < POW5_SMALLEST) return;
+    if (q > 308) { *power2 = 0x7ff; return; } // w >= 1 so this is past DBL_MAX
+
+    int lz = __builtin_clzll(w);
+    w <<= lz;
+    // w * 5^q, the second 64 bits of the power are only needed when the low
+    // bits we're about to throw away are all ones (carry could ripple up)
+    const u64 *pow5 = &_pow5_128[2 * (q - POW5_SMALLEST)];
+    u64 lo = w, hi = pow5[0];
+    _wymum(&lo, &hi);
+    u64 precision_mask = U64_MAX >> 55;
+    if ((hi & precision_mask) == precision_mask) {
+        u64 lo2 = w, hi2 = pow5[1];
+        _wymum(&lo2, &hi2);
+        lo += hi2;
+        hi += hi2 > lo;
+    }
+
+    int upperbit = (int)(hi >> 63);
+    int shift = upperbit + 64 - 52 - 3;
+    u64 m = hi >> shift;
+    // floor(log2(10^q)) + 63
+    s32 p2 = (s32)((((152170 + 65536) * q) >> 16) + 63 + upperbit - lz + 1023);
+    if (p2 <= 0) {
+        // subnormal
+        if (-p2 + 1 >= 64) return;
+        m >>= -p2 + 1;
+        m += m & 1;
+        m >>= 1;
+        *mantissa = m & ((1ull << 52) - 1);
+        *power2 = m < (1ull << 52) ? 0 : 1;
+        return;
+    }
+    // exactly halfway between two doubles, round to even instead of up
+    if (lo <= 1 && q >= -4 && q <= 23 && (m & 3) == 1 && (m << shift) == hi) m &= ~1ull;
+    m += m & 1;
+    m >>= 1;
+    if (m >= (2ull << 52)) {
+        m = 1ull << 52;
+        p2++;
+    }
+    m &= ~(1ull << 52);
+    if (p2 >= 0x7ff) { p2 = 0x7ff; m = 0; }
+    *mantissa = m;
+    *power2 = p2;
+}
+
+bool _parse_f64_round_up(const char *p, size_t int_start, size_t int_len, size_t frac_start, size_t frac_len,
+                         s64 exp_number, u64 mantissa, s32 power2);
+
+size_t string_parse_f64(const string source, double *out)
+{
+    const char *p = source.data;
+    size_t len = source.len, i = 0;
+    bool negative = false;
+    if (i < len && (p[i] == '-' || p[i] == '+')) negative = p[i++] == '-';
+
+    // inf, infinity, nan
+    string rest = { .data = (char *)&p[i], .len = len - i };
+    if (string_has_prefix_nocase(rest, cstrlen("nan"))) {
+        *out = negative ? -__builtin_nan("") : __builtin_nan("");
+        return i + 3;
+    }
+    if (string_has_prefix_nocase(rest, cstrlen("inf"))) {
+        *out = negative ? -__builtin_inf() : __builtin_inf();
+        return i + (string_has_prefix_nocase(rest, cstrlen("infinity")) ? 8 : 3);
+    }
+
+    u64 w = 0;
+    size_t int_start = i;
+    size_t int_len = _parse_digits(&p[i], len - i, &w);
+    i += int_len;
+    size_t frac_start = i, frac_len = 0;
+    s64 exponent = 0;
+    if (i < len && p[i] == '.') {
+        frac_start = ++i;
+        frac_len = _parse_digits(&p[i], len - i, &w);
+        i += frac_len;
+        exponent = -(s64)frac_len;
+    }
+    if (int_len + frac_len == 0) return 0;
+
+    s64 exp_number = 0;
+    if (i < len && (p[i] == 'e' || p[i] == 'E')) {
+        size_t e = i + 1;
+        bool exp_negative = false;
+        if (e < len && (p[e] == '-' || p[e] == '+')) exp_negative = p[e++] == '-';
+        if (e < len && (u8)(p[e] - '0') < 10) {
+            for (; e < len && (u8)(p[e] - '0') < 10; e++) {
+                if (exp_number < 0x10000000) exp_number = exp_number * 10 + (p[e] - '0');
+            }
+            if (exp_negative) exp_number = -exp_number;
+            exponent += exp_number;
+            i = e;
+        }
+        // otherwise 'e' isn't part of the number
+    }
+
+    // More than 19 digits, w wrapped. Leading zeros don't count, if there really are
+    // too many take the first 19 and check that the rest can't change the rounding.
+    bool truncated = false;
+    size_t digits = int_len + frac_len;
+    if (digits > 19) {
+        for (size_t j = int_start; j < i && (p[j] == '0' || p[j] == '.'); j++) digits -= p[j] == '0';
+        if (digits > 19) {
+            truncated = true;
+            w = 0;
+            size_t j = int_start;
+            for (; w < 1000000000000000000ull && j < int_start + int_len; j++) w = w * 10 + (p[j] - '0');
+            if (w >= 1000000000000000000ull) {
+                exponent = (s64)(int_start + int_len - j) + exp_number;
+            } else {
+                for (j = frac_start; w < 1000000000000000000ull && j < frac_start + frac_len; j++) w = w * 10 + (p[j] - '0');
+                exponent = (s64)frac_start - (s64)j + exp_number;
+            }
+        }
+    }
+
+    // Clinger's fast path, both w and 10^exponent are exact doubles so one rounding
+    if (!truncated && exponent >= -22 && exponent <= 22 && w <= (1ull << 53)) {
+        static const double powers[] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+        };
+        double d = (double)w;
+        d = exponent < 0 ? d / powers[-exponent] : d * powers[exponent];
+        *out = negative ? -d : d;
+        return i;
+    }
+
+    u64 mantissa;
+    s32 power2;
+    _eisel_lemire(exponent, w, &mantissa, &power2);
+    if (truncated) {
+        u64 mantissa_up;
+        s32 power2_up;
+        _eisel_lemire(exponent, w + 1, &mantissa_up, &power2_up);
+        // the digits we dropped decide the rounding, which is rare enough to do the slow way
+        if ((mantissa != mantissa_up || power2 != power2_up) &&
+            _parse_f64_round_up(p, int_start, int_len, frac_start, frac_len, exp_number, mantissa, power2)) {
+            mantissa = mantissa_up;
+            power2   = power2_up;
+        }
+    }
+    u64 bits = mantissa | (u64)power2 << 52 | (u64)negative << 63;
+    __builtin_memcpy(out, &bits, sizeof(*out));
+    return i;
+}
+
+// Better Printing!
+// @Incomplete - basic implementation only atm, we should be writing to buffers to be better practice
+string pct = {
+    .data = "%",
+    .len  = 1,
+};
+
+/*
+ * Syntax (after % for customising), types come from the args so everything is optional
+ *   %[flags][width][.precision][length][conversion]
+    -  = Left-align
+    +  = Always show sign (ignored for strings)
+   ' ' = Space if positive (ignored for strings)
+    0  = Zero-pad (ignored for strings)
+    #  = Alternate form (0x, 0b, 0 prefixes)
+    U  = Uppercase (strings, hex digits, inf/nan/e)
+    width:
+        Minimum field width, up to FORMAT_WIDTH_MAX.
+            printf("%5d", 42);   // "   42"
+            printf("%-5d", 42);  // "42   "
+        Dynamic width (from the arg before the value, negative means left-align):
+            printf("%*d", 5, 42);
+    precision:
+        For integers
+            Minimum number of digits:
+            printf("%.5d", 42);  // 00042
+        For floats
+            Digits after decimal:
+            printf("%.3f", 3.14159); // 3.142
+            Significant digits for %g:
+            printf("%.3g", 3.14159); // 3.14
+        For strings
+            Maximum characters:
+            printf("%.4s", "abcdef"); // abcd
+        Dynamic precision:
+            printf("%.*f", 2, 3.14159);
+    length:
+        hh h l ll L z j t q are skipped, we already know the size
+    conversion:
+        d i u s g = nothing extra, just ends the spec (a float's shortest digits)
+        c         = integers as a char (and d prints a char as a number)
+        f F       = floats with 6 decimals unless there's a precision
+        e E       = d.dddde+XX with 6 decimals unless there's a precision
+        g G       = with a precision it's printf's %g, that many significant digits
+        a A n     = not done, with flags or a size the spec is left in as text
+        x X o b   = hex, HEX, octal, binary
+        p         = hex with 0x
+ * A space is also how most placeholders end ("got % items"), so a lone ' ' flag
+ * only counts when something follows it: "% d" and "% 5" are specs, "% of" isn't.
+*/
+
+#ifdef _WIN32
+#if defined(_MSC_VER)
+#  define DLL_IMPORT __declspec(dllimport)
+#elif defined(__GNUC__)
+#  define DLL_IMPORT __attribute__((dllimport))
+#else
+#  define DLL_IMPORT
+#endif
+
+DLL_IMPORT void* __stdcall GetStdHandle(unsigned long);
+DLL_IMPORT int   __stdcall WriteFile(
+    void* h,
+    const void* buf,
+    unsigned long len,
+    unsigned long* written,
+    void* overlapped
+);
+
+#define WIN_STDIN  ((unsigned long)-10)
+#define WIN_STDOUT ((unsigned long)-11)
+#define WIN_STDERR ((unsigned long)-12)
+void *stdio_handles[3] = {0}; // index into to get handle then cast depending on system
+struct iovec {
+    void  *iov_base;
+    size_t iov_len;
+};
+#elif defined(__linux__) || defined(__APPLE__) || defined(__unix__)
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+void *stdio_handles[3] = { (void *)0, (void *)1, (void *)2 }; // fds
+#else
+#error Unsupported OS TODO!!!
+#endif // _WIN32
+
+void *_stdio_handle(int stream)
+{
+#ifdef _WIN32
+    if (!stdio_handles[stream]) {
+        stdio_handles[stream] = GetStdHandle(stream == STDIN ? WIN_STDIN : stream == STDOUT ? WIN_STDOUT : WIN_STDERR);
+    }
+#endif
+    return stdio_handles[stream];
+}
+
+// Writes all of it unless the OS gives up on us, returns how much made it
+size_t __write(void *dest, const char *data, size_t len)
+{
+    size_t written = 0;
+#ifdef _WIN32
+    while (written < len) {
+        unsigned long chunk = len - written > 0x40000000 ? 0x40000000 : (unsigned long)(len - written);
+        unsigned long n = 0;
+        if (!WriteFile(dest, &data[written], chunk, &n, NULL) || !n) break;
+        written += n;
+    }
+#else
+    int fd = (int)(intptr_t)dest;
+    while (written < len) {
+        ssize_t n = write(fd, &data[written], len - written);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break; // @Incomplete we don't tell anyone about EPIPE/ENOSPC etc
+        written += (size_t)n;
+    }
+#endif
+    return written;
+}
+
+// Like __write for a list of buffers, in as few syscalls as the OS lets us.
+// Modifies iov as it goes.
+size_t __writev(void *dest, struct iovec *iov, int count)
+{
+    size_t written = 0;
+#ifdef _WIN32
+    for (int i = 0; i < count; i++) written += __write(dest, (const char *)iov[i].iov_base, iov[i].iov_len);
+#else
+    int fd = (int)(intptr_t)dest;
+    while (count > 0) {
+        ssize_t n = writev(fd, iov, count);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        written += (size_t)n;
+        // short write, skip what went out and go again
+        while (count > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+#endif
+    return written;
+}
+
+string __write_string(void *dest, string *source)
+{ 
+    __write(dest, source->data, source->len);
+    source->len = 0;
+    return *source;
+}
+
+// Process wide buffers for print_buffered. The lock is a plain spinlock,
+// printing from a lot of threads at once should be using a logger anyway.
+// It's never held across a write in the usual case: a full buffer is swapped
+// for the spare and written out after unlocking, so other prints can carry on
+// filling the new one. Whoever holds writing owns the spare, and holding it
+// for the whole write keeps everything reaching the fd in order.
+typedef struct {
+    char     *data;
+    char     *spare;
+    size_t    len;
+    FlushMode mode;
+    u32       lock;    // data, len and mode
+    u32       writing; // spare, and taken around any write of the stream's text
+} _PrintBuffer;
+_PrintBuffer _print_buffers[3];
+
+void _print_spin_lock(u32 *lock)
+{
+    while (__atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE)) {
+        while (__atomic_load_n(lock, __ATOMIC_RELAXED)) {
+#if JP_SIMD_X86
+            _mm_pause();
+#endif
+        }
+    }
+}
+
+void _print_spin_unlock(u32 *lock)
+{
+    __atomic_store_n(lock, 0, __ATOMIC_RELEASE);
+}
+
+void _print_lock(_PrintBuffer *pb)
+{
+    _print_spin_lock(&pb->lock);
+}
+
+void _print_unlock(_PrintBuffer *pb)
+{
+    _print_spin_unlock(&pb->lock);
+}
+
+// Locks it if the stream is buffered, mode is the only thing looked at unlocked
+bool _print_lock_buffered(_PrintBuffer *pb)
+{
+    if (__atomic_load_n(&pb->mode, __ATOMIC_RELAXED) == FLUSH_NONE) return false;
+    _print_lock(pb);
+    if (pb->data) return true;
+    _print_unlock(pb);
+    return false;
+}
+
+// For when it has to go out before the lock can be let go, after anything
+// already on its way
+void _print_flush_locked(int stream)
+{
+    _PrintBuffer *pb = &_print_buffers[stream];
+    if (!pb->len) return;
+    _print_spin_lock(&pb->writing);
+    __write(_stdio_handle(stream), pb->data, pb->len);
+    _print_spin_unlock(&pb->writing);
+    pb->len = 0;
+}
+
+// Takes the lock held, swaps in the spare and writes the full one unlocked
+void _print_flush_unlock(int stream)
+{
+    _PrintBuffer *pb = &_print_buffers[stream];
+    if (!pb->len) {
+        _print_unlock(pb);
+        return;
+    }
+    _print_spin_lock(&pb->writing);
+    char  *full = pb->data;
+    size_t len  = pb->len;
+    pb->data  = pb->spare;
+    pb->spare = full;
+    pb->len   = 0;
+    _print_unlock(pb);
+    __write(_stdio_handle(stream), full, len);
+    _print_spin_unlock(&pb->writing);
+}
+
+void print_flush(void)
+{
+    for (int stream = STDOUT; stream <= STDERR; stream++) {
+        if (_print_lock_buffered(&_print_buffers[stream])) _print_flush_unlock(stream);
+    }
+}
+
+void print_buffered(int stream, FlushMode mode)
+{
+    assert((stream == STDOUT || stream == STDERR) && "print_buffered: only stdout and stderr can be buffered");
+    static bool registered;
+    if (mode != FLUSH_NONE && !registered) {
+        registered = true;
+        atexit(print_flush);
+    }
+    _PrintBuffer *pb = &_print_buffers[stream];
+    _print_lock(pb);
+    _print_flush_locked(stream);
+    // and wait out any write still using the spare before freeing it
+    _print_spin_lock(&pb->writing);
+    if (mode == FLUSH_NONE) {
+        free(pb->data);
+        free(pb->spare);
+        pb->data  = NULL;
+        pb->spare = NULL;
+    } else if (!pb->data) {
+        pb->data  = (char *)malloc(PRINT_BUFFER_SIZE);
+        pb->spare = (char *)malloc(PRINT_BUFFER_SIZE);
+        assert(pb->data && pb->spare && "We requested more memory but the computer said \"No\"!");
+    }
+    _print_spin_unlock(&pb->writing);
+    __atomic_store_n(&pb->mode, pb->data ? mode : FLUSH_NONE, __ATOMIC_RELAXED);
+    _print_unlock(pb);
+}
+
+// After adding [from, pb->len) to the buffer, unlocks and writes it out if
+// the mode says so
+void _print_added_unlock(int stream, size_t from)
+{
+    _PrintBuffer *pb = &_print_buffers[stream];
+    if (pb->mode == FLUSH_LINE && pb->len > from && _impl_load(_memchr_impl)(&pb->data[from], pb->len - from, '\n') >= 0) {
+        _print_flush_unlock(stream);
+        return;
+    }
+    _print_unlock(pb);
+}
+
+size_t print_write(int stream, const char *data, size_t len)
+{
+    _PrintBuffer *pb = &_print_buffers[stream];
+    if (!_print_lock_buffered(pb)) return __write(_stdio_handle(stream), data, len);
+    if (len >= PRINT_BUFFER_SIZE) {
+        // no point copying something this big, it's going out on its own
+        // right behind what's buffered, so both happen under the lock
+        _print_flush_locked(stream);
+        _print_spin_lock(&pb->writing);
+        len = __write(_stdio_handle(stream), data, len);
+        _print_spin_unlock(&pb->writing);
+        _print_unlock(pb);
+        return len;
+    }
+    while (pb->len + len > PRINT_BUFFER_SIZE) {
+        _print_flush_unlock(stream);
+        _print_lock(pb);
+    }
+    size_t from = pb->len;
+    __builtin_memcpy(&pb->data[pb->len], data, len);
+    pb->len += len;
+    _print_added_unlock(stream, from);
+    return len;
+}
+
+size_t __print(char *data, size_t len) {
+    return print_write(STDOUT, data, len);
+}
+
+// The output side of fprintf_impl. Formatted text goes into buf as usual and
+// T_STRREF args are queued by reference, buf is cut wherever one goes in so
+// everything leaves in order with one writev.
+#define PRINT_IOV_MAX 64
+typedef struct {
+    string       buf;     // first, the T_STRREF formatter gets here from the string * it's given
+    void        *handle;
+    u32         *writing; // the stream's, when buf is its buffer
+    size_t       cut;    // buf bytes before this are already queued
+    int          count;
+    struct iovec iov[PRINT_IOV_MAX];
+} _PrintGather;
+
+// Writes everything queued and the rest of buf, buf is empty after
+void _print_gather_flush(_PrintGather *g)
+{
+    if (g->buf.len > g->cut) g->iov[g->count++] = (struct iovec){ &g->buf.data[g->cut], g->buf.len - g->cut };
+    if (g->writing) _print_spin_lock(g->writing);
+    if (g->count == 1) __write(g->handle, (const char *)g->iov[0].iov_base, g->iov[0].iov_len);
+    else if (g->count) __writev(g->handle, g->iov, g->count);
+    if (g->writing) _print_spin_unlock(g->writing);
+    g->count = 0;
+    g->cut = 0;
+    g->buf.len = 0;
+}
+
+void _print_gather(_PrintGather *g, const char *data, size_t len)
+{
+    if (g->count + 2 > PRINT_IOV_MAX) _print_gather_flush(g);
+    if (g->buf.len > g->cut) {
+        g->iov[g->count++] = (struct iovec){ &g->buf.data[g->cut], g->buf.len - g->cut };
+        g->cut = g->buf.len;
+    }
+    g->iov[g->count++] = (struct iovec){ (void *)data, len };
+}
+
+const char _basesystem[]       = "0123456789abcdefghijklmnopqrstuvwxyz_#";
+const char _basesystem_upper[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ_#";
+
+const char _digit_pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+// [0] is 0 rather than 1 so zero still counts as one digit
+const u64 _pow10_u64[20] = {
+    0, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000,
+    10000000000ull, 100000000000ull, 1000000000000ull, 10000000000000ull, 100000000000000ull,
+    1000000000000000ull, 10000000000000000ull, 100000000000000000ull, 1000000000000000000ull,
+    10000000000000000000ull,
+};
+
+// bit length * log10(2) is either the digit count or one over, one compare fixes it up
+u32 _count_digits10(u64 value)
+{
+    u32 t = ((64 - __builtin_clzll(value | 1)) * 1233) >> 12;
+    return t + 1 - (value < _pow10_u64[t]);
+}
+
+u32 _count_digits(u64 value, u32 base)
+{
+    if (base == 10) return _count_digits10(value);
+    if (!(base & (base - 1))) {
+        u32 shift = __builtin_ctz(base);
+        return (64 - __builtin_clzll(value | 1) + shift - 1) / shift;
+    }
+    u32 n = 1;
+    while (value >= base) { value /= base; n++; }
+    return n;
+}
+
+// 8 digits (value < 10^8) as the ASCII bytes of a u64, first digit first in
+// memory. All the digits are split out at once in lanes of one register:
+// 4+4 digits in 32 bit lanes, then 2 digit lanes, then 1, each step a
+// reciprocal multiply (x * 10486 >> 20 is x / 100 below 10^4, x * 103 >> 10
+// is x / 10 below 100) instead of a divide or a table lookup.
+u64 _digits8(u32 value)
+{
+    u64 x = value / 10000 | (u64)(value % 10000) << 32;
+    u64 hi = ((x * 10486) >> 20) & 0x0000007f0000007full;
+    x = hi | (x - hi * 100) << 16;
+    hi = ((x * 103) >> 10) & 0x000f000f000f000full;
+    x = hi | (x - hi * 10) << 8;
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    x = __builtin_bswap64(x);
+#endif
+    return x | 0x3030303030303030ull;
+}
+
+void _write_8digits(char *p, u32 value)
+{
+    u64 digits = _digits8(value);
+    __builtin_memcpy(p, &digits, 8);
+}
+
+// Writes exactly ndigits (from _count_digits10) straight into place, no reversing.
+// Full 8 digit chunks come off the bottom first so the rest is 32 bit maths.
+void _write_digits10(char *out, u64 value, u32 ndigits)
+{
+    char *p = out + ndigits;
+    while (ndigits > 8) {
+        u64 hi = value / 100000000;
+        p -= 8;
+        _write_8digits(p, (u32)(value - hi * 100000000));
+        ndigits -= 8;
+        value = hi;
+    }
+    u32 v = (u32)value;
+    while (v >= 100) {
+        p -= 2;
+        __builtin_memcpy(p, &_digit_pairs[(v % 100) * 2], 2);
+        v /= 100;
+    }
+    if (v >= 10) {
+        p -= 2;
+        __builtin_memcpy(p, &_digit_pairs[v * 2], 2);
+    } else {
+        *--p = (char)('0' + v);
+    }
+}
+
+u64 _digits8_top(u32 value, u32 ndigits) // just the last ndigits of _digits8
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return _digits8(value) << (8 * (8 - ndigits));
+#else
+    return _digits8(value) >> (8 * (8 - ndigits));
+#endif
+}
+
+#if JP_SIMD_X86 && defined(__SSE2__)
+// SSE2 is baseline on x86_64 so no need to dispatch. Same idea as _digits8
+// with a lane per digit: abcd/efgh go in 16 bit lanes four times over,
+// mulhi by per lane reciprocals gives a, ab, abc, abcd (and e, ef, ...), and
+// subtracting 10x the lane before leaves one digit in each (Wojciech Muła's).
+__m128i _digits8_sse2(u32 value)
+{
+    __m128i v     = _mm_cvtsi32_si128((int)value);
+    __m128i abcd  = _mm_srli_epi64(_mm_mul_epu32(v, _mm_set1_epi32((int)0xd1b71759)), 45);
+    __m128i efgh  = _mm_sub_epi32(v, _mm_mul_epu32(abcd, _mm_set1_epi32(10000)));
+    __m128i both  = _mm_slli_epi64(_mm_unpacklo_epi16(abcd, efgh), 2);
+    both          = _mm_unpacklo_epi16(both, both);
+    both          = _mm_unpacklo_epi32(both, both);
+    __m128i heads = _mm_mulhi_epu16(both, _mm_setr_epi16(8389, 5243, 13108, (short)32768, 8389, 5243, 13108, (short)32768));
+    heads         = _mm_mulhi_epu16(heads, _mm_setr_epi16(1 << 7, 1 << 11, 1 << 13, 1 << 15, 1 << 7, 1 << 11, 1 << 13, 1 << 15));
+    __m128i tens  = _mm_slli_epi64(_mm_mullo_epi16(heads, _mm_set1_epi16(10)), 16);
+    return _mm_sub_epi16(heads, tens);
+}
+
+// value < 10^16 as exactly 16 digits
+void _write_16digits(char *p, u64 value)
+{
+    __m128i hi = _digits8_sse2((u32)(value / 100000000)), lo = _digits8_sse2((u32)(value % 100000000));
+    _mm_storeu_si128((__m128i *)p, _mm_add_epi8(_mm_packus_epi16(hi, lo), _mm_set1_epi8('0')));
+}
+#else
+void _write_16digits(char *p, u64 value)
+{
+    _write_8digits(p, (u32)(value / 100000000));
+    _write_8digits(p + 8, (u32)(value % 100000000));
+}
+#endif
+
+// Same digits with the length worked out here, for when out has 20 bytes
+// free however short the number is. Everything goes out as whole 8 and 16
+// byte stores, so the only branch is on more than 16 digits and mixed
+// lengths don't mispredict a per digit pair loop every number.
+u32 _write_u64_dec(char *out, u64 value)
+{
+    u32 n = _count_digits10(value);
+    if (n > 16) {
+        u64 hi = value / 10000000000000000ull;
+        u64 top = _digits8_top((u32)hi, n - 16);
+        __builtin_memcpy(out, &top, 8);
+        _write_16digits(out + n - 16, value - hi * 10000000000000000ull);
+        return n;
+    }
+    // all 16 with leading zeros, then copy from where the real ones start
+    char digits[32] = {0};
+    _write_16digits(digits, value);
+    __builtin_memcpy(out, &digits[16 - n], 16);
+    return n;
+}
+
+void _write_digits(char *out, u64 value, u32 ndigits, u32 base, bool upper)
+{
+    if (base == 10) {
+        _write_digits10(out, value, ndigits);
+        return;
+    }
+    const char *digits = upper ? _basesystem_upper : _basesystem;
+    char *p = out + ndigits;
+    if (!(base & (base - 1))) {
+        u32 shift = __builtin_ctz(base);
+        u64 mask = base - 1;
+        while (p > out) { *--p = digits[value & mask]; value >>= shift; }
+    } else {
+        while (p > out) { *--p = digits[value % base]; value /= base; }
+    }
+}
+
+size_t format_int(char *out, u64 magnitude, bool negative, FormatSpec spec)
+{
+    u32 base = spec.base ? spec.base : 10;
+    assert(base >= 2 && base < sizeof(_basesystem) && "format_int: unsupported base");
+    bool upper = spec.flags & FMT_UPPER;
+
+    // printf: an explicit precision of 0 prints nothing for 0
+    u32 ndigits = (magnitude == 0 && spec.precision == 0) ? 0 : _count_digits(magnitude, base);
+    u32 zeros = spec.precision > (s32)ndigits ? (u32)spec.precision - ndigits : 0;
+
+    char sign = negative ? '-' : (spec.flags & FMT_SIGN) ? '+' : (spec.flags & FMT_SPACE) ? ' ' : 0;
+    char prefix[2] = { '0', 0 };
+    u32 prefix_len = 0;
+    if (spec.flags & FMT_ALT) {
+        // same rules as printf, no 0x for zero and octal only needs a leading 0
+        if      (base == 16 && magnitude) { prefix[1] = upper ? 'X' : 'x'; prefix_len = 2; }
+        else if (base == 2  && magnitude) { prefix[1] = upper ? 'B' : 'b'; prefix_len = 2; }
+        else if (base == 8 && !zeros && !(magnitude == 0 && ndigits)) prefix_len = 1;
+    }
+
+    u32 body = (sign != 0) + prefix_len + zeros + ndigits;
+    u32 pad = spec.width > body ? spec.width - body : 0;
+    char *p = out;
+    if (!(spec.flags & FMT_LEFT)) {
+        if ((spec.flags & FMT_ZERO) && spec.precision < 0) {
+            zeros += pad; // zeros go between the sign/prefix and the digits
+        } else {
+            __builtin_memset(p, ' ', pad);
+            p += pad;
+        }
+    }
+    if (sign) *p++ = sign;
+    __builtin_memcpy(p, prefix, prefix_len);
+    p += prefix_len;
+    __builtin_memset(p, '0', zeros);
+    p += zeros;
+    // the 20 bytes _write_u64_dec can write for short numbers fit in FORMAT_INT_MAX
+    if (base == 10 && ndigits) _write_u64_dec(p, magnitude);
+    else if (ndigits)          _write_digits(p, magnitude, ndigits, base, upper);
+    p += ndigits;
+    if (spec.flags & FMT_LEFT) {
+        __builtin_memset(p, ' ', pad);
+        p += pad;
+    }
+    return (size_t)(p - out);
+}
+
+bool _spec_is_plain(FormatSpec spec)
+{
+    return !spec.width && !spec.flags && !spec.base && spec.precision < 0;
+}
+
+// Like format_int these need FORMAT_INT_MAX + width + precision bytes free
+void format_u64(string *buf, u64 value, FormatSpec spec)
+{
+    if (!_spec_is_plain(spec)) {
+        buf->len += format_int(&buf->data[buf->len], value, false, spec);
+        return;
+    }
+    buf->len += _write_u64_dec(&buf->data[buf->len], value);
+}
+
+void format_s64(string *buf, s64 value, FormatSpec spec)
+{
+    if (value >= 0) {
+        format_u64(buf, (u64)value, spec);
+        return;
+    }
+    // negate as unsigned so S64_MIN doesn't overflow
+    if (!_spec_is_plain(spec)) {
+        buf->len += format_int(&buf->data[buf->len], 0 - (u64)value, true, spec);
+        return;
+    }
+    buf->data[buf->len++] = '-';
+    format_u64(buf, 0 - (u64)value, spec);
+}
+
+#define MAX_DBL_DP 17 // significant digits to round trip any double
+// @Incomplete this is only the case on x64 on 128 bit we need to do 36 for long double
+#define MAX_LDBL_DP 21
+
+
+// Floats
+// Shortest round trip output is Schubfach (Giulietti 2020), the table is the
+// parser's powers of five bumped to ceilings. Fixed precision is exact, big
+// integer maths when the u128 shortcut can't hold the value.
+
+// 10^k as a 128 bit significand rounded up (floor + 1), top bit set
+void _pow10_ceil128(s32 k, u64 *hi, u64 *lo)
+{
+    const u64 *p = &_pow5_128[2 * (k - POW5_SMALLEST)];
+    *hi = p[0];
+    *lo = p[1];
+    // the table is truncated for these and already floor + 1 for -27 <= k < 0
+    if (k >= 0 || k < -27) {
+        *lo += 1;
+        *hi += *lo == 0;
+    }
+}
+
+// floor(g * cp / 2^128) with the lowest bit set if anything was cut off
+u64 _round_to_odd(u64 g_hi, u64 g_lo, u64 cp)
+{
+    u64 x_lo = g_lo, x_hi = cp;
+    _wymum(&x_lo, &x_hi);
+    u64 y_lo = g_hi, y_hi = cp;
+    _wymum(&y_lo, &y_hi);
+    y_lo += x_hi;
+    y_hi += y_lo < x_hi;
+    return y_hi | (y_lo > 1);
+}
+
+// Shortest decimal digits * 10^exp10 that reads back as the same (finite, nonzero) double
+u64 _f64_shortest(u64 bits, s32 *exp10)
+{
+    u64 fraction = bits & ((1ull << 52) - 1);
+    s32 biased   = (s32)((bits >> 52) & 0x7ff);
+    u64 c;
+    s32 q;
+    if (biased) {
+        c = fraction | (1ull << 52);
+        q = biased - 1075;
+        // small integers are exact
+        if (q <= 0 && -q < 53 && !(c & ((1ull << -q) - 1))) {
+            *exp10 = 0;
+            return c >> -q;
+        }
+    } else {
+        c = fraction;
+        q = 1 - 1075;
+    }
+
+    bool even = !(c & 1);
+    bool lower_closer = fraction == 0 && biased > 1; // at a power of 2 the gap below is half size
+    u64 cbl = 4 * c - 2 + lower_closer;
+    u64 cb  = 4 * c;
+    u64 cbr = 4 * c + 2;
+
+    // floor(log10(2^q)), or of 3/4 * 2^q when the lower gap is smaller
+    s32 k = (q * 1262611 - (lower_closer ? 524031 : 0)) >> 22;
+    s32 h = q + ((-k * 1741647) >> 19) + 1;
+    u64 g_hi, g_lo;
+    _pow10_ceil128(-k, &g_hi, &g_lo);
+    u64 vbl = _round_to_odd(g_hi, g_lo, cbl << h);
+    u64 vb  = _round_to_odd(g_hi, g_lo, cb  << h);
+    u64 vbr = _round_to_odd(g_hi, g_lo, cbr << h);
+    u64 lower = vbl + !even;
+    u64 upper = vbr - !even;
+
+    u64 s = vb / 4;
+    if (s >= 10) {
+        // one digit less if only one of the two candidates is in range
+        u64 sp = s / 10;
+        bool up_inside = lower <= 40 * sp;
+        bool wp_inside = 40 * sp + 40 <= upper;
+        if (up_inside != wp_inside) {
+            *exp10 = k + 1;
+            return sp + wp_inside;
+        }
+    }
+    bool u_inside = lower <= 4 * s;
+    bool w_inside = 4 * s + 4 <= upper;
+    *exp10 = k;
+    if (u_inside != w_inside) return s + w_inside;
+    u64 mid = 4 * s + 2;
+    return s + (vb > mid || (vb == mid && (s & 1)));
+}
+
+// nan, inf, -inf. true if it was one of them
+bool _format_nonfinite(string *buf, u64 bits)
+{
+    if (((bits >> 52) & 0x7ff) != 0x7ff) return false;
+    const char *text = (bits << 12) ? "nan" : (bits >> 63) ? "-inf" : "inf";
+    while (*text) buf->data[buf->len++] = *text++;
+    return true;
+}
+
+// e+05, e-324, returns bytes written
+size_t _format_exponent(char *out, s32 exp10)
+{
+    size_t len = 0;
+    out[len++] = 'e';
+    out[len++] = exp10 < 0 ? '-' : '+';
+    u32 e = exp10 < 0 ? -exp10 : exp10;
+    if (e < 10) out[len++] = '0';
+    u32 en = _count_digits10(e);
+    _write_digits10(&out[len], e, en);
+    return len + en;
+}
+
+// Like %g with 17 significant digits but only as many digits as it takes:
+// 0.1, 420.69, 1e+21, 5e-324
+void _format_f64_shortest(string *buf, double value)
+{
+    u64 bits;
+    __builtin_memcpy(&bits, &value, sizeof(bits));
+    if (_format_nonfinite(buf, bits)) return;
+    if (bits >> 63) buf->data[buf->len++] = '-';
+    if (!(bits << 1)) {
+        buf->data[buf->len++] = '0';
+        return;
+    }
+
+    s32 exp10;
+    u64 digits = _f64_shortest(bits, &exp10);
+    while (digits % 10 == 0) { digits /= 10; exp10++; }
+    u32 n = _count_digits10(digits);
+    s32 point = exp10 + (s32)n - 1; // exponent in scientific notation
+    char *out = &buf->data[buf->len];
+
+    if (point < -4 || point >= MAX_DBL_DP) {
+        // d.ddde+XX
+        _write_digits10(out + 1, digits, n);
+        out[0] = out[1];
+        size_t len = 1;
+        if (n > 1) {
+            out[1] = '.';
+            len = n + 1;
+        }
+        buf->len += len + _format_exponent(&out[len], point);
+    } else if (point >= (s32)n - 1) {
+        // integer, pad the zeros back on
+        _write_digits10(out, digits, n);
+        __builtin_memset(out + n, '0', point - (n - 1));
+        buf->len += point + 1;
+    } else if (point >= 0) {
+        // ddd.ddd
+        _write_digits10(out + 1, digits, n);
+        __builtin_memmove(out, out + 1, point + 1);
+        out[point + 1] = '.';
+        buf->len += n + 1;
+    } else {
+        // 0.000ddd
+        u32 zeros = -point - 1;
+        out[0] = '0';
+        out[1] = '.';
+        __builtin_memset(out + 2, '0', zeros);
+        _write_digits10(out + 2 + zeros, digits, n);
+        buf->len += 2 + zeros + n;
+    }
+}
+
+// Little unsigned big integer, enough for 2^1024 or 2^53 * 10^1074 (subnormal %.1074f)
+typedef struct {
+    u32 limb[120];
+    u32 len;
+} _BigUint;
+
+void _big_mul_small(_BigUint *b, u32 m)
+{
+    u64 carry = 0;
+    for (u32 i = 0; i < b->len; i++) {
+        carry += (u64)b->limb[i] * m;
+        b->limb[i] = (u32)carry;
+        carry >>= 32;
+    }
+    if (carry) b->limb[b->len++] = (u32)carry;
+}
+
+void _big_shl(_BigUint *b, u32 shift)
+{
+    u32 words = shift / 32, bits = shift % 32;
+    if (bits) {
+        b->limb[b->len] = 0;
+        for (u32 i = b->len; i > 0; i--) b->limb[i] = (b->limb[i] << bits) | (b->limb[i - 1] >> (32 - bits));
+        b->limb[0] <<= bits;
+        b->len++;
+    }
+    if (words) {
+        for (u32 i = b->len; i > 0; i--) b->limb[i - 1 + words] = b->limb[i - 1];
+        __builtin_memset(b->limb, 0, words * sizeof(u32));
+        b->len += words;
+    }
+    while (b->len && !b->limb[b->len - 1]) b->len--;
+}
+
+// b = b * m + add
+void _big_mul_add(_BigUint *b, u32 m, u32 add)
+{
+    u64 carry = add;
+    for (u32 i = 0; i < b->len; i++) {
+        carry += (u64)b->limb[i] * m;
+        b->limb[i] = (u32)carry;
+        carry >>= 32;
+    }
+    if (carry) b->limb[b->len++] = (u32)carry;
+}
+
+void _big_mul_pow5(_BigUint *b, u32 n)
+{
+    for (; n >= 13; n -= 13) _big_mul_small(b, 1220703125u);
+    u32 pow5 = 1;
+    while (n--) pow5 *= 5;
+    if (pow5 > 1) _big_mul_small(b, pow5);
+}
+
+int _big_cmp(const _BigUint *a, const _BigUint *b)
+{
+    if (a->len != b->len) return a->len < b->len ? -1 : 1;
+    for (u32 i = a->len; i > 0; i--) {
+        if (a->limb[i - 1] != b->limb[i - 1]) return a->limb[i - 1] < b->limb[i - 1] ? -1 : 1;
+    }
+    return 0;
+}
+
+bool _big_bit(const _BigUint *b, u32 bit)
+{
+    return bit / 32 < b->len && ((b->limb[bit / 32] >> (bit % 32)) & 1);
+}
+
+// b >>= shift rounding half to even
+void _big_shr_round(_BigUint *b, u32 shift)
+{
+    if (shift == 0) return;
+    bool half = _big_bit(b, shift - 1), sticky = false;
+    for (u32 i = 0; !sticky && i < (shift - 1) / 32 && i < b->len; i++) sticky = b->limb[i] != 0;
+    if ((shift - 1) % 32 && (shift - 1) / 32 < b->len) {
+        sticky |= (b->limb[(shift - 1) / 32] & ((1u << ((shift - 1) % 32)) - 1)) != 0;
+    }
+    u32 words = shift / 32, bits = shift % 32;
+    if (words >= b->len) {
+        b->len = 0;
+    } else {
+        for (u32 i = 0; i + words < b->len; i++) {
+            u32 next = i + words + 1 < b->len ? b->limb[i + words + 1] : 0;
+            b->limb[i] = bits ? (b->limb[i + words] >> bits) | (next << (32 - bits)) : b->limb[i + words];
+        }
+        b->len -= words;
+        while (b->len && !b->limb[b->len - 1]) b->len--;
+    }
+    if (half && (sticky || (b->len && (b->limb[0] & 1)))) {
+        u32 i = 0;
+        while (i < b->len && ++b->limb[i] == 0) i++;
+        if (i == b->len) b->limb[b->len++] = 1;
+    }
+}
+
+// Writes the decimal digits of b, returns how many
+size_t _big_write_digits(char *out, _BigUint *b)
+{
+    // peel off 9 digits at a time from the bottom, then write them top down
+    u32 chunks[140];
+    u32 nchunks = 0;
+    while (b->len) {
+        u64 rem = 0;
+        for (u32 i = b->len; i > 0; i--) {
+            u64 cur = (rem << 32) | b->limb[i - 1];
+            b->limb[i - 1] = (u32)(cur / 1000000000);
+            rem = cur % 1000000000;
+        }
+        while (b->len && !b->limb[b->len - 1]) b->len--;
+        chunks[nchunks++] = (u32)rem;
+    }
+    if (!nchunks) {
+        out[0] = '0';
+        return 1;
+    }
+    u32 n = _count_digits10(chunks[nchunks - 1]);
+    _write_digits10(out, chunks[nchunks - 1], n);
+    size_t len = n;
+    for (u32 i = nchunks - 1; i > 0; i--) {
+        u32 chunk = chunks[i - 1];
+        out[len] = (char)('0' + chunk / 100000000);
+        _write_8digits(&out[len + 1], chunk % 100000000);
+        len += 9;
+    }
+    return len;
+}
+
+// fast_float's digit comparison for string_parse_f64, when Eisel-Lemire on the
+// first 19 digits lands either side of a rounding boundary. The exact decimal
+// (769 digits is enough, anything past that only matters for being nonzero)
+// is compared with the point halfway between mantissa/power2 and the next
+// double up, both as big integers. True if the next one up is the answer.
+bool _parse_f64_round_up(const char *p, size_t int_start, size_t int_len, size_t frac_start, size_t frac_len,
+                         s64 exp_number, u64 mantissa, s32 power2)
+{
+    _BigUint digits = {0};
+    u32 count = 0, chunk = 0, chunk_len = 0;
+    s64 place = 0; // of the last digit used
+    bool sticky = false;
+    for (size_t j = 0; j < int_len + frac_len; j++) {
+        char c = j < int_len ? p[int_start + j] : p[frac_start + j - int_len];
+        if (count == 769) {
+            sticky |= c != '0';
+            continue;
+        }
+        if (!count && c == '0') continue;
+        chunk = chunk * 10 + (c - '0');
+        count++;
+        place = j < int_len ? (s64)(int_len - 1 - j) : -(s64)(j - int_len + 1);
+        if (++chunk_len == 9) {
+            _big_mul_add(&digits, 1000000000, chunk);
+            chunk = chunk_len = 0;
+        }
+    }
+    if (sticky) {
+        chunk = chunk * 10 + 1;
+        chunk_len++;
+        place--;
+    }
+    if (chunk_len) _big_mul_add(&digits, (u32)_pow10_u64[chunk_len], chunk);
+    s64 k = place + exp_number;
+
+    // halfway is (2m + 1) * 2^(e - 1)
+    u64 m = power2 ? mantissa | (1ull << 52) : mantissa;
+    s64 e = (power2 ? power2 : 1) - 1075;
+    u64 h = 2 * m + 1;
+    _BigUint half = { .limb = { (u32)h, (u32)(h >> 32) }, .len = (h >> 32) ? 2 : 1 };
+    // digits * 10^k against half * 2^(e - 1), as digits * 2^a against half * 2^b
+    s64 a = 0, b = e - 1;
+    if (k >= 0) {
+        _big_mul_pow5(&digits, (u32)k);
+        a = k;
+    } else {
+        _big_mul_pow5(&half, (u32)-k);
+        b -= k;
+    }
+    if (a > b) _big_shl(&digits, (u32)(a - b));
+    else       _big_shl(&half, (u32)(b - a));
+    int order = _big_cmp(&digits, &half);
+    return order > 0 || (order == 0 && (m & 1));
+}
+
+// %.Nf, exact and rounded half to even like glibc. Needs room for 310 + precision bytes.
+void _format_f64_fixed(string *buf, double value, u32 precision)
+{
+    u64 bits;
+    __builtin_memcpy(&bits, &value, sizeof(bits));
+    if (_format_nonfinite(buf, bits)) return;
+    if (bits >> 63) buf->data[buf->len++] = '-';
+
+    // value = m * 2^e exactly
+    u64 m = bits & ((1ull << 52) - 1);
+    s32 biased = (s32)((bits >> 52) & 0x7ff);
+    s32 e = biased ? biased - 1075 : -1074;
+    if (biased) m |= 1ull << 52;
+
+    // m * 2^-s has exactly s decimals, anything asked for past that is zeros
+    u32 exact = e >= 0 ? 0 : (precision < (u32)-e ? precision : (u32)-e);
+    char *out = &buf->data[buf->len];
+    size_t n = 0;
+#if defined(__SIZEOF_INT128__)
+    // m * 10^exact fits in 128 bits for exact <= 19, then shift and round
+    if (exact <= 19 && e <= 10 && e > -117) {
+        __uint128_t x = (__uint128_t)m * (exact ? _pow10_u64[exact] : 1);
+        __uint128_t r;
+        if (e >= 0) {
+            r = x << e;
+        } else {
+            u32 shift = -e;
+            r = x >> shift;
+            __uint128_t rest = x & (((__uint128_t)1 << shift) - 1), half = (__uint128_t)1 << (shift - 1);
+            r += rest > half || (rest == half && (r & 1));
+        }
+        if (r <= U64_MAX) {
+            n = _count_digits10((u64)r);
+            _write_digits10(out, (u64)r, n);
+        }
+    }
+#endif
+    if (!n) {
+        _BigUint b = { .limb = { (u32)m, (u32)(m >> 32) }, .len = (m >> 32) ? 2 : (m ? 1 : 0) };
+        for (u32 i = 0; i < exact; i++) _big_mul_small(&b, 10); // @Speed multiply by 10^9 at a time
+        if (e >= 0) _big_shl(&b, e);
+        else        _big_shr_round(&b, -e);
+        n = _big_write_digits(out, &b);
+    }
+
+    // we have value * 10^exact as digits, put the point in (padding to 0.xxx if needed)
+    if (exact && n <= exact) {
+        size_t pad = exact + 1 - n;
+        __builtin_memmove(out + pad, out, n);
+        __builtin_memset(out, '0', pad);
+        n += pad;
+    }
+    if (precision) {
+        __builtin_memmove(out + n - exact + 1, out + n - exact, exact);
+        out[n - exact] = '.';
+        n++;
+        __builtin_memset(out + n, '0', precision - exact);
+        n += precision - exact;
+    }
+    buf->len += n;
+}
+
+// The exact decimal digits of m * 2^e (m != 0), at most 767 of them. *point is
+// the exponent of the first one in scientific notation.
+u32 _f64_exact_digits(u64 m, s32 e, char *out, s32 *point)
+{
+    _BigUint b = { .limb = { (u32)m, (u32)(m >> 32) }, .len = (m >> 32) ? 2 : 1 };
+    // m * 2^e = m * 5^-e / 10^-e, so it's the digits of m * 5^-e
+    if (e >= 0) _big_shl(&b, e);
+    else        _big_mul_pow5(&b, -e);
+    u32 n = (u32)_big_write_digits(out, &b);
+    *point = (s32)n - 1 + (e < 0 ? e : 0);
+    return n;
+}
+
+// The first count significant digits of a finite nonzero double, rounded half
+// to even on its exact value like glibc. Returns the scientific exponent, which
+// is one more than the exact one when 9.99.. rounds up to 10.0..
+s32 _f64_round_digits(u64 bits, char *out, u32 count)
+{
+    u64 m = bits & ((1ull << 52) - 1);
+    s32 biased = (s32)((bits >> 52) & 0x7ff);
+    if (biased) m |= 1ull << 52;
+    char exact[800];
+    s32 point;
+    u32 n = _f64_exact_digits(m, biased ? biased - 1075 : -1074, exact, &point);
+    if (n <= count) {
+        __builtin_memcpy(out, exact, n);
+        __builtin_memset(out + n, '0', count - n);
+        return point;
+    }
+    __builtin_memcpy(out, exact, count);
+    bool up = exact[count] > '5';
+    if (exact[count] == '5') {
+        up = (out[count - 1] - '0') & 1;
+        for (u32 i = count + 1; !up && i < n; i++) up = exact[i] != '0';
+    }
+    if (!up) return point;
+    u32 i = count;
+    while (i > 0 && out[i - 1] == '9') out[--i] = '0';
+    if (i > 0) {
+        out[i - 1]++;
+        return point;
+    }
+    out[0] = '1';
+    return point + 1;
+}
+
+// %.Ne, or %.Ng when general (precision significant digits, trailing zeros
+// dropped unless alt). Needs room for 10 + precision bytes.
+void _format_f64_exp(string *buf, double value, u32 precision, bool general, bool alt)
+{
+    u64 bits;
+    __builtin_memcpy(&bits, &value, sizeof(bits));
+    if (_format_nonfinite(buf, bits)) return;
+    if (bits >> 63) buf->data[buf->len++] = '-';
+    u32 count = general ? (precision ? precision : 1) : precision + 1;
+    // digits go one along so the first can move in front of the point
+    char *out = &buf->data[buf->len];
+    s32 point = 0;
+    if (bits << 1) point = _f64_round_digits(bits, out + 1, count);
+    else           __builtin_memset(out + 1, '0', count);
+
+    u32 n = count;
+    if (general && !alt) while (n > 1 && out[n] == '0') n--;
+    if (general && point >= -4 && point < (s32)count) {
+        size_t len;
+        if (point >= 0) {
+            // ddd.ddd, all the integer digits are there since point < count
+            __builtin_memmove(out, out + 1, point + 1);
+            len = point + 1;
+            if (n > (u32)point + 1 || alt) {
+                out[len++] = '.';
+                len += n - (point + 1);
+            }
+        } else {
+            // 0.000ddd
+            u32 zeros = -point - 1;
+            __builtin_memmove(out + 2 + zeros, out + 1, n);
+            out[0] = '0';
+            out[1] = '.';
+            __builtin_memset(out + 2, '0', zeros);
+            len = 2 + zeros + n;
+        }
+        buf->len += len;
+        return;
+    }
+    // d.ddde+XX
+    out[0] = out[1];
+    size_t len = 1;
+    if (n > 1 || alt) {
+        out[1] = '.';
+        len = n + 1;
+    }
+    buf->len += len + _format_exponent(&out[len], point);
+}
+
+// precision < 0 is the shortest text that reads back as the same double,
+// otherwise exactly precision decimals (%.Nf)
+void format_f64(string *buf, double value, int precision)
+{
+    if (precision < 0) _format_f64_shortest(buf, value);
+    else               _format_f64_fixed(buf, value, (u32)precision);
+}
+
+void format_ldbl(string *buf, long double value, int precision)
+{
+    // Anything a double holds exactly goes through the double paths
+    if ((long double)(double)value == value || value != value) {
+        format_f64(buf, (double)value, precision);
+        return;
+    }
+    // @Incomplete extended precision values still go through libc
+    int n = precision < 0 ? snprintf(&buf->data[buf->len], buf->_cap - buf->len, "%.*Lg", MAX_LDBL_DP, value)
+                          : snprintf(&buf->data[buf->len], buf->_cap - buf->len, "%.*Lf", precision, value);
+    if (n > 0) buf->len += (size_t)n < buf->_cap - buf->len ? (size_t)n : buf->_cap - buf->len - 1;
+}
+
+// %e and %.Ng, like _format_f64_exp
+void _format_ldbl_exp(string *buf, long double value, u32 precision, bool general, bool alt)
+{
+    if ((long double)(double)value == value || value != value) {
+        _format_f64_exp(buf, (double)value, precision, general, alt);
+        return;
+    }
+    // @Incomplete extended precision values still go through libc
+    const char *fmt = general ? (alt ? "%#.*Lg" : "%.*Lg") : (alt ? "%#.*Le" : "%.*Le");
+    int n = snprintf(&buf->data[buf->len], buf->_cap - buf->len, fmt, (int)precision, value);
+    if (n > 0) buf->len += (size_t)n < buf->_cap - buf->len ? (size_t)n : buf->_cap - buf->len - 1;
+}
+
+string boolstr[] = {
+    {.data = "false", .len = 5, ._cap = 5},
+    {.data = "true" , .len = 4, ._cap = 4},
+}; 
+
+size_t write_string_upto_cap(string *buf, string source)
+{
+    // copy into buffer until either we finish the string or we fill up the buffer
+    size_t room = buf->_cap > buf->len ? buf->_cap - buf->len : 0;
+    size_t advanceby = source.len < room ? source.len : room;
+    __builtin_memcpy(&buf->data[buf->len], source.data, advanceby);
+    buf->len += advanceby;
+    return advanceby;
+}
+
+
+s64 _format_clamp(s64 value, s64 max)
+{
+    return value > max ? max : value;
+}
+
+// Decodes the spec text after a %, returns how many bytes of it there were
+// (0 for a bare %). See the syntax comment above.
+u32 _format_parse_spec(const char *fmt, u32 len, u32 i, FormatSpec *spec)
+{
+    u32 start = i;
+    FormatSpec s = FORMAT_SPEC_DEFAULT;
+    for (; i < len; i++) {
+        char c = fmt[i];
+        if      (c == '-') s.flags |= FMT_LEFT;
+        else if (c == '+') s.flags |= FMT_SIGN;
+        else if (c == ' ') s.flags |= FMT_SPACE;
+        else if (c == '0') s.flags |= FMT_ZERO;
+        else if (c == '#') s.flags |= FMT_ALT;
+        else if (c == 'U') s.flags |= FMT_UPPER;
+        else break;
+    }
+    // Only flags, "% <-" is text but "%U" or "%-" on their own still mean something
+    u32 end = (s.flags & FMT_SPACE) ? start : i;
+
+    bool sized = false;
+    if (i < len && fmt[i] == '*') {
+        s.flags |= FMT_WIDTH_ARG;
+        end = ++i;
+        sized = true;
+    } else if (i < len && jp_isnum(fmt[i])) {
+        s64 width = 0;
+        for (; i < len && jp_isnum(fmt[i]); i++) width = width < FORMAT_WIDTH_MAX ? width * 10 + (fmt[i] - '0') : width;
+        s.width = (u16)_format_clamp(width, FORMAT_WIDTH_MAX);
+        end = i;
+        sized = true;
+    }
+    // a '.' without digits is just a full stop ("value is %.")
+    if (i + 1 < len && fmt[i] == '.' && fmt[i + 1] == '*') {
+        s.flags |= FMT_PRECISION_ARG;
+        end = i += 2;
+        sized = true;
+    } else if (i + 1 < len && fmt[i] == '.' && jp_isnum(fmt[i + 1])) {
+        s64 precision = 0;
+        for (i++; i < len && jp_isnum(fmt[i]); i++) precision = precision < S16_MAX ? precision * 10 + (fmt[i] - '0') : precision;
+        s.precision = (s16)_format_clamp(precision, S16_MAX);
+        end = i;
+        sized = true;
+    }
+
+    while (i < len && (fmt[i] == 'h' || fmt[i] == 'l' || fmt[i] == 'L' || fmt[i] == 'z' ||
+                       fmt[i] == 'j' || fmt[i] == 't' || fmt[i] == 'q')) i++;
+    char c = i < len ? fmt[i] : 0;
+    bool word_next = i + 1 < len && jp_isalpha(fmt[i + 1]);
+    bool conv = c == 'd' || c == 'i' || c == 'u' || c == 's' || c == 'g' || c == 'c' || c == 'f' ||
+                c == 'x' || c == 'X' || c == 'o' || c == 'b' || c == 'p';
+    // "100% of" and "%Users" are words, not an octal or string spec
+    if (conv && s.flags && !sized && word_next) conv = false;
+    // these came later, a bare "%each" or "%Fahrenheit" stays a placeholder and a word
+    if ((c == 'e' || c == 'E' || c == 'F' || c == 'G') && !(word_next && !sized)) conv = true;
+    if (!conv && ((s.flags & ~FMT_SPACE) || sized) && (c == 'a' || c == 'A' || c == 'n') && !word_next) {
+        // printf conversions we don't do, the whole thing is text rather than a value
+        spec->conv = '%';
+        return i + 1 - start;
+    }
+    if (conv) {
+        s.conv = c;
+        end = i + 1;
+        if (c == 'E' || c == 'F' || c == 'G') {
+            s.conv = c - 'A' + 'a';
+            s.flags |= FMT_UPPER;
+        }
+        if      (c == 'x') s.base = 16;
+        else if (c == 'X') { s.base = 16; s.flags |= FMT_UPPER; }
+        else if (c == 'o') s.base = 8;
+        else if (c == 'b') s.base = 2;
+        else if (c == 'p') { s.base = 16; s.flags |= FMT_ALT; }
+    } else if (!sized && end < len && jp_isalpha(fmt[end])) {
+        end = start;
+    }
+    if (end == start) return 0;
+    *spec = s;
+    return end - start;
+}
+
+// Parses the segment starting at pos, see FormatSegment
+FormatSegment format_parse_segment(const char *fmt, u32 len, u32 pos)
+{
+    FormatSegment seg = { .start = pos, .spec = FORMAT_SPEC_DEFAULT };
+    ptrdiff_t index = _impl_load(_memchr_impl)(&fmt[pos], len - pos, '%');
+    if (index < 0) {
+        seg.len = len - pos;
+        return seg;
+    }
+    seg.len = (u32)index;
+    seg.spec_len = 1;
+    if (pos + index + 1 < len && fmt[pos + index + 1] == '%') {
+        // escaped, keep the first % in the literal and skip the second
+        seg.len++;
+        return seg;
+    }
+    seg.arg = true;
+    seg.spec_len += _format_parse_spec(fmt, len, pos + (u32)index + 1, &seg.spec);
+    if (seg.spec.conv == '%') {
+        // one we don't do, it and everything up to the next placeholder is the literal
+        FormatSegment rest = format_parse_segment(fmt, len, pos + (u32)index + seg.spec_len);
+        rest.len  += rest.start - pos;
+        rest.start = pos;
+        return rest;
+    }
+    return seg;
+}
+
+void _format_use_cache(FormatCache *cache, TypeInfo *args)
+{
+    if (args[0].tag != T_STR || !args[0].s) return;
+    u32 state = __atomic_load_n(&cache->state, __ATOMIC_ACQUIRE);
+    if (state == FORMAT_CACHE_EMPTY) {
+        // first caller to get here fills it in, anyone racing it just goes uncached this once
+        if (!__atomic_compare_exchange_n(&cache->state, &state, FORMAT_CACHE_FILLING, false,
+                                         __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) return;
+        string fmt = cstrlen(args[0].s);
+        cache->fmt = fmt.data;
+        cache->len = (u32)fmt.len;
+        u32 pos = 0, count = 0;
+        state = FORMAT_CACHE_READY;
+        for (;;) {
+            if (count == FORMAT_CACHE_SEGMENTS) {
+                state = FORMAT_CACHE_UNUSED;
+                break;
+            }
+            FormatSegment seg = format_parse_segment(cache->fmt, cache->len, pos);
+            cache->segments[count++] = seg;
+            if (!seg.spec_len) break;
+            pos = seg.start + seg.len + seg.spec_len;
+        }
+        cache->count = count;
+        __atomic_store_n(&cache->state, state, __ATOMIC_RELEASE);
+    }
+    if (state != FORMAT_CACHE_READY) return;
+    // __builtin_constant_p also passes `flag ? "a" : "b"`, so the site can see other text
+    if (cache->fmt != args[0].s) return;
+    args[0] = (TypeInfo){ T_FMT, .aux = 0, .cache = cache };
+}
+
+// Each type has a formatter in _format_table, they either write the whole field
+// and return false, or return true without writing when there isn't room for it.
+// Strings are the exception, they write what fits and turn the arg into a
+// T_STRN of whatever is left so the next call carries on.
+typedef bool (*FormatFn)(string *buf, TypeInfo *arg, FormatSpec spec);
+
+size_t _format_room(const string *buf)
+{
+    return buf->_cap > buf->len ? buf->_cap - buf->len : 0;
+}
+
+void _format_upper(char *text, size_t len)
+{
+    for (size_t i = 0; i < len; i++) text[i] -= ((u8)(text[i] - 'a') < 26) << 5;
+}
+
+// Pads everything written since start out to the field width. The fills are
+// plain memsets, the compiler turns them into vector stores.
+void _format_pad(string *buf, size_t start, FormatSpec spec, bool numeric)
+{
+    size_t n = buf->len - start;
+    if (spec.width <= n) return;
+    size_t pad = spec.width - n;
+    char *field = &buf->data[start];
+    if (spec.flags & FMT_LEFT) {
+        __builtin_memset(&field[n], ' ', pad);
+    } else {
+        // zeros go between the sign and the digits, and never in front of inf/nan
+        size_t at = n && (field[0] == '-' || field[0] == '+' || field[0] == ' ');
+        char fill = '0';
+        if (!numeric || !(spec.flags & FMT_ZERO) || at == n || !jp_isnum(field[at])) {
+            fill = ' ';
+            at = 0;
+        }
+        __builtin_memmove(&field[at + pad], &field[at], n - at);
+        __builtin_memset(&field[at], fill, pad);
+    }
+    buf->len += pad;
+}
+
+bool _format_char(string *buf, TypeInfo *arg, FormatSpec spec);
+
+// Fields are at most FORMAT_INT_MAX + 2 * FORMAT_WIDTH_MAX bytes
+bool _format_integer(string *buf, TypeInfo *arg, FormatSpec spec, bool is_signed)
+{
+    if (spec.conv == 'c') return _format_char(buf, arg, (FormatSpec){ .width = spec.width, .precision = -1, .flags = spec.flags });
+    spec.precision = (s16)_format_clamp(spec.precision, FORMAT_WIDTH_MAX);
+    if (_format_room(buf) < FORMAT_INT_MAX + spec.width + (size_t)(spec.precision > 0 ? spec.precision : 0)) return true;
+    // printf's x/o conversions are unsigned, so no + or space either
+    if (spec.base && spec.base != 10) spec.flags &= ~(FMT_SIGN | FMT_SPACE);
+    if (!is_signed) {
+        format_u64(buf, arg->u, spec);
+    } else if (spec.base && spec.base != 10 && arg->i < 0) {
+        // like printf, negative numbers in other bases are their bits at the arg's size
+        u32 size = arg->tag == T_SCHAR ? sizeof(signed char) : arg->tag == T_SHORT ? sizeof(short) :
+                   arg->tag == T_INT   ? sizeof(int)         : arg->tag == T_LONG  ? sizeof(long)  : sizeof(long long);
+        u64 mask = size < 8 ? (1ull << (size * 8)) - 1 : U64_MAX;
+        format_u64(buf, (u64)arg->i & mask, spec);
+    } else {
+        format_s64(buf, arg->i, spec);
+    }
+    return false;
+}
+
+bool _format_signed(string *buf, TypeInfo *arg, FormatSpec spec)
+{
+    return _format_integer(buf, arg, spec, true);
+}
+
+bool _format_unsigned(string *buf, TypeInfo *arg, FormatSpec spec)
+{
+    return _format_integer(buf, arg, spec, false);
+}
+
+bool _format_char(string *buf, TypeInfo *arg, FormatSpec spec)
+{
+    if (spec.conv == 'd' || spec.conv == 'i' || spec.conv == 'u' || spec.base) return _format_signed(buf, arg, spec);
+    if (_format_room(buf) < 1u + spec.width) return true;
+    size_t start = buf->len;
+    buf->data[buf->len++] = (char)arg->i;
+    if (spec.flags & FMT_UPPER) _format_upper(&buf->data[start], 1);
+    _format_pad(buf, start, spec, false);
+    return false;
+}
+
+// Wide chars are codepoints, written as UTF-8 (invalid ones as RUNE_ERROR)
+bool _format_wchar(string *buf, TypeInfo *arg, FormatSpec spec)
+{
+    if (spec.conv == 'd' || spec.conv == 'i' || spec.conv == 'u' || spec.base) return _format_unsigned(buf, arg, spec);
+    if (_format_room(buf) < 4u + spec.width) return true;
+    rune r = (rune)arg->u;
+    if (r > 0x10ffff || (r >= 0xd800 && r <= 0xdfff)) r = RUNE_ERROR;
+    size_t start = buf->len;
+    char *out = &buf->data[buf->len];
+    if (r < 0x80) {
+        out[0] = (char)r;
+        buf->len += 1;
+    } else if (r < 0x800) {
+        out[0] = (char)(0xc0 | (r >> 6));
+        out[1] = (char)(0x80 | (r & 0x3f));
+        buf->len += 2;
+    } else if (r < 0x10000) {
+        out[0] = (char)(0xe0 | (r >> 12));
+        out[1] = (char)(0x80 | ((r >> 6) & 0x3f));
+        out[2] = (char)(0x80 | (r & 0x3f));
+        buf->len += 3;
+    } else {
+        out[0] = (char)(0xf0 | (r >> 18));
+        out[1] = (char)(0x80 | ((r >> 12) & 0x3f));
+        out[2] = (char)(0x80 | ((r >> 6) & 0x3f));
+        out[3] = (char)(0x80 | (r & 0x3f));
+        buf->len += 4;
+    }
+    _format_pad(buf, start, spec, false);
+    return false;
+}
+
+bool _format_bool(string *buf, TypeInfo *arg, FormatSpec spec)
+{
+    string text = boolstr[arg->b ? 1 : 0];
+    if (_format_room(buf) < text.len + spec.width) return true;
+    size_t start = buf->len;
+    write_string_upto_cap(buf, text);
+    if (spec.flags & FMT_UPPER) _format_upper(&buf->data[start], text.len);
+    _format_pad(buf, start, spec, false);
+    return false;
+}
+
+// %.Nf of a long double past the double range has up to 4933 digits before
+// the point, more than some buffers ever have free. So it's built whole on the
+// stack each go and aux is how much of it went out on the ones before.
+bool _format_ldbl_long(string *buf, TypeInfo *arg, FormatSpec spec, int precision)
+{
+    char text[1 + 4933 + 1 + FORMAT_WIDTH_MAX + 1]; // sign, digits, point, precision and snprintf's nul, padding is shorter
+    string field = { ._owner = true, .data = text, ._cap = sizeof(text) };
+    if (!__builtin_signbit(*arg->ld) && (spec.flags & (FMT_SIGN | FMT_SPACE))) text[field.len++] = spec.flags & FMT_SIGN ? '+' : ' ';
+    format_ldbl(&field, *arg->ld, precision);
+    if (spec.flags & FMT_UPPER) _format_upper(text, field.len);
+    _format_pad(&field, 0, spec, true);
+    size_t n = write_string_upto_cap(buf, (string){ .data = &text[arg->aux], .len = field.len - arg->aux });
+    arg->aux += n;
+    return arg->aux < field.len;
+}
+
+// Doubles and long doubles, 312 + precision covers the longest %.Nf and
+// we keep the width on top of that
+bool _format_float(string *buf, TypeInfo *arg, FormatSpec spec)
+{
+    int precision = spec.precision >= 0 ? (int)_format_clamp(spec.precision, FORMAT_WIDTH_MAX) : spec.conv == 'f' || spec.conv == 'e' ? 6 : -1;
+    // %e, and %g when it has a precision, the rest is fixed or shortest
+    bool exp = spec.conv == 'e' || (spec.conv == 'g' && precision >= 0);
+    if (arg->tag == T_LDOUBLE && precision >= 0 && !exp && __builtin_fabsl(*arg->ld) >= 1e308L) {
+        return _format_ldbl_long(buf, arg, spec, precision);
+    }
+    if (_format_room(buf) < 312u + (precision > 0 ? precision : 0) + spec.width) return true;
+    bool negative = arg->tag == T_LDOUBLE ? __builtin_signbit(*arg->ld) : __builtin_signbit(arg->d);
+    size_t start = buf->len;
+    if (!negative && (spec.flags & (FMT_SIGN | FMT_SPACE))) buf->data[buf->len++] = spec.flags & FMT_SIGN ? '+' : ' ';
+    bool general = spec.conv == 'g', alt = spec.flags & FMT_ALT;
+    if      (exp && arg->tag == T_LDOUBLE) _format_ldbl_exp(buf, *arg->ld, (u32)precision, general, alt);
+    else if (exp)                          _format_f64_exp(buf, arg->d, (u32)precision, general, alt);
+    else if (arg->tag == T_LDOUBLE)        format_ldbl(buf, *arg->ld, precision);
+    else                                   format_f64(buf, arg->d, precision);
+    if (spec.flags & FMT_UPPER) _format_upper(&buf->data[start], buf->len - start);
+    _format_pad(buf, start, spec, true);
+    return false;
+}
+
+// printf %p, 0x hex and (nil) for NULL
+bool _format_pointer(string *buf, TypeInfo *arg, FormatSpec spec)
+{
+    if (arg->p) {
+        spec.base = 16;
+        spec.flags |= FMT_ALT;
+        TypeInfo value = { T_ULLONG, .u = (u64)(uintptr_t)arg->p };
+        return _format_unsigned(buf, &value, spec);
+    }
+    if (_format_room(buf) < 5u + spec.width) return true;
+    size_t start = buf->len;
+    write_string_upto_cap(buf, (string){ .data = "(nil)", .len = 5 });
+    _format_pad(buf, start, spec, false);
+    return false;
+}
+
+bool _format_str(string *buf, TypeInfo *arg, FormatSpec spec)
+{
+    if (arg->tag == T_STRN) {
+        // carrying on, the truncating and padding was sorted out the first time
+        size_t n = write_string_upto_cap(buf, (string){ .data = arg->s, .len = arg->aux });
+        if (spec.flags & FMT_UPPER) _format_upper(&buf->data[buf->len - n], n);
+        arg->s   += n;
+        arg->aux -= n;
+        return arg->aux > 0;
+    }
+    bool null = arg->tag == T_STR && !arg->s;
+    string text = arg->tag == T_STRING ? (string){ .data = arg->s, .len = arg->aux } :
+                  null ? (string){ .data = "(null)", .len = 6 } : cstrlen(arg->s);
+    if (spec.precision >= 0 && text.len > (size_t)spec.precision) text.len = spec.precision;
+    if (spec.width > text.len || null) {
+        // padded fields are shorter than FORMAT_WIDTH_MAX, they go in whole or not at all
+        size_t need = spec.width > text.len ? spec.width : text.len;
+        if (_format_room(buf) < need) return true;
+        size_t start = buf->len;
+        write_string_upto_cap(buf, text);
+        if (spec.flags & FMT_UPPER) _format_upper(&buf->data[start], text.len);
+        _format_pad(buf, start, spec, false);
+        return false;
+    }
+    *arg = (TypeInfo){ T_STRN, .aux = text.len, .s = text.data };
+    return _format_str(buf, arg, spec);
+}
+
+// Only fprintf_impl makes these, so buf is always the front of a _PrintGather
+bool _format_strref(string *buf, TypeInfo *arg, FormatSpec spec)
+{
+    size_t len = arg->aux;
+    if (spec.precision >= 0 && len > (size_t)spec.precision) len = spec.precision;
+    if (len < PRINT_ZERO_COPY_MIN || len < spec.width || (spec.flags & FMT_UPPER)) {
+        // needs changing on the way out, copy it like any other string
+        arg->tag = T_STRING;
+        return _format_str(buf, arg, spec);
+    }
+    _print_gather((_PrintGather *)buf, arg->s, len);
+    return false;
+}
+
+// T_CUSTOM's aux is the formatter's index in here, with how much of its text went
+// out on an earlier go above that. 0 means we ran out of room for formatters.
+#define FORMAT_TYPES_MAX 256
+FormatTypeFn _format_types[FORMAT_TYPES_MAX];
+
+u64 _format_type_index(FormatTypeFn fn)
+{
+    for (u64 i = 1; i < FORMAT_TYPES_MAX; i++) {
+        FormatTypeFn slot = __atomic_load_n(&_format_types[i], __ATOMIC_ACQUIRE);
+        if (slot == fn) return i;
+        if (slot) continue;
+        if (__atomic_compare_exchange_n(&_format_types[i], &slot, fn, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) return i;
+        if (slot == fn) return i;
+    }
+    return 0;
+}
+
+char *format_reserve(FormatWriter *w, size_t len)
+{
+    if (len > FORMAT_RESERVE_MAX) return NULL;
+    // straight into the output unless some of it is being skipped or won't fit
+    bool direct = !w->full && w->pos >= w->skip && _format_room(w->buf) >= len;
+    w->reserved = direct ? &w->buf->data[w->buf->len] : w->scratch;
+    return w->reserved;
+}
+
+void format_commit(FormatWriter *w, size_t len)
+{
+    if (w->reserved == w->scratch) {
+        format_write(w, w->scratch, len);
+        return;
+    }
+    w->buf->len += len;
+    w->pos      += len;
+}
+
+void format_write(FormatWriter *w, const char *data, size_t len)
+{
+    size_t start = w->pos;
+    w->pos += len;
+    if (w->full) return;
+    size_t skip = w->skip > start ? w->skip - start : 0;
+    if (skip >= len) return;
+    size_t room = _format_room(w->buf);
+    size_t n = len - skip < room ? len - skip : room;
+    __builtin_memcpy(&w->buf->data[w->buf->len], &data[skip], n);
+    w->buf->len += n;
+    if (skip + n < len) {
+        w->full = true;
+        w->stop = start + skip + n;
+    }
+}
+
+bool format_full(const FormatWriter *w)
+{
+    return w->full;
+}
+
+void format_mark(FormatWriter *w, u64 state)
+{
+    if (w->full || w->depth) return;
+    w->mark     = state;
+    w->mark_pos = w->pos;
+}
+
+u64 format_resume(const FormatWriter *w)
+{
+    return w->depth ? 0 : w->resume;
+}
+
+bool _format_arg(string *buf, TypeInfo *arg, FormatSpec spec);
+bool _format_unhandled(string *buf, TypeInfo *arg, FormatSpec spec);
+
+void format_arg(FormatWriter *w, TypeInfo arg, FormatSpec spec)
+{
+    if (arg.tag == T_CUSTOM && _format_types[arg.aux & 0xff]) {
+        w->depth++;
+        _format_types[arg.aux & 0xff](w, arg.value, spec);
+        w->depth--;
+        return;
+    }
+    if (arg.tag == T_STR && arg.s) arg = arg_string(cstrlen(arg.s));
+    if (arg.tag == T_STRING && !spec.width && spec.precision < 0 && !(spec.flags & FMT_UPPER)) {
+        format_write(w, arg.s, arg.aux);
+        return;
+    }
+    // everything else fits in the scratch space, apart from strings which
+    // carry on where they left off
+    for (;;) {
+        string field = { ._owner = true, .data = w->scratch, ._cap = FORMAT_RESERVE_MAX };
+        bool more = _format_arg(&field, &arg, spec);
+        format_write(w, field.data, field.len);
+        if (!more || !field.len) break;
+    }
+}
+
+// The custom value that stopped part way on this thread and the last place it
+// marked before then. There's only ever one, the caller makes room and carries
+// on with it before anything else gets formatted.
+typedef struct {
+    const TypeInfo *arg;
+    size_t          stop;
+    u64             mark;
+    size_t          mark_pos;
+} _FormatResume;
+_Thread_local _FormatResume _format_stopped;
+
+void _format_writer_init(FormatWriter *w, string *buf, size_t skip)
+{
+    w->buf      = buf;
+    w->skip     = skip;
+    w->pos      = 0;
+    w->full     = false;
+    w->resume   = 0;
+    w->mark     = 0;
+    w->mark_pos = 0;
+    w->depth    = 0;
+}
+
+// Runs the formatter over whatever room buf has, skipping what an earlier go
+// wrote. It starts from the last mark before that if it made any.
+bool _format_custom(string *buf, TypeInfo *arg, FormatSpec spec)
+{
+    FormatTypeFn fn = _format_types[arg->aux & 0xff];
+    if (!fn) return _format_unhandled(buf, arg, spec);
+    FormatWriter w;
+    _format_writer_init(&w, buf, arg->aux >> 8);
+    if (w.skip && _format_stopped.arg == arg && _format_stopped.stop == w.skip) {
+        w.resume = w.mark = _format_stopped.mark;
+        w.pos    = w.mark_pos = _format_stopped.mark_pos;
+    }
+    fn(&w, arg->value, spec);
+    if (!w.full) return false;
+    arg->aux = (w.stop << 8) | (arg->aux & 0xff);
+    _format_stopped = (_FormatResume){ .arg = arg, .stop = w.stop, .mark = w.mark, .mark_pos = w.mark_pos };
+    return true;
+}
 
-//#define ALWAYS_SHOW_SIGN 1 << 0
-void format_u64(string *buf, unsigned long long value, u8 opts) 
+void format_string_list(FormatWriter *w, const void *value, FormatSpec spec)
 {
-    (void)opts;
-    char reversed[20];   // max for 64-bit decimal
-    int n = 0;
-
-    // @Speed can we improve this?
-    do {
-        reversed[n++] = '0' + value % 10;
-        value /= 10;
-    } while (value);
-    while (n--) {
-        buf->data[buf->len++] = reversed[n];
+    const StringList *list = (const StringList *)value;
+    u64 from = format_resume(w); // item i is marked i + 1
+    if (!from) format_write(w, "[", 1);
+    for (size_t i = from ? from - 1 : 0; i < list->len && !w->full; i++) {
+        format_mark(w, i + 1);
+        if (i) format_write(w, ", ", 2);
+        format_arg(w, arg_string(list->data[i]), spec);
     }
+    format_write(w, "]", 1);
 }
 
-void format_s64(string *buf, long long value, u8 opts)
-{ 
-    if (value <  0) {
-        buf->data[buf->len++] = '-';
-        value = -value;
-    } 
-    format_u64(buf, (unsigned long long)value, opts);
+// Internal tags that should never get here, say so rather than fall over
+bool _format_unhandled(string *buf, TypeInfo *arg, FormatSpec spec)
+{
+    (void)arg; (void)spec;
+    if (_format_room(buf) < 11) return true;
+    write_string_upto_cap(buf, (string){ .data = "(unhandled)", .len = 11 });
+    return false;
 }
 
-#define MAX_DBL_DP 17
-// @Incomplete this is only the case on x64 on 128 bit we need to do 36 for long double
-#define MAX_LDBL_DP 21
-
+FormatFn _format_table[] = {
+    [T_CHAR]    = _format_char,
+    [T_SCHAR]   = _format_signed,
+    [T_UCHAR]   = _format_unsigned,
+    [T_SHORT]   = _format_signed,
+    [T_USHORT]  = _format_unsigned,
+    [T_INT]     = _format_signed,
+    [T_UINT]    = _format_unsigned,
+    [T_LONG]    = _format_signed,
+    [T_ULONG]   = _format_unsigned,
+    [T_LLONG]   = _format_signed,
+    [T_ULLONG]  = _format_unsigned,
+    [T_BOOL]    = _format_bool,
+    [T_FLOAT]   = _format_float,
+    [T_DOUBLE]  = _format_float,
+    [T_LDOUBLE] = _format_float,
+    [T_SIZE]    = _format_unsigned,
+    [T_PTRDIFF] = _format_signed,
+    [T_WCHAR]   = _format_wchar,
+    [T_STR]     = _format_str,
+    [T_PTR]     = _format_pointer,
+    [T_STRING]  = _format_str,
+    [T_CUSTOM]  = _format_custom,
+    [T_FMT]     = _format_unhandled,
+    [T_STRN]    = _format_str,
+    [T_STRREF]  = _format_strref,
+};
 
-void format_f64(string *buf, double value, int precision)
+bool _format_arg(string *buf, TypeInfo *arg, FormatSpec spec)
 {
-    if (value <  0) {
-        buf->data[buf->len++] = '-';
-        value = -value;
-    } 
-
-    int digit;
-    long long intpart = (long long)value;
-    double frac       = value - (double)intpart;
-    format_u64(buf, intpart, 0);
-    if (precision < 0) precision = MAX_DBL_DP;
-    buf->data[buf->len] = '.'; 
-    size_t lastnon0 = 1;
-    for (size_t i = 0; i < (size_t)precision; i++) { 
-        frac *= 10.0;
-        if (frac >= 1) lastnon0 = i + 3; // +3 so we can -= 1 after and it will remove the '.' if no decimal result
-        digit = (int)frac;
-        buf->data[buf->len+1+i] = '0' + digit;
-        frac -= digit;
-    }
-    buf->len += lastnon0 - 1;
+    if ((size_t)arg->tag >= sizeof(_format_table) / sizeof(_format_table[0])) return _format_unhandled(buf, arg, spec);
+    return _format_table[arg->tag](buf, arg, spec);
 }
 
-void format_ldbl(string *buf, long double value, int precision)
+// Width or precision from a * arg
+s64 _format_arg_int(const TypeInfo *arg)
 {
-    if (value <  0) {
-        buf->data[buf->len++] = '-';
-        value = -value;
-    } 
-
-    int digit;
-    long long intpart = (long long)value;
-    long double frac  = value - (long double)intpart;
-    format_u64(buf, intpart, 0);
-    if (precision < 0) precision = MAX_DBL_DP;
-    buf->data[buf->len] = '.'; 
-    size_t lastnon0 = 1;
-    for (size_t i = 0; i < (size_t)precision; i++) { 
-        frac *= 10.0;
-        if (frac >= 1) lastnon0 = i + 3; // +3 so we can -= 1 after and it will remove the '.' if no decimal result
-        digit = (int)frac;
-        buf->data[buf->len+1+i] = '0' + digit;
-        frac -= digit;
+    switch (arg->tag) {
+        case T_UCHAR: case T_USHORT: case T_UINT: case T_ULONG: case T_ULLONG: case T_SIZE:
+            return arg->u > (u64)S64_MAX ? S64_MAX : (s64)arg->u;
+        case T_CHAR: case T_SCHAR: case T_SHORT: case T_INT: case T_LONG: case T_LLONG: case T_PTRDIFF:
+            return arg->i;
+        default:
+            return 0;
     }
-    buf->len += lastnon0 - 1;
 }
 
-string boolstr[] = {
-    {.data = "false", .len = 5, ._cap = 5},
-    {.data = "true" , .len = 4, ._cap = 4},
-}; 
-
-size_t write_string_upto_cap(string *buf, string source)
+// Fills in a * width/precision from the args in front of the value, returns the value
+TypeInfo *_format_star_args(FormatSpec *spec, TypeInfo *arg)
 {
-    size_t advanceby;
-    // copy into buffer until either we finish the string or we fill up the buffer
-    for (advanceby = 0;buf->len < buf->_cap && source.len > 0; advanceby++) {
-        buf->data[buf->len++] = source.data[advanceby];
-        source.len--;
+    if (spec->flags & FMT_WIDTH_ARG) {
+        s64 width = _format_arg_int(arg++);
+        if (width < 0) {
+            spec->flags |= FMT_LEFT;
+            width = width < -FORMAT_WIDTH_MAX ? FORMAT_WIDTH_MAX : -width;
+        }
+        spec->width = (u16)_format_clamp(width, FORMAT_WIDTH_MAX);
     }
-    return advanceby;
+    if (spec->flags & FMT_PRECISION_ARG) {
+        s64 precision = _format_arg_int(arg++);
+        spec->precision = precision < 0 ? -1 : (s16)_format_clamp(precision, S16_MAX);
+    }
+    spec->flags &= ~(FMT_WIDTH_ARG | FMT_PRECISION_ARG);
+    return arg;
 }
 
-
 // @Incomplete I want to replace char * here with string and wrap any char* in cstrlen at time of call
 bool format_string_arg_into_buffer_iter(string *buf, size_t *argc, TypeInfo **args, char *source, bool isf)
 {
     if (!source) {
-        if (isf) write_string_upto_cap(buf, (string){.data="(null)", .len=6});
-        else write_string_upto_cap(buf, (string){.data="(null) ", .len=7});
+        string text = isf ? (string){.data="(null)", .len=6} : (string){.data="(null) ", .len=7};
+        if (_format_room(buf) < text.len) return true;
+        write_string_upto_cap(buf, text);
         return false;
     }
-    string working, result, line, subline;
-    working = cstrlen(source);
-    u8 opts = 0;
+    FormatCache *cache = (*args)[0].tag == T_FMT ? (*args)[0].cache : NULL;
+    string working = cache ? (string){0} : cstrlen(source);
     size_t advanceby;
     if (!isf) {
         // [\n]
         advanceby = write_string_upto_cap(buf, working);
-        if (*argc == 1) {
-            (*args)[0].s = &(*args)[0].s[advanceby-1]; // we don't know if we hit the cap when writing
-                                                       // if we did and we trim the trailing \n from print[f]ln
-                                                       // we won't know to come back into this block
-            // We only care about trailing newlines as inserted by print[f]ln
-            bool isnewline = *working.data == '\n';
-            if (buf->len + (isnewline ? 1 : 0) > buf->_cap) return true;
-            
-            // We don't need to advance the string any more as we return saying we've finished it
-            // save the wasteful op
-            if (!isnewline) buf->data[buf->len++] = ' ';
-            return false;
-        }
-        (*args)[0].s = &(*args)[0].s[advanceby]; // we don't need to reserve any space cut what we read
-        if (advanceby > working.len) return true;
-
+        (*args)[0].s = &(*args)[0].s[advanceby];
+        // filled up the buffer before we finished, the rest goes next time
+        if (advanceby < working.len) return true;
+        // We only care about trailing newlines as inserted by print[f]ln,
+        // the last string gets a space otherwise
+        if (*argc == 1 && *working.data != '\n') {
+            // s is at the end now so next time round it's just the space
+            if (buf->len >= buf->_cap) return true;
+            buf->data[buf->len++] = ' ';
+        }
         return false;
     }
-    while ((line = string_split_iter(&working, pct)).next) {
-        advanceby = write_string_upto_cap(buf, line);
 
-        // advance raw source string in case we run out of space and are called again
-        // this gives the caller the same view as 'working' (and thus our next call if any)
+    // Cached formats keep their place in the arg, plain strings get advanced as we go
+    // so either way the pair below is where this call starts from
+    const char *fmt = cache ? cache->fmt : working.data;
+    u32 len = cache ? cache->len : (u32)working.len;
+    u32 pos = cache ? (u32)(*args)[0].aux : 0;
+    u32 index = 0;
+    if (cache) {
+        // resuming after a refill, skip to the segment we were in
+        while (index + 1 < cache->count &&
+               cache->segments[index].start + cache->segments[index].len + cache->segments[index].spec_len <= pos) index++;
+    }
 
-        if (line.len > advanceby) {
-            // We filled up the buffer before we finished writing the string
-            return true;
+    bool more = false;
+    FormatSegment parsed;
+    for (;; index++) {
+        // pointing at the cached one rather than copying it out, the copy is
+        // piecemeal and reading the spec back whole straight after stalls
+        const FormatSegment *seg = &parsed;
+        if (cache) seg = &cache->segments[index];
+        else       parsed = format_parse_segment(fmt, len, pos);
+        u32 end = seg->start + seg->len;
+        if (pos < end) {
+            if (pos < seg->start) pos = seg->start;
+            pos += (u32)write_string_upto_cap(buf, (string){ .data = (char *)&fmt[pos], .len = end - pos });
+            // filled up the buffer before we finished writing the literal
+            if (pos < end) { more = true; break; }
         }
-
-        // we had enough space to write the string UP TO the % we are formatting...
-
-        // check we can fit at least a double...
-        if (buf->len + 41 >= buf->_cap) return true;
-        // saves doing an if on each number branch...
-
-        if (working.len > 0) {
-            // check if we had an escaped % OR no more args (print the %)
-            if (working.data[0] == '%' || *argc == 1) {
-                working.data++;
-                working.len--;
-                buf->data[buf->len++] = '%';
-                continue;
+        if (!seg->spec_len) break;
+
+        // * takes the width/precision from the args in front of the value
+        FormatSpec spec = seg->spec;
+        size_t used = 1 + !!(spec.flags & FMT_WIDTH_ARG) + !!(spec.flags & FMT_PRECISION_ARG);
+        if (seg->arg && *argc > used) {
+            TypeInfo *arg = &(*args)[1];
+            if (spec.flags & (FMT_WIDTH_ARG | FMT_PRECISION_ARG)) arg = _format_star_args(&spec, arg);
+            if (_format_arg(buf, arg, spec)) { more = true; break; }
+            pos = end + seg->spec_len;
+            // Replace the last arg we consumed with the format string we're working through
+            // built whole so the tag/aux bitfields go out as one store
+            (*args)[used] = cache ? (TypeInfo){ .tag = T_FMT, .aux = pos, .cache = cache }
+                                  : (TypeInfo){ .tag = T_STR, .s = (char *)&fmt[pos] };
+            // Increment args to remove consumed from total
+            (*args) = &(*args)[used];
+            (*argc) -= used;
+            if (!cache) { fmt += pos; len -= pos; pos = 0; }
+        } else {
+            // escaped %, or no args left so print the placeholder as is
+            if (seg->arg) {
+                if (_format_room(buf) < seg->spec_len) { more = true; break; }
+                write_string_upto_cap(buf, (string){ .data = (char *)&fmt[end], .len = seg->spec_len });
             }
-            // handle_printf_format_opts()
+            pos = end + seg->spec_len;
         }
-
-        TypeInfo next = (*args)[1];
-        // We've already checked we know we have at least 1 or more arg so have to format
-        switch(next.tag) {
-            case T_CHAR:
-                buf->data[buf->len++] = (char)next.i;
-                break;
-            case T_SCHAR:
-            case T_SHORT:
-            case T_INT:  
-            case T_LONG:
-            case T_LLONG:
-                format_s64(buf, next.i, opts);
-                break;
-            case T_UCHAR:
-            case T_USHORT:
-            case T_UINT:  
-            case T_ULONG:
-            case T_ULLONG: 
-                format_u64(buf, next.u, opts);
-                break;
-            case T_FLOAT:
-            case T_DOUBLE:
-                format_f64(buf, next.d, opts);
-                break;
-            case T_LDOUBLE:
-                format_ldbl(buf, next.ld, opts);
-                break;
-            case T_BOOL:  
-                // printf("DEBUG: handling formatted T_BOOL\n");
-                result = boolstr[next.b ? 1 : 0];
-                for (size_t i = 0; i < result.len; i++) {
-                    buf->data[buf->len++] = result.data[i];
-                }
-                break;
-            case T_PTR:
-                panic("T_PTR not implemented!!");
-                break;
-            case T_STR:
-                if (!next.s) {
-                    advanceby = write_string_upto_cap(buf, (string){.data="(null)", .len=6});
-                    if (6 > advanceby) {
-                        // we didn't write the full '(null)' to the string
-                        // undo what we wrote as it's cleanest way to ensure we don't write wonky crap
-                        buf->len -= advanceby; // @Incomplete check this is not off by 1!!!
-                        return true;
-                    }
-                    break;
-                }
-                subline = cstrlen(next.s);
-                // @CopyPasta from a few lines above
-                advanceby = write_string_upto_cap(buf, subline);
-                // advance raw source string in case we run out of space and are called again
-                // this gives the caller the same view as 'working' (and thus our next call if any)
-                (*args)[1].s = &(*args)[1].s[advanceby]; 
-
-                if (subline.len > advanceby) return true;
-                break;
-
-            default:
-                // Once everything is implemented this will only fire for
-                // custom types... So we can handle custom types here?
-                panic("Unhandled type!");
-        }
-        // Replace the arg we consumed with the string we're formatting
-        (*args)[1] = (*args)[0];
-        // Increment args to remove consumed from total
-        (*args) = &(*args)[1];
-        (*argc)--;
     }
-    advanceby = write_string_upto_cap(buf, working);
-    // advance raw source string in case we run out of space and are called again
-    // this gives the caller the same view as 'working' (and thus our next call if any)
-    (*args)[0].s = &(*args)[0].s[advanceby]; // no need to preserve the '%' we have handled them all in the loop above
-
-    if (working.len > advanceby) return true;
-    return false;
-
+    // this gives the caller the same view as we had so the next call carries on from here
+    if (cache) (*args)[0].aux = pos;
+    else       (*args)[0].s = (char *)&fmt[pos];
+    return more;
 }
 
-// TODO
-// - Remaining basic types formatting
-// - Decide handling of each type for printf formatting semantics and implement
-// - Optimise handling and processing...
-// - Figure out how to do custom end user types...
-// - Tests for each of the features 
-//
 // IMPORTANT! Updates *args pointing to next arg on each loop,
 //            if you need to keep access to the start of the list 
 //            copy the address!
 //
 // Returns true if more args to process
+#define FORMAT_ARG_ROOM 41 // always kept free before starting on the next arg
 bool format_args_into_iter(string *buf, size_t *argc, TypeInfo **args, bool isf)
 {
     if (*argc == 0) return false; // nothing to do 
     buf->next = true;
-    TypeInfo current;
-    string result;
     while (*argc > 0) {
-        current = *args[0];
+        TypeInfo *current = *args;
         // Check we can fit the largest possible numerical type when represented as string
-        if (buf->len + 41 >= buf->_cap) return true;
+        if (buf->len + FORMAT_ARG_ROOM >= buf->_cap) return true;
         // anything else (bool) will fit in this, strings are handled separately...
 
-        switch(current.tag) {
-            // Numbers are all handled the same, could probably do this during the tag and just do l and d (long and double all types are representable by)
-            // But then it'd just push this switch statement into another function, so meh.
-            // @Incomplete @cleanup we wouldn't have to switch twice we could just if T_STR do string else do number which does this!!!
+        switch(current->tag) {
+            // Strings are text (or the format), everything else goes through _format_table
             //
-            // Numbers not in format string have a space (' ') appended
-            case T_CHAR:
-                buf->data[buf->len++] = (char)current.i;
-                break;
-            case T_SCHAR:
-            case T_SHORT:
-            case T_INT:  
-            case T_LONG:
-            case T_LLONG:
-                format_s64(buf, current.i, 0);
-                break;
-            case T_UCHAR:
-            case T_USHORT:
-            case T_UINT:  
-            case T_ULONG:
-            case T_ULLONG:
-                format_u64(buf, current.u, 0);
-                break;
-            case T_FLOAT:
-            case T_DOUBLE:
-                format_f64(buf, current.d, -1);
-                break;
-            case T_LDOUBLE:
-                format_ldbl(buf, current.ld, -1);
+            // Values not in format string have a space (' ') appended
+            case T_STR:  
+                if (format_string_arg_into_buffer_iter(buf, argc, args, current->s, isf)) return true;
                 break;
-            case T_BOOL:  
-                result = boolstr[current.b ? 1 : 0];
-                for (size_t i = 0; i < result.len; i++) {
-                    buf->data[buf->len++] = result.data[i];
-                }
+            case T_FMT:
+                if (format_string_arg_into_buffer_iter(buf, argc, args, (char *)current->cache->fmt, isf)) return true;
                 break;
-            case T_PTR:
-                format_u64(buf, (unsigned long long)current.p, 0);
+            // plain ints are most of what gets printed, FORMAT_ARG_ROOM covers them
+            // so they skip the table and the spec handling
+            case T_UCHAR: case T_USHORT: case T_UINT: case T_ULONG: case T_ULLONG: case T_SIZE:
+                buf->len += _write_u64_dec(&buf->data[buf->len], current->u);
                 break;
-            case T_STR:  
-                if (format_string_arg_into_buffer_iter(buf, argc, args, current.s, isf)) return true;
+            case T_SCHAR: case T_SHORT: case T_INT: case T_LONG: case T_LLONG: case T_PTRDIFF: {
+                // the '-' always goes down, the digits land on top of it when there's no sign
+                bool minus = current->i < 0;
+                char *out = &buf->data[buf->len];
+                *out = '-';
+                buf->len += minus + _write_u64_dec(out + minus, minus ? 0 - (u64)current->i : (u64)current->i);
                 break;
+            }
             default:
-                // Once everything is implemented this will only fire for
-                // custom types... So we can handle custom types here?
-                panic("Unhandled type!");
+                // strings/lists/custom types can stop part way, the arg keeps track
+                if (_format_arg(buf, current, FORMAT_SPEC_DEFAULT)) return true;
         }
 
         // maybe this nested if is horrible
         // I'm hoping it helps it run faster as branches refined by scope
         if (!isf){
             if (*argc > 1) {
+                if (buf->len >= buf->_cap) {
+                    // this one's done but the space doesn't fit, an empty string
+                    // in its place means next time round it's just the space
+                    *current = (TypeInfo){ T_STRN, .aux = 0, .s = "" };
+                    return true;
+                }
                 buf->data[buf->len++] = ' ';
             }
         }
@@ -1079,55 +5427,736 @@ bool format_args_into_iter(string *buf, size_t *argc, TypeInfo **args, bool isf)
     return false;
 }
 
+// Measuring
+// Goes over the args the same way format_args_into_iter does but only adds up
+// sizes, plain ints are a digit count and strings their length, anything
+// fiddlier gets formatted into a FormatWriter that throws the text away.
+// The handlers want room for the biggest field they could write before they
+// start, peak is the buffer size that lets them all go through first time.
+// Like format_args_into_iter it carries on from wherever that last stopped,
+// and string args become slices so their length is only found the once.
+typedef struct {
+    size_t len;  // bytes of output
+    size_t peak; // capacity format_args_into_iter needs to not stop part way
+} _FormatMeasure;
+
+void _format_measure_field(_FormatMeasure *m, size_t len, size_t need)
+{
+    if (m->len + need > m->peak) m->peak = m->len + need;
+    m->len += len;
+    if (m->len > m->peak) m->peak = m->len;
+}
+
+size_t _format_count(TypeInfo arg, FormatSpec spec)
+{
+    FormatWriter w;
+    _format_writer_init(&w, NULL, SIZE_MAX); // skipping everything, so nothing is written but pos still counts
+    format_arg(&w, arg, spec);
+    return w.pos;
+}
+
+// Mirrors the room checks in the _format_table handlers
+void _format_measure_arg(_FormatMeasure *m, TypeInfo *arg, FormatSpec spec)
+{
+    bool numeric = spec.conv == 'd' || spec.conv == 'i' || spec.conv == 'u' || spec.base;
+    bool plain   = _spec_is_plain(spec) && spec.conv != 'c';
+    size_t width = spec.width;
+    switch (arg->tag) {
+        case T_CHAR:
+            if (numeric) break;
+            _format_measure_field(m, width > 1 ? width : 1, 1 + width);
+            return;
+        case T_WCHAR:
+            if (numeric) break;
+            _format_measure_field(m, _format_count(*arg, spec), 4 + width);
+            return;
+        case T_BOOL: {
+            size_t len = boolstr[arg->b ? 1 : 0].len;
+            _format_measure_field(m, width > len ? width : len, len + width);
+            return;
+        }
+        case T_FLOAT: case T_DOUBLE: case T_LDOUBLE: {
+            int precision = spec.precision >= 0 ? (int)_format_clamp(spec.precision, FORMAT_WIDTH_MAX) : spec.conv == 'f' || spec.conv == 'e' ? 6 : -1;
+            _format_measure_field(m, _format_count(*arg, spec), 312 + (precision > 0 ? precision : 0) + width);
+            return;
+        }
+        case T_PTR:
+            if (arg->p) break;
+            _format_measure_field(m, width > 5 ? width : 5, 5 + width);
+            return;
+        case T_STR: case T_STRING: case T_STRN: case T_STRREF: {
+            bool null = arg->tag == T_STR && !arg->s;
+            // once is enough for strlen, it's a slice from here on
+            if (arg->tag == T_STR && !null) *arg = arg_string(cstrlen(arg->s));
+            size_t len = null ? 6 : arg->aux;
+            if (arg->tag != T_STRN && spec.precision >= 0 && len > (size_t)spec.precision) len = spec.precision;
+            // padded ones go in whole, the rest write what fits
+            if (arg->tag == T_STRN) width = 0;
+            bool whole = width > len || null;
+            if (width > len) len = width;
+            _format_measure_field(m, len, whole ? len : 0);
+            return;
+        }
+        case T_CUSTOM:
+            // less whatever went out before it stopped
+            _format_measure_field(m, _format_count(*arg, spec) - (arg->aux >> 8), _format_types[arg->aux & 0xff] ? 0 : 11);
+            return;
+        case T_SCHAR: case T_SHORT: case T_INT: case T_LONG: case T_LLONG: case T_PTRDIFF:
+        case T_UCHAR: case T_USHORT: case T_UINT: case T_ULONG: case T_ULLONG: case T_SIZE:
+            break;
+        default:
+            _format_measure_field(m, 11, 11);
+            return;
+    }
+    // integers, and the chars/pointers that end up printed as one
+    if (spec.conv == 'c' && arg->tag != T_CHAR && arg->tag != T_WCHAR) {
+        _format_measure_field(m, width > 1 ? width : 1, 1 + width);
+        return;
+    }
+    size_t precision = spec.precision > 0 ? (size_t)_format_clamp(spec.precision, FORMAT_WIDTH_MAX) : 0;
+    size_t len;
+    bool is_signed = arg->tag == T_CHAR || arg->tag == T_SCHAR || arg->tag == T_SHORT || arg->tag == T_INT ||
+                     arg->tag == T_LONG || arg->tag == T_LLONG || arg->tag == T_PTRDIFF;
+    if (plain && arg->tag != T_PTR) {
+        bool negative = is_signed && arg->i < 0;
+        len = negative + _count_digits10(negative ? 0 - (u64)arg->i : arg->u);
+    } else {
+        len = _format_count(*arg, spec);
+    }
+    _format_measure_field(m, len, FORMAT_INT_MAX + width + precision);
+}
+
+// A string arg, the format when isf. Moves args/argc over whatever the format used.
+void _format_measure_string(_FormatMeasure *m, size_t *argc, TypeInfo **args, bool isf)
+{
+    TypeInfo *current = *args;
+    FormatCache *cache = current->tag == T_FMT ? current->cache : NULL;
+    const char *fmt = cache ? cache->fmt : current->s;
+    if (!fmt) {
+        _format_measure_field(m, isf ? 6 : 7, isf ? 6 : 7);
+        return;
+    }
+    u32 len = cache ? cache->len : (u32)cstrlen((char *)fmt).len;
+    if (!isf) {
+        _format_measure_field(m, len, 0);
+        // the last one gets a space, unless it's print[f]ln's newline
+        if (*argc == 1) _format_measure_field(m, *fmt != '\n', 1);
+        return;
+    }
+    // same resuming as format_string_arg_into_buffer_iter
+    u32 pos = cache ? (u32)current->aux : 0;
+    u32 index = 0;
+    if (cache) {
+        while (index + 1 < cache->count &&
+               cache->segments[index].start + cache->segments[index].len + cache->segments[index].spec_len <= pos) index++;
+    }
+    FormatSegment parsed;
+    for (;; index++) {
+        const FormatSegment *seg = &parsed;
+        if (cache) seg = &cache->segments[index];
+        else       parsed = format_parse_segment(fmt, len, pos);
+        u32 end = seg->start + seg->len;
+        if (pos < end) _format_measure_field(m, end - (pos < seg->start ? seg->start : pos), 0);
+        if (!seg->spec_len) break;
+
+        FormatSpec spec = seg->spec;
+        size_t used = 1 + !!(spec.flags & FMT_WIDTH_ARG) + !!(spec.flags & FMT_PRECISION_ARG);
+        if (seg->arg && *argc > used) {
+            TypeInfo *arg = &(*args)[1];
+            if (spec.flags & (FMT_WIDTH_ARG | FMT_PRECISION_ARG)) arg = _format_star_args(&spec, arg);
+            _format_measure_arg(m, arg, spec);
+            (*args) = &(*args)[used];
+            (*argc) -= used;
+        } else if (seg->arg) {
+            _format_measure_field(m, seg->spec_len, seg->spec_len);
+        }
+        pos = end + seg->spec_len;
+    }
+}
+
+_FormatMeasure _format_measure(size_t argc, TypeInfo *args, bool isf)
+{
+    _FormatMeasure m = {0};
+    while (argc > 0) {
+        _format_measure_field(&m, 0, FORMAT_ARG_ROOM + 1);
+        switch (args->tag) {
+            case T_STR:
+            case T_FMT:
+                _format_measure_string(&m, &argc, &args, isf);
+                break;
+            default:
+                _format_measure_arg(&m, args, FORMAT_SPEC_DEFAULT);
+        }
+        if (!isf && argc > 1) _format_measure_field(&m, 1, 1);
+        args = &args[1];
+        argc--;
+    }
+    return m;
+}
+
+// Exactly how many bytes writef_string_impl would add for these args, without
+// writing or allocating anything. String args come back as slices of themselves.
+size_t format_length(size_t argc, TypeInfo *args, bool isf)
+{
+    if (argc == 1 && args[0].tag == T_STR && args[0].s && !isf) return cstrlen(args[0].s).len;
+    return _format_measure(argc, args, isf).len;
+}
+
 #define PRINT_BUF_SIZE 4096
-void printf_impl(size_t argc, TypeInfo *args, bool isf) 
+void fprintf_impl(int stream, size_t argc, TypeInfo *args, bool isf)
 {
     if (argc == 0) return; // nothing to do 
-#ifdef _WIN32
-    if (!stdio_handles[STDOUT]) {
-        stdio_handles[STDOUT] = GetStdHandle(WIN_STDOUT);
-    }
-#endif
     // shortcut logic if we have 1 string arg to print
-    // send it straight to write
-    if (argc == 1 && args[0].tag == T_STR) {
-        my_println("we're skipping the format logic");
+    // send it straight to write (formats still need their %% unescaping)
+    if (argc == 1 && args[0].tag == T_STR && args[0].s && !isf) {
         string towrite = cstrlen(args[0].s);
-        __write_string(stdio_handles[STDOUT], &towrite);
+        print_write(stream, towrite.data, towrite.len);
         return;
     }
 
+    // Big strings get written from where they are. The format itself only
+    // counts if there's nothing in it to format, and a plain print's last arg
+    // keeps its trailing space so it stays as it was.
+    for (size_t i = 0; i < argc - !isf; i++) {
+        if (!(args[i].tag == T_STR && args[i].s) && args[i].tag != T_STRING) continue;
+        string text = args[i].tag == T_STRING ? (string){ .data = args[i].s, .len = args[i].aux } : cstrlen(args[i].s);
+        if (text.len < PRINT_ZERO_COPY_MIN) continue;
+        if (isf && i == 0 && _impl_load(_memchr_impl)(text.data, text.len, '%') >= 0) continue;
+        args[i] = (TypeInfo){ T_STRREF, .aux = text.len, .s = text.data };
+    }
+
     char _buf[PRINT_BUF_SIZE];
-    string buf = {
-        ._owner = true,
-        .data = _buf,
-        .len = 0,
-        ._cap = PRINT_BUF_SIZE,
+    _PrintGather g = {
+        .buf = {
+            ._owner = true,
+            .data = _buf,
+            ._cap = PRINT_BUF_SIZE,
+        },
+        .handle = _stdio_handle(stream),
     };
-    while (format_args_into_iter(&buf, &argc, &args, isf)) {
-        __write_string(stdio_handles[STDOUT], &buf);
+    _PrintBuffer *pb = &_print_buffers[stream];
+    bool buffered = _print_lock_buffered(pb);
+    if (buffered) {
+        // buffered, format straight into the stream's buffer and only write it out when it's full
+        // (a print that fills it writes it then and there, so the print stays whole)
+        g.buf.data = pb->data;
+        g.buf.len  = pb->len;
+        g.buf._cap = PRINT_BUFFER_SIZE;
+        g.writing  = &pb->writing;
+    }
+    size_t from = g.buf.len;
+    while (format_args_into_iter(&g.buf, &argc, &args, isf)) {
+        _print_gather_flush(&g);
+        from = 0;
+    }
+    if (!buffered) {
+        if (g.count) _print_gather_flush(&g);
+        else if (g.buf.len > 0) __write(g.handle, g.buf.data, g.buf.len);
+        return;
+    }
+    if (g.count) {
+        // anything queued by reference has to go before we hand the args back,
+        // the buffer it's cut from becomes the spare so it can go unlocked
+        _print_spin_lock(&pb->writing);
+        pb->data  = pb->spare;
+        pb->spare = g.buf.data;
+        pb->len   = 0;
+        _print_unlock(pb);
+        g.writing = NULL;
+        _print_gather_flush(&g);
+        _print_spin_unlock(&pb->writing);
+        return;
+    }
+    pb->len = g.buf.len;
+    _print_added_unlock(stream, from);
+}
+
+void printf_impl(size_t argc, TypeInfo *args, bool isf) 
+{
+    fprintf_impl(STDOUT, argc, args, isf);
+}
+
+// Binary log records all start with a u32 size (the whole record) and a u8 kind.
+//   header: kind, version, sizeof(long double), 0, "JPBINLOG"
+//   site:   kind, 0, 0, 0, u64 id, then the format string
+//   event:  kind, isf, u16 argc, then per arg a u8 tag and its value
+// Values are _log_arg_bytes[tag] bytes little endian, strings are a u32 length
+// (_LOG_NULL_STR for NULL) then the bytes and a 0. T_FMT's value is its site id.
+#define _LOG_REC_HEADER 1
+#define _LOG_REC_SITE   2
+#define _LOG_REC_EVENT  3
+#define _LOG_VERSION    1
+#define _LOG_NULL_STR   0xFFFFFFFFu
+
+const u8 _log_arg_bytes[] = {
+    [T_CHAR]    = 1,
+    [T_SCHAR]   = 1,
+    [T_UCHAR]   = 1,
+    [T_SHORT]   = 2,
+    [T_USHORT]  = 2,
+    [T_INT]     = 4,
+    [T_UINT]    = 4,
+    [T_LONG]    = 8,
+    [T_ULONG]   = 8,
+    [T_LLONG]   = 8,
+    [T_ULLONG]  = 8,
+    [T_BOOL]    = 1,
+    [T_FLOAT]   = 8, // stored as a double already
+    [T_DOUBLE]  = 8,
+    [T_LDOUBLE] = sizeof(long double),
+    [T_SIZE]    = 8,
+    [T_PTRDIFF] = 8,
+    [T_WCHAR]   = 4,
+    [T_PTR]     = 8,
+    [T_FMT]     = 8,
+};
+
+size_t _log_value_bytes(u8 tag)
+{
+    return tag < sizeof(_log_arg_bytes) ? _log_arg_bytes[tag] : 0;
+}
+
+bool _log_signed(u8 tag)
+{
+    return tag == T_CHAR || tag == T_SCHAR || tag == T_SHORT || tag == T_INT ||
+           tag == T_LONG || tag == T_LLONG || tag == T_PTRDIFF;
+}
+
+void _log_put_uint(char *out, u64 value, size_t bytes)
+{
+    for (size_t i = 0; i < bytes; i++) out[i] = (char)(value >> (i * 8));
+}
+
+u64 _log_get_uint(const char *in, size_t bytes)
+{
+    u64 value = 0;
+    for (size_t i = 0; i < bytes; i++) value |= (u64)(u8)in[i] << (i * 8);
+    return value;
+}
+
+// Room for len more bytes on the end of buf, returns where they go
+char *_log_grow(string *buf, size_t len)
+{
+    if (buf->len + len > buf->_cap) {
+        size_t cap = buf->_cap ? buf->_cap : 256;
+        while (cap < buf->len + len) cap *= 2;
+        buf->data = (char *)realloc(buf->data, cap);
+        assert(buf->data && "We requested more memory but the computer said \"No\"!");
+        buf->_cap   = cap;
+        buf->_owner = true;
+    }
+    char *at = &buf->data[buf->len];
+    buf->len += len;
+    return at;
+}
+
+// The event record for a log call, what the binary logger does instead of formatting
+void _log_encode(string *buf, size_t argc, TypeInfo *args, bool isf)
+{
+    assert(argc <= 0xFFFF && "Too many args to log!");
+    size_t start = buf->len;
+    char *head = _log_grow(buf, 8);
+    head[4] = _LOG_REC_EVENT;
+    head[5] = isf;
+    _log_put_uint(&head[6], argc, 2);
+    for (size_t i = 0; i < argc; i++) {
+        TypeInfo *arg = &args[i];
+        if (arg->tag == T_STR || arg->tag == T_STRING) {
+            bool null = arg->tag == T_STR && !arg->s;
+            string text = arg->tag == T_STRING ? (string){ .data = arg->s, .len = arg->aux } :
+                          null ? (string){0} : cstrlen(arg->s);
+            char *at = _log_grow(buf, 5 + (null ? 0 : text.len + 1));
+            at[0] = T_STR;
+            _log_put_uint(&at[1], null ? _LOG_NULL_STR : text.len, 4);
+            if (!null) {
+                __builtin_memcpy(&at[5], text.data, text.len);
+                at[5 + text.len] = 0;
+            }
+            continue;
+        }
+        if (arg->tag == T_CUSTOM) {
+            // what they point at might be gone by the time it's decoded, so these become text now
+            _log_grow(buf, 5)[0] = T_STR;
+            size_t text_start = buf->len;
+            TypeInfo rest = *arg;
+            for (size_t want = 256;; want = buf->_cap) {
+                _log_grow(buf, want);
+                buf->len -= want;
+                string field = { ._owner = true, .data = &buf->data[buf->len], ._cap = buf->_cap - buf->len };
+                bool more = _format_arg(&field, &rest, FORMAT_SPEC_DEFAULT);
+                buf->len += field.len;
+                if (!more) break;
+            }
+            _log_put_uint(&buf->data[text_start - 4], buf->len - text_start, 4);
+            *_log_grow(buf, 1) = 0;
+            continue;
+        }
+        size_t bytes = _log_value_bytes((u8)arg->tag);
+        assert(bytes && "Unhandled type!");
+        char *at = _log_grow(buf, 1 + bytes);
+        at[0] = (char)arg->tag;
+        if      (arg->tag == T_LDOUBLE) __builtin_memcpy(&at[1], arg->ld, bytes);
+        else if (arg->tag == T_FMT)     _log_put_uint(&at[1], (u64)(uintptr_t)arg->cache, bytes);
+        else if (arg->tag == T_BOOL)    at[1] = arg->b;
+        else                            _log_put_uint(&at[1], arg->u, bytes);
+    }
+    _log_put_uint(&buf->data[start], buf->len - start, 4);
+}
+
+// Async logging
+//
+// Every thread that logs gets a _LogThread with its own ring. Only that thread
+// allocates from the ring (head) and only the writer thread frees (tail), and
+// since a thread's records come out of the queue in the order they went in the
+// ring is always freed from the back. The queue is Vyukov's intrusive MPSC
+// queue: a push is one exchange plus a store, the writer is the only popper.
+// When a thread exits its ring is retired and the next new thread takes it
+// over, records still queued from it come back the same as ever, so there are
+// only ever as many rings as threads logging at once.
+#ifndef _WIN32
+typedef struct _LogThread _LogThread;
+
+typedef struct _LogRecord {
+    struct _LogRecord *next;  // queue link
+    _LogThread        *owner; // NULL if it was malloc'd (LOG_FULL_GROW)
+    u32                len;
+    u32                size;  // ring bytes to free, including any skipped at the end
+    char               data[];
+} _LogRecord;
+
+struct _LogThread {
+    char       *ring;
+    size_t      cap;
+    u64         head;    // producer only
+    u64         tail;    // writer only, atomic
+    string      scratch; // formatting happens here first, then it's copied in
+    _LogThread *link;    // every thread's state, freed by log_stop
+    bool        retired; // its thread has gone, free for the next one to take
+};
+
+struct {
+    _LogRecord   *head;      // producers push here
+    _LogRecord   *tail;      // writer pops here
+    void         *handle;
+    LogConfig     config;
+    bool          running;
+    u32           generation; // bumped by log_stop so threads know their state is gone
+    size_t        dropped;
+    _LogThread   *threads;
+    pthread_key_t exiting;    // retires the thread's ring when it goes
+    bool          exiting_made;
+    pthread_t     writer;
+    int           file;       // opened from config.path, -1 if we're writing to a stream
+    _LogSites     sites;      // call sites the writer has written out, binary only
+} _log;
+
+_LogRecord _log_stub;
+_Thread_local _LogThread *_log_self;
+_Thread_local u32         _log_self_generation;
+
+void _log_thread_exit(void *self);
+
+void _log_push(_LogRecord *record)
+{
+    record->next = NULL;
+    _LogRecord *prev = __atomic_exchange_n(&_log.head, record, __ATOMIC_ACQ_REL);
+    __atomic_store_n(&prev->next, record, __ATOMIC_RELEASE);
+}
+
+// NULL when empty, or when a producer is half way through a push
+_LogRecord *_log_pop(void)
+{
+    _LogRecord *tail = _log.tail;
+    _LogRecord *next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if (tail == &_log_stub) {
+        if (!next) return NULL;
+        _log.tail = tail = next;
+        next = __atomic_load_n(&next->next, __ATOMIC_ACQUIRE);
+    }
+    if (next) {
+        _log.tail = next;
+        return tail;
+    }
+    if (tail != __atomic_load_n(&_log.head, __ATOMIC_ACQUIRE)) return NULL;
+    _log_push(&_log_stub);
+    next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if (!next) return NULL;
+    _log.tail = next;
+    return tail;
+}
+
+void _log_sleep(long ns)
+{
+    struct timespec t = { .tv_sec = 0, .tv_nsec = ns };
+    nanosleep(&t, NULL);
+}
+
+void _log_release(_LogRecord *record)
+{
+    _LogThread *owner = record->owner;
+    if (!owner) {
+        free(record);
+        return;
+    }
+    __atomic_store_n(&owner->tail, owner->tail + record->size, __ATOMIC_RELEASE);
+}
+
+// The first time the writer sees a call site its format string goes out ahead
+// of the event, straight from the literal. Returns how many iovecs that took.
+int _log_site_iov(const _LogRecord *record, char *head, struct iovec *iov)
+{
+    if (record->len < 17 || (u8)record->data[8] != T_FMT) return 0;
+    u64 id = _log_get_uint(&record->data[9], 8);
+    if (hm_contains(_log.sites, id)) return 0;
+    FormatCache *cache = (FormatCache *)(uintptr_t)id;
+    hm_put(_log.sites, id, (void *)cache);
+    __builtin_memset(head, 0, 16);
+    _log_put_uint(head, 16 + cache->len, 4);
+    head[4] = _LOG_REC_SITE;
+    _log_put_uint(&head[8], id, 8);
+    iov[0] = (struct iovec){ head, 16 };
+    iov[1] = (struct iovec){ (void *)cache->fmt, cache->len };
+    return 2;
+}
+
+// Pops everything it can in batches of PRINT_IOV_MAX, true if it wrote anything
+bool _log_drain(void)
+{
+    bool wrote = false;
+    int need = _log.config.binary ? 3 : 1;
+    for (;;) {
+        _LogRecord *batch[PRINT_IOV_MAX];
+        struct iovec iov[PRINT_IOV_MAX];
+        char sites[PRINT_IOV_MAX / 2][16];
+        int count = 0, records = 0;
+        while (count + need <= PRINT_IOV_MAX && (batch[records] = _log_pop())) {
+            _LogRecord *record = batch[records++];
+            if (_log.config.binary) count += _log_site_iov(record, sites[count / 2], &iov[count]);
+            iov[count++] = (struct iovec){ record->data, record->len };
+        }
+        if (!records) return wrote;
+        __writev(_log.handle, iov, count);
+        for (int i = 0; i < records; i++) _log_release(batch[i]);
+        wrote = true;
+    }
+}
+
+// Nothing to do means sleeping, backing off up to 1ms so an idle logger
+// isn't burning a core. Producers never have to wake us up.
+void *_log_writer(void *unused)
+{
+    (void)unused;
+    long idle = 0;
+    if (_log.config.binary) {
+        char header[16] = { 0, 0, 0, 0, _LOG_REC_HEADER, _LOG_VERSION, sizeof(long double), 0,
+                            'J', 'P', 'B', 'I', 'N', 'L', 'O', 'G' };
+        header[0] = sizeof(header);
+        __write(_log.handle, header, sizeof(header));
+    }
+    for (;;) {
+        if (_log_drain()) {
+            idle = 0;
+            continue;
+        }
+        if (!__atomic_load_n(&_log.running, __ATOMIC_ACQUIRE)) {
+            if (!_log_drain()) break;
+            continue;
+        }
+        idle = idle ? (idle * 2 > 1000000 ? 1000000 : idle * 2) : 20000;
+        _log_sleep(idle);
+    }
+    return NULL;
+}
+
+bool log_start(int stream, LogConfig config)
+{
+    if (__atomic_load_n(&_log.running, __ATOMIC_ACQUIRE)) return false;
+    if (!config.thread_buffer) config.thread_buffer = LOG_THREAD_BUFFER;
+    _log.file   = -1;
+    _log.handle = _stdio_handle(stream);
+    if (config.path) {
+        _log.file = open(config.path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (_log.file < 0) return false;
+        _log.handle = (void *)(intptr_t)_log.file;
+    }
+    if (!_log.exiting_made) _log.exiting_made = !pthread_key_create(&_log.exiting, _log_thread_exit);
+    _log.config  = config;
+    _log.dropped = 0;
+    _log_stub.next = NULL;
+    _log.head = _log.tail = &_log_stub;
+    __atomic_store_n(&_log.running, true, __ATOMIC_RELEASE);
+    if (pthread_create(&_log.writer, NULL, _log_writer, NULL)) {
+        __atomic_store_n(&_log.running, false, __ATOMIC_RELEASE);
+        if (_log.file >= 0) close(_log.file);
+        return false;
+    }
+    return true;
+}
+
+void log_stop(void)
+{
+    if (!__atomic_load_n(&_log.running, __ATOMIC_ACQUIRE)) return;
+    __atomic_store_n(&_log.running, false, __ATOMIC_RELEASE);
+    pthread_join(_log.writer, NULL);
+    if (_log.file >= 0) close(_log.file);
+    hm_free(_log.sites);
+    __atomic_add_fetch(&_log.generation, 1, __ATOMIC_RELEASE);
+    _LogThread *t = __atomic_exchange_n(&_log.threads, NULL, __ATOMIC_ACQ_REL);
+    while (t) {
+        _LogThread *next = t->link;
+        free(t->ring);
+        free(t->scratch.data);
+        free(t);
+        t = next;
+    }
+}
+
+size_t log_dropped(void)
+{
+    return __atomic_load_n(&_log.dropped, __ATOMIC_RELAXED);
+}
+
+_LogThread *_log_thread(void)
+{
+    u32 generation = __atomic_load_n(&_log.generation, __ATOMIC_ACQUIRE);
+    if (_log_self && _log_self_generation == generation) return _log_self;
+    // threads only ever go on the front of the list, so walking it is safe
+    _LogThread *t = __atomic_load_n(&_log.threads, __ATOMIC_ACQUIRE);
+    for (; t; t = t->link) {
+        bool retired = true;
+        if (__atomic_load_n(&t->retired, __ATOMIC_RELAXED) &&
+            __atomic_compare_exchange_n(&t->retired, &retired, false, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) break;
+    }
+    if (!t) {
+        t = (_LogThread *)calloc(1, sizeof(_LogThread));
+        assert(t && "We requested more memory but the computer said \"No\"!");
+        t->cap  = _log.config.thread_buffer;
+        t->ring = (char *)malloc(t->cap);
+        assert(t->ring && "We requested more memory but the computer said \"No\"!");
+        t->link = __atomic_load_n(&_log.threads, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&_log.threads, &t->link, t, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    }
+    if (_log.exiting_made) pthread_setspecific(_log.exiting, t);
+    _log_self = t;
+    _log_self_generation = generation;
+    return t;
+}
+
+// pthread key destructor, hands the ring on unless log_stop already freed it
+void _log_thread_exit(void *self)
+{
+    _LogThread *t = (_LogThread *)self;
+    _log_self = NULL;
+    if (_log_self_generation != __atomic_load_n(&_log.generation, __ATOMIC_ACQUIRE)) return;
+    __atomic_store_n(&t->retired, true, __ATOMIC_RELEASE);
+}
+
+// Space for a record of len bytes in our ring, NULL if it doesn't fit right now
+_LogRecord *_log_reserve(_LogThread *t, size_t len)
+{
+    size_t need = (sizeof(_LogRecord) + len + 7) & ~(size_t)7;
+    size_t offset = t->head % t->cap;
+    // records never wrap, skip whatever's left at the end instead
+    size_t total = offset + need > t->cap ? t->cap - offset + need : need;
+    if (need > t->cap) return NULL;
+    u64 tail = __atomic_load_n(&t->tail, __ATOMIC_ACQUIRE);
+    if (t->cap - (t->head - tail) < total) return NULL;
+    _LogRecord *record = (_LogRecord *)&t->ring[total == need ? offset : 0];
+    record->owner = t;
+    record->size  = (u32)total;
+    t->head += total;
+    return record;
+}
+
+void log_impl(size_t argc, TypeInfo *args, bool isf)
+{
+    if (!__atomic_load_n(&_log.running, __ATOMIC_ACQUIRE)) {
+        fprintf_impl(STDOUT, argc, args, isf);
+        return;
     }
-    if (buf.len > 0) __write_string(stdio_handles[STDOUT], &buf);
+    _LogThread *t = _log_thread();
+    string *buf = &t->scratch;
+    if (!buf->data) {
+        buf->_owner = true;
+        buf->_cap   = 256;
+        buf->data   = (char *)malloc(buf->_cap);
+        assert(buf->data && "We requested more memory but the computer said \"No\"!");
+    }
+    buf->len = 0;
+    if (_log.config.binary) _log_encode(buf, argc, args, isf);
+    else while (format_args_into_iter(buf, &argc, &args, isf)) {
+        buf->data = (char *)realloc(buf->data, buf->_cap * 2);
+        assert(buf->data && "We requested more memory but the computer said \"No\"!");
+        buf->_cap = buf->_cap * 2;
+    }
+
+    // anything up to half the ring fits once the writer has emptied it, wherever head is
+    _LogRecord *record = _log_reserve(t, buf->len);
+    bool fits = sizeof(_LogRecord) + buf->len + 8 <= t->cap / 2;
+    for (int spins = 0; !record && _log.config.on_full == LOG_FULL_BLOCK && fits; spins++) {
+        if (spins < 64) sched_yield();
+        else            _log_sleep(50000);
+        record = _log_reserve(t, buf->len);
+    }
+    if (!record && (_log.config.on_full == LOG_FULL_GROW || (_log.config.on_full == LOG_FULL_BLOCK && !fits))) {
+        // bigger than the whole ring can never block its way in, it gets malloc'd too
+        record = (_LogRecord *)malloc(sizeof(_LogRecord) + buf->len);
+        assert(record && "We requested more memory but the computer said \"No\"!");
+        record->owner = NULL;
+        record->size  = 0;
+    }
+    if (!record) {
+        __atomic_add_fetch(&_log.dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    record->len = (u32)buf->len;
+    __builtin_memcpy(record->data, buf->data, buf->len);
+    _log_push(record);
 }
+#else
+// @Incomplete no writer thread on Windows yet, logging is just printing
+bool   log_start(int stream, LogConfig config) { (void)stream; (void)config; return false; }
+void   log_stop(void) {}
+size_t log_dropped(void) { return 0; }
+void   log_impl(size_t argc, TypeInfo *args, bool isf) { fprintf_impl(STDOUT, argc, args, isf); }
+#endif // _WIN32
+
+int _log_level = LOG_INFO;
 
-// TODO - ability to write raw bytes not converted to human format
+void log_set_level(int level)
+{
+    __atomic_store_n(&_log_level, level, __ATOMIC_RELAXED);
+}
 
 // like sprintf except we know the types and can grow the buffer
+// Most writes fit in what's there (or the first 512, floats want 312 free to
+// start) so they just go. When that runs out the rest gets measured from where
+// it stopped and the buffer grown once to fit it.
 void writef_string_impl(string *dest, size_t argc, TypeInfo *args, bool isf)
 {
     assert("Passed NULL to write_string" && dest);
-    if (!dest->data) {
+    bool copy = argc == 1 && args[0].tag == T_STR && args[0].s && !isf;
+    if (!dest->data && !copy) {
         dest->_owner = true;
-        dest->_cap   = 256;
+        dest->_cap   = 512;
         dest->data   = (char *)malloc(dest->_cap * sizeof(char));
     }
+    if (!dest->data) dest->_owner = true;
     assert(dest->_owner); // @Incomplete this lib should make a copy of and make an owner
-    if (argc == 1 && args[0].tag == T_STR) {
-        my_println("we're skipping the format logic");
-        string towrite = cstrlen(args[0].s);
-        string_copy(dest, towrite);
+    string towrite = copy ? cstrlen(args[0].s) : (string){0};
+    if (!copy && !format_args_into_iter(dest, &argc, &args, isf)) return;
+    size_t need = dest->len + (copy ? towrite.len : _format_measure(argc, args, isf).peak);
+    if (need > dest->_cap) {
+        dest->data = (char *)realloc(dest->data, need * sizeof(char));
+        assert(dest->data && "We requested more memory but the computer said \"No\"!");
+        dest->_cap = need;
+    }
+    if (copy) {
+        __builtin_memcpy(&dest->data[dest->len], towrite.data, towrite.len);
+        dest->len += towrite.len;
         return;
     }
+    // the measure is exact, this is only here in case it ever isn't
     while (format_args_into_iter(dest, &argc, &args, isf)) {
         dest->data = (char*)realloc(dest->data, dest->_cap * 2 * sizeof(char));
         assert("Failed to reallocate string buffer!" && dest->data);
@@ -1135,6 +6164,174 @@ void writef_string_impl(string *dest, size_t argc, TypeInfo *args, bool isf)
     }
 }
 
+// The handlers won't start on a field unless there's room for the biggest it
+// could be, so once buf stops taking them the rest goes through a scratch
+// buffer and whatever fits is copied over. Past the end it's only measured.
+#define FORMAT_INTO_SCRATCH 4096 // the most any field asks for is under this
+size_t format_into(char *buf, size_t cap, size_t argc, TypeInfo *args, bool isf)
+{
+    string out = { .data = buf, ._cap = cap };
+    if (!format_args_into_iter(&out, &argc, &args, isf)) return out.len;
+    size_t need = out.len;
+    char scratch[FORMAT_INTO_SCRATCH];
+    for (;;) {
+        string chunk = { .data = scratch, ._cap = sizeof(scratch) };
+        bool more = format_args_into_iter(&chunk, &argc, &args, isf);
+        size_t n = chunk.len < cap - out.len ? chunk.len : cap - out.len;
+        if (n) __builtin_memcpy(&buf[out.len], scratch, n);
+        out.len += n;
+        need    += chunk.len;
+        if (!more) return need;
+        if (out.len == cap) return need + _format_measure(argc, args, isf).len;
+    }
+}
+
+// Formats straight into the free space at the end of the builder, new chunks
+// are only started when the formatter says it has run out of room
+void sb_append_impl(StringBuilder *sb, size_t argc, TypeInfo *args, bool isf)
+{
+    _SbChunk *chunk = sb->tail;
+    if (!chunk) chunk = _sb_new_chunk(sb);
+    for (;;) {
+        string buf = {
+            ._owner = true,
+            .data   = &chunk->data[chunk->len],
+            ._cap   = chunk->cap - chunk->len,
+        };
+        bool more = format_args_into_iter(&buf, &argc, &args, isf);
+        chunk->len += buf.len;
+        sb->len    += buf.len;
+        if (!more) break;
+        chunk = _sb_new_chunk(sb);
+    }
+}
+
+// One writev per PRINT_IOV_MAX chunks rather than a write each
+size_t sb_flush(StringBuilder *sb, void *dest)
+{
+    size_t written = 0;
+    struct iovec iov[PRINT_IOV_MAX];
+    int count = 0;
+    for (_SbChunk *chunk = sb->head; chunk; chunk = chunk->next) {
+        if (!chunk->len) continue;
+        iov[count++] = (struct iovec){ chunk->data, chunk->len };
+        if (count == PRINT_IOV_MAX || !chunk->next) {
+            written += __writev(dest, iov, count);
+            count = 0;
+        }
+    }
+    if (count) written += __writev(dest, iov, count);
+    sb_reset(sb);
+    return written;
+}
+
+// A call site from a binary log, its format string owned alongside the cache
+typedef struct {
+    FormatCache cache;
+    char        text[];
+} _LogSite;
+
+const char *_log_decode_event(LogDecoder *d, const char *rec, size_t size, StringBuilder *out)
+{
+    bool isf = rec[5];
+    size_t argc = _log_get_uint(&rec[6], 2);
+    if (argc > d->args_cap) {
+        d->args     = (TypeInfo *)realloc(d->args, argc * sizeof(TypeInfo));
+        d->ldoubles = (long double *)realloc(d->ldoubles, argc * sizeof(long double));
+        assert(d->args && d->ldoubles && "We requested more memory but the computer said \"No\"!");
+        d->args_cap = argc;
+    }
+    size_t at = 8;
+    for (size_t i = 0; i < argc; i++) {
+        if (at >= size) return "event is missing args";
+        u8 tag = (u8)rec[at++];
+        TypeInfo *arg = &d->args[i];
+        *arg = (TypeInfo){ .tag = (tag_t)tag };
+        if (tag == T_STR) {
+            if (size - at < 4) return "event is missing args";
+            u32 len = (u32)_log_get_uint(&rec[at], 4);
+            at += 4;
+            if (len == _LOG_NULL_STR) continue;
+            if (size - at <= len || rec[at + len]) return "string arg runs off the end of its event";
+            arg->s = (char *)&rec[at];
+            at += len + 1;
+            continue;
+        }
+        size_t bytes = _log_value_bytes(tag);
+        if (!bytes) return "event has an arg type we don't know";
+        if (size - at < bytes) return "event is missing args";
+        if (tag == T_LDOUBLE) {
+            __builtin_memcpy(&d->ldoubles[i], &rec[at], bytes);
+            arg->ld = &d->ldoubles[i];
+        } else if (tag == T_BOOL) {
+            arg->b = rec[at] != 0;
+        } else if (tag == T_FMT) {
+            void **slot = hm_get(d->sites, _log_get_uint(&rec[at], bytes));
+            if (!slot) return "event for a call site we haven't seen";
+            _LogSite *site = (_LogSite *)*slot;
+            *arg = (TypeInfo){ T_STR, .s = site->text };
+            _format_use_cache(&site->cache, arg);
+        } else {
+            u64 value = _log_get_uint(&rec[at], bytes);
+            if (_log_signed(tag) && bytes < 8) value = (u64)((s64)(value << (64 - bytes * 8)) >> (64 - bytes * 8));
+            arg->u = value;
+        }
+        at += bytes;
+    }
+    sb_append_impl(out, argc, d->args, isf);
+    return NULL;
+}
+
+size_t log_decode(LogDecoder *d, string data, StringBuilder *out)
+{
+    size_t pos = 0;
+    while (!d->error && data.len - pos >= 8) {
+        const char *rec = &data.data[pos];
+        size_t size = _log_get_uint(rec, 4);
+        u8 kind = (u8)rec[4];
+        if (size < 8) d->error = "record is too short";
+        else if (kind == _LOG_REC_HEADER ? size != 16 : !d->header) d->error = "not a binary log";
+        if (d->error) break;
+        if (size > data.len - pos) break; // the rest of it isn't here yet
+        if (kind == _LOG_REC_HEADER) {
+            if (__builtin_memcmp(&rec[8], "JPBINLOG", 8))   d->error = "not a binary log";
+            else if (rec[5] != _LOG_VERSION)               d->error = "binary log version we don't know";
+            else if (rec[6] != sizeof(long double))        d->error = "binary log is from a different kind of machine";
+            else d->header = true;
+        } else if (kind == _LOG_REC_SITE) {
+            if (size < 16) {
+                d->error = "record is too short";
+                break;
+            }
+            size_t len = size - 16;
+            _LogSite *site = (_LogSite *)calloc(1, sizeof(_LogSite) + len + 1);
+            assert(site && "We requested more memory but the computer said \"No\"!");
+            __builtin_memcpy(site->text, &rec[16], len);
+            // a later run logging to the same file can reuse ids
+            u64 id = _log_get_uint(&rec[8], 8);
+            void **old = hm_get(d->sites, id);
+            if (old) free(*old);
+            hm_put(d->sites, id, (void *)site);
+        } else if (kind == _LOG_REC_EVENT) {
+            d->error = _log_decode_event(d, rec, size, out);
+        } else {
+            d->error = "record kind we don't know";
+        }
+        if (d->error) break;
+        pos += size;
+    }
+    return pos;
+}
+
+void log_decoder_free(LogDecoder *d)
+{
+    for (size_t i = 0; hm_next(d->sites, &i); i++) free(d->sites.values[i]);
+    hm_free(d->sites);
+    free(d->args);
+    free(d->ldoubles);
+    *d = (LogDecoder){0};
+}
+
 // IO Implementation
 
 /* -- Prefix macro 
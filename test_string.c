@@ -0,0 +1,1644 @@
+#define _XOPEN_SOURCE 700 // pread, fileno and mkstemp under -std=c11
+#include "jp_basic.h"
+#include <ctype.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+// Custom types for test_format_types
+typedef struct {
+    float x, y;
+} Vec2;
+
+static void format_vec2(FormatWriter *w, const void *value, FormatSpec spec)
+{
+    const Vec2 *v = value;
+    char *out = format_reserve(w, 1);
+    out[0] = '(';
+    format_commit(w, 1);
+    format_arg(w, arg_float(v->x), spec);
+    format_write(w, ", ", 2);
+    format_arg(w, arg_float(v->y), spec);
+    format_write(w, ")", 1);
+}
+
+static TypeInfo arg_vec2(Vec2 *v) { return arg_custom(v, format_vec2); }
+
+typedef dynarray(int) IntList;
+typedef dynarray(Vec2 *) Vec2List;
+TypeInfo arg_IntList(IntList *arr);
+TypeInfo arg_Vec2List(Vec2List *arr);
+
+#undef  JP_FORMAT_TYPES
+#define JP_FORMAT_TYPES Vec2 *: arg_vec2, IntList *: arg_IntList, Vec2List *: arg_Vec2List,
+
+FORMAT_DYNARRAY(IntList)
+FORMAT_DYNARRAY(Vec2List)
+
+
+static void sep(const char *name)
+{
+    printf("--- %s ---\n", name);
+}
+
+// Run every implementation we have rather than just the one picked for this CPU
+static void test_cstrlen(void)
+{
+    sep("cstrlen");
+    char buf[512 + 64];
+    size_t (*impls[])(const char *) = {
+        _cstrlen_scalar,
+#if JP_SIMD_X86
+        _cstrlen_sse2,
+        (cpu_features() & CPU_AVX2)     ? _cstrlen_avx2   : _cstrlen_scalar,
+        (cpu_features() & CPU_AVX512BW) ? _cstrlen_avx512 : _cstrlen_scalar,
+#endif
+    };
+    for (size_t impl = 0; impl < sizeof(impls)/sizeof(impls[0]); impl++) {
+        for (size_t offset = 0; offset < 64; offset++) {
+            for (size_t len = 0; len < 512; len++) {
+                memset(buf, 'x', sizeof(buf));
+                buf[offset + len] = '\0';
+                assert(impls[impl](&buf[offset]) == len);
+            }
+        }
+    }
+    assert(cstrlen("").len == 0);
+    assert(cstrlen("hello").len == 5);
+    printf("ok\n");
+}
+
+static ptrdiff_t naive_find(string h, string n)
+{
+    for (size_t i = 0; i + n.len <= h.len; i++) {
+        if (memcmp(&h.data[i], n.data, n.len) == 0) return i;
+    }
+    return -1;
+}
+
+static void test_indexof(void)
+{
+    sep("string_indexof");
+    // match right at the end used to be missed
+    assert(string_indexof(cstrlen("foobar"), cstrlen("bar")) == 3);
+    assert(string_indexof(cstrlen("foobar"), cstrlen("r")) == 5);
+    assert(string_indexof(cstrlen("foobar"), cstrlen("foobar")) == 0);
+    assert(string_indexof(cstrlen("foobar"), cstrlen("foobarr")) == -1);
+    assert(string_indexof(cstrlen("foobar"), cstrlen("")) == 0);
+    assert(string_contains(cstrlen("a -> b"), cstrlen("->")));
+    assert(string_indexof_char(cstrlen("a -> b"), '>') == 3);
+    assert(string_trim_after(cstrlen("key=value"), "=").len == 3);
+    assert(string_trim_after(cstrlen("key"), "=").len == 3);
+
+    // small alphabet so we get lots of partial matches + periodic needles for Two-Way
+    char hay[4096], needle[128];
+    srand(1234);
+    for (int iter = 0; iter < 20000; iter++) {
+        size_t hlen = rand() % sizeof(hay);
+        size_t nlen = 1 + rand() % (iter % 3 == 0 ? 100 : 12);
+        int alpha = 2 + rand() % 3;
+        for (size_t i = 0; i < hlen; i++) hay[i] = 'a' + rand() % alpha;
+        for (size_t i = 0; i < nlen; i++) needle[i] = 'a' + rand() % alpha;
+        // plant a copy near the end half the time
+        if (iter & 1 && hlen >= nlen) memcpy(&hay[hlen - nlen - (rand() % (hlen - nlen + 1)) / 8], needle, nlen);
+        string h = { .data = hay, .len = hlen };
+        string n = { .data = needle, .len = nlen };
+        assert(_string_find(h.data, h.len, n) == naive_find(h, n));
+        if (nlen > 1) assert(_find_twoway(h.data, h.len, n) == naive_find(h, n));
+        if (nlen > 1) assert(_find_short_scalar(h.data, h.len, n) == naive_find(h, n));
+    }
+
+    // past 2 GiB the int index goes negative, the untouched pages are never really allocated
+    size_t big_len = (1ull << 31) + 4096;
+    char *big = calloc(big_len, 1);
+    if (big) {
+        memcpy(&big[big_len - 100], "needle", 6);
+        string h = { .data = big, .len = big_len };
+        assert(string_find(h, cstrlen("needle")) == (ptrdiff_t)big_len - 100);
+        assert(string_find_char(h, 'n') == (ptrdiff_t)big_len - 100);
+        assert(string_contains(h, cstrlen("needle")) && string_contains(h, cstrlen("dle")));
+        assert(!string_contains(h, cstrlen("needles")));
+        assert(string_trim_after(h, "needle").len == big_len - 100);
+        free(big);
+    }
+    printf("ok\n");
+}
+
+static void test_indexof_any(void)
+{
+    sep("string_indexof_any");
+    string keywords[] = { cstrlen("he"), cstrlen("she"), cstrlen("his"), cstrlen("hers") };
+    StringMatcher m = string_matcher_compile(keywords, 4);
+    u32 id = 0;
+    assert(string_indexof_any(&m, cstrlen("ushers"), &id) == 1 && id == 1);
+    assert(string_indexof_any(&m, cstrlen("xxxx"), &id) == -1);
+
+    // ushers -> she(1), he(2), hers(2)
+    StringMatchIter it = { .m = &m, .haystack = cstrlen("ushers") };
+    StringMatch match;
+    size_t found = 0;
+    while ((match = string_match_iter(&it)).next) found++;
+    assert(found == 3);
+    string_matcher_free(&m);
+
+    // brute force every match with random needle sets
+    char hay[1024];
+    char needle_buf[16][8];
+    string needles[16];
+    srand(4321);
+    for (int iter = 0; iter < 2000; iter++) {
+        size_t count = 1 + rand() % 16;
+        for (size_t i = 0; i < count; i++) {
+            needles[i] = (string){ .data = needle_buf[i], .len = 1 + rand() % 6 };
+            for (size_t j = 0; j < needles[i].len; j++) needle_buf[i][j] = 'a' + rand() % 3;
+        }
+        size_t hlen = rand() % sizeof(hay);
+        for (size_t i = 0; i < hlen; i++) hay[i] = 'a' + rand() % 4;
+        string h = { .data = hay, .len = hlen };
+        m = string_matcher_compile(needles, count);
+
+        size_t expected = 0;
+        ptrdiff_t leftmost = -1;
+        for (size_t i = 0; i < count; i++) {
+            // duplicated needles only report the first id
+            bool dup = false;
+            for (size_t j = 0; j < i; j++) dup |= needles[j].len == needles[i].len && !memcmp(needles[j].data, needles[i].data, needles[i].len);
+            if (dup) continue;
+            for (size_t at = 0; at + needles[i].len <= hlen; at++) {
+                if (memcmp(&hay[at], needles[i].data, needles[i].len)) continue;
+                expected++;
+                if (leftmost < 0 || (ptrdiff_t)at < leftmost) leftmost = at;
+            }
+        }
+        it = (StringMatchIter){ .m = &m, .haystack = h };
+        found = 0;
+        while ((match = string_match_iter(&it)).next) {
+            assert(!memcmp(&hay[match.index], needles[match.id].data, needles[match.id].len));
+            found++;
+        }
+        assert(found == expected);
+        assert(string_indexof_any(&m, h, &id) == leftmost);
+        string_matcher_free(&m);
+    }
+
+    // every byte value used (no spare class 0) and all but one
+    char bytes[256];
+    string singles[256];
+    for (int i = 0; i < 256; i++) {
+        bytes[i] = (char)i;
+        singles[i] = (string){ .data = &bytes[i], .len = 1 };
+    }
+    for (size_t count = 255; count <= 256; count++) {
+        m = string_matcher_compile(singles, count);
+        it = (StringMatchIter){ .m = &m, .haystack = { .data = bytes, .len = 256 } };
+        found = 0;
+        while ((match = string_match_iter(&it)).next) {
+            assert(match.index == found && match.id == found);
+            found++;
+        }
+        assert(found == count);
+        assert(string_indexof_any(&m, (string){ .data = &bytes[200], .len = 56 }, &id) == 0 && id == 200);
+        string_matcher_free(&m);
+    }
+    printf("ok\n");
+}
+
+static void test_split(void)
+{
+    sep("string_split_iter / string_split_all");
+    string source = cstrlen("a->b->c");
+    string arrow = cstrlen("->");
+    string part = string_split_iter(&source, arrow);
+    assert(part.next && part.len == 1 && part.data[0] == 'a');
+    part = string_split_iter(&source, arrow);
+    assert(part.next && part.len == 1 && part.data[0] == 'b');
+    assert(!string_split_iter(&source, arrow).next);
+    assert(source.len == 1 && source.data[0] == 'c');
+
+    StringList fields = string_split_all(cstrlen("a,,b,"), cstrlen(","));
+    assert(fields.len == 4);
+    assert(fields.data[0].len == 1 && fields.data[1].len == 0 && fields.data[2].len == 1 && fields.data[3].len == 0);
+    free(fields.data);
+
+    char buf[2048];
+    srand(99);
+    for (int iter = 0; iter < 5000; iter++) {
+        size_t len = rand() % sizeof(buf);
+        for (size_t i = 0; i < len; i++) buf[i] = "ab,\n"[rand() % 4];
+        string delim = (iter & 1) ? cstrlen(",") : cstrlen(iter & 2 ? ",\n" : "aaa");
+        string h = { .data = buf, .len = len };
+
+        IndexList index = {0};
+        string_indexof_all(h, delim, &index);
+        size_t expected = 0;
+        for (size_t i = 0; i + delim.len <= len;) {
+            if (memcmp(&buf[i], delim.data, delim.len) == 0) {
+                assert(expected < index.len && index.data[expected] == i);
+                expected++;
+                i += delim.len;
+            } else {
+                i++;
+            }
+        }
+        assert(index.len == expected);
+
+        fields = string_split_all(h, delim);
+        assert(fields.len == expected + 1);
+        size_t total = 0;
+        for (size_t i = 0; i < fields.len; i++) total += fields.data[i].len;
+        assert(total + expected * delim.len == len);
+        free(fields.data);
+        free(index.data);
+    }
+    printf("ok\n");
+}
+
+// Every class combination from a few threads at once, before any of the
+// nibble tables exist, so they're racing to build them
+static void *classes_worker(void *arg)
+{
+    char *text = arg;
+    size_t len = cstrlen(text).len;
+    for (int classes = 1; classes < 256; classes++) {
+        for (int member = 0; member < 2; member++) {
+            assert(_span_class_impl(text, len, (u8)classes, member) == _span_class_scalar(text, len, (u8)classes, member));
+        }
+    }
+    return NULL;
+}
+
+static void test_classes(void)
+{
+    sep("character classes");
+    assert(jp_isspace(' ') && jp_isspace('\v') && !jp_isspace('a'));
+    assert(jp_isalpha('q') && jp_isalpha('Q') && !jp_isalpha('1'));
+    assert(jp_isnum('7') && !jp_isnum('a'));
+    assert(jp_ishex('F') && jp_ishex('9') && !jp_ishex('g'));
+    assert(jp_ispunct('!') && !jp_ispunct(' '));
+
+    string trimmed = string_trim_whitespace(cstrlen(" \t  hello world \n"));
+    assert(trimmed.len == 11 && trimmed.data[0] == 'h');
+    assert(string_trim_whitespace(cstrlen("   ")).len == 0);
+    assert(string_skip_whitespace(cstrlen("  x ")).len == 2);
+
+    StringList fields = string_fields(cstrlen("  the quick\tbrown\n\n fox  "));
+    assert(fields.len == 4);
+    assert(fields.data[2].len == 5 && fields.data[2].data[0] == 'b');
+    free(fields.data);
+
+    pthread_t threads[4];
+    char *text = "  \tsome Words, 42 and\n  PUNCTUATION!? \x80\xff end of the line";
+    for (int i = 0; i < 4; i++) pthread_create(&threads[i], NULL, classes_worker, text);
+    for (int i = 0; i < 4; i++) pthread_join(threads[i], NULL);
+
+    char buf[300];
+    srand(7);
+    for (int iter = 0; iter < 20000; iter++) {
+        size_t len = rand() % sizeof(buf);
+        int mode = rand() % 3;
+        for (size_t i = 0; i < len; i++) buf[i] = mode == 0 ? (char)rand() : mode == 1 ? " \t\nab1"[rand() % 6] : ' ';
+        if (len && mode == 2) buf[rand() % len] = (char)rand();
+        u8 classes = (u8)(1 + rand() % 127);
+        for (int member = 0; member < 2; member++) {
+            size_t expected = _span_class_scalar(buf, len, classes, member);
+            assert(_span_class_impl(buf, len, classes, member) == expected);
+#if JP_SIMD_X86
+            assert(_span_class_sse41(buf, len, classes, member) == expected);
+#endif
+        }
+    }
+    printf("ok\n");
+}
+
+static void test_hash(void)
+{
+    sep("string_hash / interning");
+    // reference vectors from wyhash's test suite (seed is the index)
+    assert(string_hash_seed(cstrlen(""), 0) == 0x93228a4de0eec5a2ull);
+    assert(string_hash_seed(cstrlen("a"), 1) == 0xc5bac3db178713c4ull);
+    assert(string_hash_seed(cstrlen("abc"), 2) == 0xa97f2f7b1d9b3314ull);
+    assert(string_hash_seed(cstrlen("message digest"), 3) == 0x786d1f1df3801df4ull);
+    assert(string_hash_seed(cstrlen("abcdefghijklmnopqrstuvwxyz"), 4) == 0xdca5a8138ad37c87ull);
+    assert(string_hash_seed(cstrlen("ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789"), 5) == 0xb9e734f117cfaf70ull);
+    assert(string_hash_seed(cstrlen("12345678901234567890123456789012345678901234567890123456789012345678901234567890"), 6) == 0x6cc5eab49a92d617ull);
+
+    // string_intern straight into an empty interner, and on every grow after
+    StringInterner in = {0};
+    char buf[32];
+    for (int i = 0; i < 100; i++) {
+        int n = snprintf(buf, sizeof(buf), "first_%d", i);
+        string a = string_intern(&in, (string){ .data = buf, .len = n });
+        assert(a.len == (size_t)n && memcmp(a.data, buf, n) == 0 && a.data != buf);
+    }
+    // empty strings don't share an address with the next one
+    string empty = string_intern(&in, cstrlen(""));
+    string abc = string_intern(&in, cstrlen("abc"));
+    assert(empty.len == 0 && empty.data != abc.data);
+    assert(string_intern(&in, (string){ .data = buf, .len = 0 }).data == empty.data);
+    string_interner_free(&in);
+
+    in = (StringInterner){0};
+    for (int i = 0; i < 10000; i++) {
+        int n = snprintf(buf, sizeof(buf), "key_%d", i);
+        assert(string_intern_id(&in, (string){ .data = buf, .len = n }) == (u32)i);
+    }
+    for (int i = 0; i < 10000; i++) {
+        int n = snprintf(buf, sizeof(buf), "key_%d", i);
+        string a = string_intern(&in, (string){ .data = buf, .len = n });
+        assert(a.data == string_interned(&in, i).data);
+        assert(a.len == (size_t)n && memcmp(a.data, buf, n) == 0);
+    }
+    assert(in.strings.len == 10000);
+    static char big[100000];
+    memset(big, 'z', sizeof(big));
+    string big1 = string_intern(&in, (string){ .data = big, .len = sizeof(big) });
+    assert(big1.data == string_intern(&in, (string){ .data = big, .len = sizeof(big) }).data);
+    string_interner_free(&in);
+    printf("ok\n");
+}
+
+static void test_hashmap(void)
+{
+    sep("hashmap");
+    typedef hashmap(string, int) WordCounts;
+    WordCounts counts = {0};
+    StringList words = string_fields(cstrlen("the cat and the dog and the bird"));
+    for (size_t i = 0; i < words.len; i++) {
+        int *count = hm_get(counts, words.data[i]);
+        if (count) (*count)++;
+        else hm_put(counts, words.data[i], 1);
+    }
+    assert(counts.len == 5);
+    assert(*(int *)hm_get(counts, cstrlen("the")) == 3);
+    assert(*(int *)hm_get(counts, cstrlen("and")) == 2);
+    assert(!hm_contains(counts, cstrlen("fish")));
+    // lookups leave the map alone, so they work through a const one
+    const WordCounts *view = &counts;
+    string last = counts._key;
+    assert(*(int *)hm_get(*view, cstrlen("dog")) == 1 && hm_contains(*view, cstrlen("cat")));
+    assert(counts._key.data == last.data && counts._key.len == last.len);
+    size_t seen = 0;
+    for (size_t i = 0; hm_next(counts, &i); i++) seen += counts.values[i];
+    assert(seen == words.len);
+    assert(hm_remove(counts, cstrlen("the")) && !hm_remove(counts, cstrlen("the")));
+    assert(counts.len == 4);
+    hm_free(counts);
+    free(words.data);
+
+    // random ops against a plain array
+    typedef hashmap(u32, u64) IntMap;
+    IntMap map = {0};
+    static u64 reference[4096];
+    static bool present[4096];
+    srand(42);
+    for (int iter = 0; iter < 200000; iter++) {
+        u32 key = rand() % 4096;
+        switch (rand() % 4) {
+        case 0:
+        case 1:
+            hm_put(map, key, (u64)iter);
+            reference[key] = iter;
+            present[key] = true;
+            break;
+        case 2:
+            assert(hm_remove(map, key) == present[key]);
+            present[key] = false;
+            break;
+        case 3: {
+            u64 *value = hm_get(map, key);
+            assert((value != NULL) == present[key]);
+            if (value) assert(*value == reference[key]);
+        } break;
+        }
+    }
+    size_t expected = 0;
+    for (size_t i = 0; i < 4096; i++) expected += present[i];
+    assert(map.len == expected);
+    hm_reserve(map, 100000);
+    assert(map.len == expected);
+    for (u32 i = 0; i < 4096; i++) assert(hm_contains(map, i) == present[i]);
+    hm_free(map);
+    printf("ok\n");
+}
+
+static void test_small_string(void)
+{
+    sep("string layout / SmallString");
+    assert(sizeof(string) == 3 * sizeof(size_t));
+    assert(sizeof(SmallString) == 24);
+    string owner = { ._owner = true, ._cap = 100, .next = true };
+    assert(owner._owner && owner.next && owner._cap == 100);
+
+    SmallString small;
+    assert(small_string_set(&small, cstrlen("content-length")));
+    string view = small_string_view(&small);
+    assert(view.len == 14 && view.data == small.data && view.data[14] == '\0');
+    assert(small_string_set(&small, cstrlen("0123456789012345678901")));
+    assert(!small_string_set(&small, cstrlen("01234567890123456789012")));
+    assert(small.len == 22);
+    printf("ok\n");
+}
+
+static void test_string_builder(void)
+{
+    sep("StringBuilder");
+    StringBuilder sb = {0};
+    static char expected[1 << 20];
+    size_t len = 0;
+    for (int i = 0; i < 20000; i++) {
+        sb_appends(&sb, cstrlen("line "));
+        sb_appendf(&sb, "% -> %\n", i, "value");
+        len += snprintf(&expected[len], sizeof(expected) - len, "line %d -> value\n", i);
+    }
+    sb_write(&sb, "done");
+    len += snprintf(&expected[len], sizeof(expected) - len, "done");
+    assert(sb.len == len);
+
+    string flat = sb_flatten(&sb);
+    assert(flat.len == len && memcmp(flat.data, expected, len) == 0 && flat.data[len] == '\0');
+    free(flat.data);
+
+    sb_reset(&sb);
+    assert(sb.len == 0);
+    bool yes = true;
+    sb_append(&sb, "a", 1, yes);
+    flat = sb_flatten(&sb);
+    assert(flat.len == 8 && memcmp(flat.data, "a 1 true", 8) == 0);
+    free(flat.data);
+    sb_free(&sb);
+    printf("ok\n");
+}
+
+static void test_nocase(void)
+{
+    sep("case insensitive");
+    assert(string_eq_nocase(cstrlen("Content-Length"), cstrlen("content-length")));
+    assert(!string_eq_nocase(cstrlen("Content-Length"), cstrlen("content-lengths")));
+    assert(!string_eq_nocase(cstrlen("[@`{"), cstrlen("{`@[")));
+    assert(string_has_prefix_nocase(cstrlen("HTTP/1.1 200 OK"), cstrlen("http/")));
+    assert(string_indexof_nocase(cstrlen("X-Forwarded-FOR: 1.2.3.4"), cstrlen("for:")) == 12);
+    assert(string_indexof_nocase(cstrlen("abc"), cstrlen("D")) == -1);
+
+    // every byte value against tolower so the SIMD range trick doesn't catch anything extra
+    char a[256], b[256];
+    for (int i = 0; i < 256; i++) { a[i] = (char)i; b[i] = (char)tolower(i); }
+    for (int i = 0; i < 256; i++) {
+        for (int j = 0; j < 256; j++) {
+            bool expected = tolower(i) == tolower(j);
+            assert(string_eq_nocase((string){ .data = &a[i], .len = 1 }, (string){ .data = &a[j], .len = 1 }) == expected);
+        }
+    }
+    assert(string_eq_nocase((string){ .data = a, .len = 256 }, (string){ .data = b, .len = 256 }));
+
+    char hay[1024], needle[40], upper[40];
+    srand(5);
+    for (int iter = 0; iter < 20000; iter++) {
+        size_t hlen = rand() % sizeof(hay);
+        size_t nlen = 1 + rand() % 39;
+        for (size_t i = 0; i < hlen; i++) hay[i] = "aAbB@["[rand() % 6];
+        for (size_t i = 0; i < nlen; i++) { needle[i] = "ab@["[rand() % 4]; upper[i] = toupper(needle[i]); }
+        if (iter & 1 && hlen > nlen) memcpy(&hay[rand() % (hlen - nlen)], upper, nlen);
+        ptrdiff_t expected = -1;
+        for (size_t i = 0; expected < 0 && i + nlen <= hlen; i++) {
+            if (strncasecmp(&hay[i], needle, nlen) == 0) expected = i;
+        }
+        string h = { .data = hay, .len = hlen }, n = { .data = needle, .len = nlen };
+        assert(string_indexof_nocase(h, n) == expected);
+        assert(_find_nocase_scalar(hay, hlen, n) == expected);
+    }
+    printf("ok\n");
+}
+
+static void test_utf8(void)
+{
+    sep("utf8");
+    assert(string_utf8_valid(cstrlen("plain ascii")));
+    assert(string_utf8_valid(cstrlen("h\xc3\xa9llo w\xc3\xb6rld \xe2\x82\xac \xf0\x9f\x98\x80")));
+    assert(string_utf8_count(cstrlen("h\xc3\xa9llo w\xc3\xb6rld \xe2\x82\xac \xf0\x9f\x98\x80")) == 15);
+    const char *bad[] = {
+        "\x80", "\xc3", "\xc0\xaf", "\xe0\x80\xaf", "\xed\xa0\x80", "\xf4\x90\x80\x80",
+        "\xf5\x80\x80\x80", "\xe2\x82", "\xf0\x9f\x98", "\xff", "ok\xc3(", "\xf0\x80\x80\x80",
+    };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        assert(!string_utf8_valid(cstrlen((char *)bad[i])));
+    }
+
+    string s = cstrlen("a\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80\xff");
+    assert(string_utf8_iter(&s) == 'a');
+    assert(string_utf8_iter(&s) == 0xe9);
+    assert(string_utf8_iter(&s) == 0x20ac);
+    assert(string_utf8_iter(&s) == 0x1f600);
+    assert(string_utf8_iter(&s) == RUNE_ERROR);
+    assert(s.len == 0);
+
+    // random valid text with the odd byte flipped, checked against the decoder, and
+    // at every offset so sequences straddle the 16/32 byte blocks
+    u8 buf[300];
+    srand(6);
+    for (int iter = 0; iter < 50000; iter++) {
+        size_t len = 0, runes = 0;
+        size_t target = rand() % 260;
+        while (len < target) {
+            u32 r;
+            switch (rand() % 4) {
+            case 0:  r = rand() % 0x80; break;
+            case 1:  r = 0x80 + rand() % (0x800 - 0x80); break;
+            case 2:  r = 0x800 + rand() % (0x10000 - 0x800); if (r >= 0xd800 && r <= 0xdfff) r = 0xe000; break;
+            default: r = 0x10000 + rand() % (0x110000 - 0x10000); break;
+            }
+            if      (r < 0x80)    { buf[len++] = r; }
+            else if (r < 0x800)   { buf[len++] = 0xc0 | r >> 6;  buf[len++] = 0x80 | (r & 0x3f); }
+            else if (r < 0x10000) { buf[len++] = 0xe0 | r >> 12; buf[len++] = 0x80 | (r >> 6 & 0x3f); buf[len++] = 0x80 | (r & 0x3f); }
+            else { buf[len++] = 0xf0 | r >> 18; buf[len++] = 0x80 | (r >> 12 & 0x3f); buf[len++] = 0x80 | (r >> 6 & 0x3f); buf[len++] = 0x80 | (r & 0x3f); }
+            runes++;
+        }
+        string text = { .data = (char *)buf, .len = len };
+        assert(string_utf8_count(text) == runes);
+        if (iter & 1 && len) buf[rand() % len] = rand();
+
+        bool expected = true;
+        for (string it = text; it.len;) {
+            const char *at = it.data;
+            if (string_utf8_iter(&it) == RUNE_ERROR && !(it.data - at == 3)) expected = false;
+        }
+        assert(_utf8_valid_scalar(text.data, text.len) == expected);
+        assert(string_utf8_valid(text) == expected);
+#if JP_SIMD_X86
+        if (cpu_features() & CPU_SSE42) assert(_utf8_valid_sse41(text.data, text.len) == expected);
+        if (cpu_features() & CPU_AVX2)  assert(_utf8_valid_avx2(text.data, text.len) == expected);
+#endif
+        assert(string_utf8_count(text) == _utf8_count_scalar(text.data, text.len));
+    }
+    printf("ok\n");
+}
+
+static u64 rand64(void)
+{
+    return (u64)rand() << 62 ^ (u64)rand() << 31 ^ (u64)rand();
+}
+
+static void check_f64(const char *text)
+{
+    double got = 0, expected = strtod(text, NULL);
+    string source = cstrlen((char *)text);
+    assert(string_parse_f64(source, &got) == source.len);
+    // bit for bit, so -0.0 and the infinities count, any NaN matches any other
+    if (got == got || expected == expected) assert(memcmp(&got, &expected, sizeof(got)) == 0);
+}
+
+static void test_parse(void)
+{
+    sep("number parsing");
+    u64 u = 7;
+    s64 i = 7;
+    assert(string_parse_u64(cstrlen("12345678901234567890xyz"), &u) == 20 && u == 12345678901234567890ull);
+    assert(string_parse_u64(cstrlen("18446744073709551615"), &u) == 20 && u == U64_MAX);
+    u = 7;
+    assert(string_parse_u64(cstrlen("18446744073709551616"), &u) == 0 && u == 7);
+    assert(string_parse_u64(cstrlen("-1"), &u) == 0);
+    assert(string_parse_u64(cstrlen(""), &u) == 0);
+    assert(string_parse_u64(cstrlen("00000000000000000000000042,"), &u) == 26 && u == 42);
+    assert(string_parse_s64(cstrlen("-9223372036854775808"), &i) == 20 && i == INT64_MIN);
+    assert(string_parse_s64(cstrlen("+9223372036854775807 "), &i) == 20 && i == INT64_MAX);
+    assert(string_parse_s64(cstrlen("9223372036854775808"), &i) == 0);
+    assert(string_parse_s64(cstrlen("-"), &i) == 0);
+    assert(sizeof(s32) == 4 && sizeof(s64) == 8);
+
+    char buf[64];
+    srand(7);
+    for (int iter = 0; iter < 100000; iter++) {
+        u64 v = rand64() >> (rand() % 64);
+        snprintf(buf, sizeof(buf), "%llu", (unsigned long long)v);
+        assert(string_parse_u64(cstrlen(buf), &u) == strlen(buf) && u == v);
+        s64 sv = (s64)rand64() >> (rand() % 64);
+        snprintf(buf, sizeof(buf), "%lld", (long long)sv);
+        assert(string_parse_s64(cstrlen(buf), &i) == strlen(buf) && i == sv);
+    }
+
+    double d;
+    assert(string_parse_f64(cstrlen("1.5e3,"), &d) == 5 && d == 1500);
+    assert(string_parse_f64(cstrlen("2e"), &d) == 1 && d == 2);
+    assert(string_parse_f64(cstrlen(".5"), &d) == 2 && d == 0.5);
+    assert(string_parse_f64(cstrlen("5."), &d) == 2 && d == 5);
+    assert(string_parse_f64(cstrlen("-Infinity"), &d) == 9 && d == -__builtin_inf());
+    assert(string_parse_f64(cstrlen("nan"), &d) == 3 && d != d);
+    assert(string_parse_f64(cstrlen("."), &d) == 0);
+    assert(string_parse_f64(cstrlen("e5"), &d) == 0);
+    const char *edge[] = {
+        "0", "-0", "1e308", "1.7976931348623157e308", "1.7976931348623159e308", "2e308",
+        "4.9406564584124654e-324", "2.4703282292062327e-324", "2.4703282292062328e-324", "1e-400",
+        "2.2250738585072011e-308", "2.2250738585072014e-308", "9007199254740993", "9007199254740992.5",
+        "7.2057594037927933e16", "1152921504606846976", "0.1", "3.14159265358979323846264338327950288",
+        "0.000000000000000000000000000000000000001", "123456789012345678901234567890e-10",
+        "2.22507385850720113605740979670913197593481954635164564e-308",
+        "1.00000000000000011102230246251565404236316680908203125",
+        "1.00000000000000011102230246251565404236316680908203124",
+        "1.00000000000000011102230246251565404236316680908203126",
+        // 2^-1075, halfway between 0 and the smallest subnormal
+        "2.4703282292062327208828439643411068618252990130716238221279284125033775363510437593264991818081799618989828234772285886546332835517796989819938739800539093906315035659515570226392290858392449105184435931802849936536152500319370457678249219365623669863658480757001585769269903706311928279558551332927834338409351978015531246597263579574622766465272827220056374006485499977096599470454020828166226237857393450736339007967761930577506740176324673600968951340535537458516661134223766678604162159680461914467291840300530057530849048765391711386591646239524912623653881879636239373280423891018672348497668235089863388587925628302755995657524455507255189313690836254779186948667994968324049705821028513185451396213837722826145437693412532098591327667236328125e-324",
+        "2.47032822920623272088284396434110686182529901307162382212792841250337753635104375932649918180817996189898282347722858865463328355177969898199387398005390939063150356595155702263922908583924491051844359318028499365361525003193704576782492193656236698636584807570015857692699037063119282795585513329278343384093519780155312465972635795746227664652728272200563740064854999770965994704540208281662262378573934507363390079677619305775067401763246736009689513405355374585166611342237666786041621596804619144672918403005300575308490487653917113865916462395249126236538818796362393732804238910186723484976682350898633885879256283027559956575244555072551893136908362547791869486679949683240497058210285131854513962138377228261454376934125320985913276672363281251e-324",
+        "1e-325", "4.9e-324", "2.4703282292062327e-324",
+    };
+    for (size_t e = 0; e < sizeof(edge) / sizeof(edge[0]); e++) check_f64(edge[e]);
+
+    for (int iter = 0; iter < 200000; iter++) {
+        // round trips of random doubles, and random digit strings that aren't
+        u64 bits = rand64();
+        __builtin_memcpy(&d, &bits, sizeof(d));
+        if (iter & 1) snprintf(buf, sizeof(buf), "%.17g", d);
+        else          snprintf(buf, sizeof(buf), "%.*e", rand() % 25, d);
+        check_f64(buf);
+        int n = 0, ndigits = 1 + rand() % 30, dot = rand() % (ndigits + 1);
+        for (int k = 0; k < ndigits; k++) {
+            if (k == dot) buf[n++] = '.';
+            buf[n++] = '0' + rand() % 10;
+        }
+        n += snprintf(&buf[n], sizeof(buf) - n, "e%d", rand() % 700 - 350);
+        check_f64(buf);
+    }
+
+    // exactly halfway between two doubles, and a hair either side, which
+    // takes every digit to decide (long double holds the midpoint exactly)
+    char half[1100];
+    for (int iter = 0; iter < 2000; iter++) {
+        u64 bits = rand64() & ~(1ull << 63), next_bits;
+        if (iter & 1) bits &= (1ull << 52) - 1; // subnormals
+        if (bits >= 0x7fefffffffffffffull) continue;
+        double next;
+        next_bits = bits + 1;
+        __builtin_memcpy(&d, &bits, sizeof(d));
+        __builtin_memcpy(&next, &next_bits, sizeof(next));
+        int len = snprintf(half, sizeof(half), "%.800Le", ((long double)d + next) / 2);
+        int e = (int)(strchr(half, 'e') - half), exp_len = len - e + 1;
+        while (half[e - 1] == '0') memmove(&half[e - 1], &half[e], exp_len), e--;
+        check_f64(half);
+        memmove(&half[e + 1], &half[e], exp_len);
+        half[e] = '1';
+        check_f64(half);
+        memmove(&half[e], &half[e + 1], exp_len);
+        if (half[e - 1] != '.' && half[e - 1] != '0') {
+            half[e - 1]--;
+            check_f64(half);
+        }
+    }
+    printf("ok\n");
+}
+
+static void test_format_int(void)
+{
+    sep("integer formatting");
+    char out[256], expected[256];
+    string buf = { .data = out, ._cap = sizeof(out) };
+    format_s64(&buf, INT64_MIN, FORMAT_SPEC_DEFAULT);
+    format_u64(&buf, U64_MAX, FORMAT_SPEC_DEFAULT);
+    format_u64(&buf, 0, FORMAT_SPEC_DEFAULT);
+    assert(buf.len == 41 && memcmp(out, "-9223372036854775808184467440737095516150", 41) == 0);
+
+    size_t n = format_int(out, 255, false, (FormatSpec){ .base = 2, .precision = -1, .flags = FMT_ALT });
+    assert(n == 10 && memcmp(out, "0b11111111", n) == 0);
+    n = format_int(out, 35 * 36 + 1, false, (FormatSpec){ .base = 36, .precision = -1, .flags = FMT_UPPER });
+    assert(n == 2 && memcmp(out, "Z1", n) == 0);
+    n = format_int(out, 37, false, (FormatSpec){ .base = 38, .precision = -1 });
+    assert(n == 1 && out[0] == '#');
+
+    // either side of every digit count, the digits go out in whole 8/16 byte
+    // stores so check nothing lands past the 20 bytes it's allowed
+    for (int digits = 1; digits <= 20; digits++) {
+        u64 edge = digits == 20 ? U64_MAX : _pow10_u64[digits] - 1;
+        for (int k = 0; k < 3; k++) {
+            u64 v = k == 0 ? edge : k == 1 ? edge + 1 - (digits == 20) : edge / 7;
+            memset(out, '#', 32);
+            n = _write_u64_dec(out, v);
+            int len = snprintf(expected, sizeof(expected), "%llu", (unsigned long long)v);
+            assert(n == (size_t)len && memcmp(out, expected, n) == 0 && out[20] == '#');
+        }
+    }
+    // the print path writes plain ints without going through format_int
+    string printed = {0};
+    long long mixed[8] = { 0, -1, 9, -10, INT64_MIN, INT64_MAX, 12345678, -123456789012345678 };
+    write_string(&printed, mixed[0], mixed[1], mixed[2], mixed[3], mixed[4], mixed[5], mixed[6], mixed[7],
+                  (unsigned char)255, (short)-32768, (size_t)U64_MAX);
+    const char *all = "0 -1 9 -10 -9223372036854775808 9223372036854775807 12345678 -123456789012345678 "
+                      "255 -32768 18446744073709551615";
+    assert(printed.len == strlen(all) && memcmp(printed.data, all, printed.len) == 0);
+    free(printed.data);
+
+    // everything snprintf can also do
+    const char conv[] = "duxXo";
+    u8 bases[] = { 10, 10, 16, 16, 8 };
+    srand(8);
+    for (int iter = 0; iter < 200000; iter++) {
+        u64 v = rand64() >> (rand() % 64);
+        int c = rand() % 5;
+        bool negative = c == 0 && (v >> 1) && (rand() & 1);
+        FormatSpec spec = { .base = bases[c], .precision = (rand() % 3) ? -1 : rand() % 25 };
+        spec.flags = rand() & (FMT_LEFT | FMT_ZERO | FMT_ALT | (c == 0 ? FMT_SIGN | FMT_SPACE : 0));
+        if (c == 3) spec.flags |= FMT_UPPER;
+        if (c == 0) spec.flags &= ~FMT_ALT;
+        spec.width = (rand() % 3) ? 0 : rand() % 40;
+
+        char fmt[32], *f = fmt;
+        *f++ = '%';
+        if (spec.flags & FMT_LEFT)  *f++ = '-';
+        if (spec.flags & FMT_SIGN)  *f++ = '+';
+        if (spec.flags & FMT_SPACE) *f++ = ' ';
+        if (spec.flags & FMT_ZERO)  *f++ = '0';
+        if (spec.flags & FMT_ALT)   *f++ = '#';
+        f += sprintf(f, "%d", spec.width);
+        if (spec.precision >= 0) f += sprintf(f, ".%d", spec.precision);
+        sprintf(f, "ll%c", conv[c]);
+        #pragma GCC diagnostic push
+        #pragma GCC diagnostic ignored "-Wformat-nonliteral"
+        int len = c == 0 ? snprintf(expected, sizeof(expected), fmt, negative ? -(long long)(v >> 1) : (long long)(v >> 1))
+                         : snprintf(expected, sizeof(expected), fmt, (unsigned long long)v);
+        #pragma GCC diagnostic pop
+        n = format_int(out, c == 0 ? v >> 1 : v, negative, spec);
+        if (n != (size_t)len || memcmp(out, expected, n) != 0) {
+            fprintf(stderr, "%s: expected '%s' got '%.*s'\n", fmt, expected, (int)n, out);
+            assert(0);
+        }
+    }
+    printf("ok\n");
+}
+
+static void check_shortest(double d)
+{
+    char out[64];
+    string buf = { .data = out, ._cap = sizeof(out) };
+    format_f64(&buf, d, -1);
+    out[buf.len] = '\0';
+    double back = strtod(out, NULL);
+    if (memcmp(&back, &d, sizeof(d)) != 0) {
+        fprintf(stderr, "%.17g -> %s doesn't round trip\n", d, out);
+        assert(0);
+    }
+    // no %.Ng with fewer significant digits round trips
+    // significant digits, first to last nonzero
+    size_t digits = 0, run = 0;
+    bool started = false;
+    for (size_t i = 0; i < buf.len && out[i] != 'e'; i++) {
+        if (out[i] < '0' || out[i] > '9') continue;
+        started |= out[i] != '0';
+        if (!started) continue;
+        run++;
+        if (out[i] != '0') digits = run;
+    }
+    char shorter[400];
+    for (int p = 1; p < (int)digits; p++) {
+        snprintf(shorter, sizeof(shorter), "%.*g", p, d);
+        back = strtod(shorter, NULL);
+        if (memcmp(&back, &d, sizeof(d)) == 0) {
+            fprintf(stderr, "%s is shorter than %s\n", shorter, out);
+            assert(0);
+        }
+    }
+}
+
+static void test_format_float(void)
+{
+    sep("float formatting");
+    static char out[2048], expected[2048];
+    string buf = { .data = out, ._cap = sizeof(out) };
+    format_f64(&buf, 420.69, -1);
+    format_f64(&buf, 0.1, -1);
+    format_f64(&buf, 1e21, -1);
+    format_f64(&buf, -5e-324, -1);
+    format_f64(&buf, 1.0 / 0.0, -1);
+    format_f64(&buf, 0.0 / 0.0, -1);
+    format_f64(&buf, -0.0, -1);
+    format_f64(&buf, 123456789012345680.0, -1);
+    format_f64(&buf, 0.0001, -1);
+    out[buf.len] = '\0';
+    assert(strcmp(out, "420.690.11e+21-5e-324infnan-01.2345678901234568e+170.0001") == 0);
+
+    const double edge[] = { 1, 2, 10, 100, 1e16, 1e17, 9007199254740993.0, 1.7976931348623157e308,
+                            2.2250738585072014e-308, 2.2250738585072009e-308, 0.3, 2.675, 1e-5, 5e-324 };
+    for (size_t i = 0; i < sizeof(edge) / sizeof(edge[0]); i++) check_shortest(edge[i]);
+
+    srand(9);
+    for (int iter = 0; iter < 50000; iter++) {
+        u64 bits = rand64();
+        double d;
+        __builtin_memcpy(&d, &bits, sizeof(d));
+        if (d != d || d - d != 0) continue;
+        check_shortest(d);
+        // powers of two have the lopsided rounding interval
+        bits &= ~((1ull << 52) - 1);
+        __builtin_memcpy(&d, &bits, sizeof(d));
+        if (d - d == 0) check_shortest(d);
+    }
+
+    // %.Nf against libc, small and huge values and precisions
+    for (int iter = 0; iter < 30000; iter++) {
+        double d;
+        if (iter % 3 == 0) {
+            u64 bits = rand64();
+            __builtin_memcpy(&d, &bits, sizeof(d));
+        } else {
+            d = (double)(rand64() >> (rand() % 64)) / (double)(1ull << (rand() % 64));
+            if (rand() & 1) d = -d;
+        }
+        int precision = iter % 50 == 0 ? rand() % 1100 : rand() % 25;
+        buf.len = 0;
+        format_f64(&buf, d, precision);
+        int len = snprintf(expected, sizeof(expected), "%.*f", precision, d);
+        if (d != d) len = snprintf(expected, sizeof(expected), "nan");
+        if (buf.len != (size_t)len || memcmp(out, expected, len) != 0) {
+            fprintf(stderr, "%%.%df: expected '%s' got '%.*s'\n", precision, expected, (int)buf.len, out);
+            assert(0);
+        }
+    }
+    printf("ok\n");
+}
+
+static string sb_take(StringBuilder *sb)
+{
+    string flat = sb_flatten(sb);
+    sb_reset(sb);
+    return flat;
+}
+
+static void test_format_cache(void)
+{
+    sep("format call site cache");
+    StringBuilder sb = {0};
+    char *dynamic = "[%] 100%% of % and %";
+    static char big[10000];
+    memset(big, 'x', sizeof(big) - 1);
+
+    for (int i = 0; i < 3; i++) {
+        // same text cached (literal) and uncached (variable), the first call fills the cache
+        sb_appendf(&sb, "[%] 100%% of % and %", i, big, -1);
+        string cached = sb_take(&sb);
+        sb_appendf(&sb, dynamic, i, big, -1);
+        string uncached = sb_take(&sb);
+        assert(cached.len == uncached.len && memcmp(cached.data, uncached.data, cached.len) == 0);
+        assert(cached.len == 12 + sizeof(big) - 1 + 7);
+        assert(memcmp(cached.data, "[", 1) == 0 && memcmp(&cached.data[cached.len - 7], " and -1", 7) == 0);
+        free(cached.data);
+        free(uncached.data);
+    }
+
+    // the cache is per call site and the fill happens once
+    for (int i = 0; i < 2; i++) {
+        sb_appendf(&sb, "% missing %\n", i);
+        string flat = sb_take(&sb);
+        char expected[32];
+        int n = snprintf(expected, sizeof(expected), "%d missing %%\n", i);
+        assert(flat.len == (size_t)n && memcmp(flat.data, expected, n) == 0);
+        free(flat.data);
+    }
+
+    // more placeholders than the cache holds still works, just uncached
+    sb_appendf(&sb, "%,%,%,%,%,%,%,%,%,%,%,%,%,%,%,%,%,%", 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18);
+    string flat = sb_take(&sb);
+    assert(flat.len == 44 && memcmp(flat.data, "1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16,17,18", 44) == 0);
+    free(flat.data);
+
+    // chunk refills part way through cached literals
+    for (int i = 0; i < 2000; i++) sb_appendf(&sb, "a fairly long literal run before the value % and after it\n", i);
+    flat = sb_take(&sb);
+    size_t pos = 0;
+    for (int i = 0; i < 2000; i++) {
+        char expected[96];
+        int n = snprintf(expected, sizeof(expected), "a fairly long literal run before the value %d and after it\n", i);
+        assert(memcmp(&flat.data[pos], expected, n) == 0);
+        pos += n;
+    }
+    assert(pos == flat.len);
+    free(flat.data);
+
+    // a cache filled from one text is never used for another
+    for (int i = 0; i < 4; i++) {
+        sb_appendf(&sb, (i & 1) ? "odd %\n" : "even % and more\n", i);
+        flat = sb_take(&sb);
+        char expected[32];
+        int n = snprintf(expected, sizeof(expected), (i & 1) ? "odd %d\n" : "even %d and more\n", i);
+        assert(flat.len == (size_t)n && memcmp(flat.data, expected, n) == 0);
+        free(flat.data);
+    }
+    FormatCache cache = {0};
+    TypeInfo args[] = { { .tag = T_STR, .s = "% one" }, { .tag = T_STR, .s = "% two" } };
+    _format_use_cache(&cache, &args[0]);
+    _format_use_cache(&cache, &args[1]);
+    assert(args[0].tag == T_FMT && args[1].tag == T_STR);
+    sb_free(&sb);
+    printf("ok\n");
+}
+
+static void check_spec(StringBuilder *sb, const char *expected, int n)
+{
+    string flat = sb_take(sb);
+    if (flat.len != (size_t)n || memcmp(flat.data, expected, n) != 0) {
+        fprintf(stderr, "expected [%s] got [%.*s]\n", expected, (int)flat.len, flat.data);
+        assert(0);
+    }
+    free(flat.data);
+}
+
+static void test_format_spec(void)
+{
+    sep("format specs");
+    StringBuilder sb = {0};
+    char fmt[64], expected[2048];
+    const char *flags = "-+ 0#";
+    const char *convs = "dxXo";
+    const char *strings[] = { "", "a", "hello", "a longer string than most widths" };
+
+    for (int iter = 0; iter < 20000; iter++) {
+        // random printf specs, the text is the same for both so it's also testing the parser
+        int n = 0;
+        fmt[n++] = '<';
+        fmt[n++] = '%';
+        for (int i = 0; i < 5; i++) if (rand() % 3 == 0) fmt[n++] = flags[i];
+        if (rand() % 2) n += sprintf(&fmt[n], "%d", 1 + rand() % 30);
+        if (rand() % 3 == 0) n += sprintf(&fmt[n], ".%d", rand() % 25);
+        fmt[n] = 0;
+        int kind = rand() % 4;
+        if (kind == 0) {
+            fmt[n++] = convs[rand() % 4];
+            strcpy(&fmt[n], ">");
+            int value = (int)rand64();
+            if (rand() % 4 == 0) value = rand() % 3 - 1;
+            sb_appendf(&sb, fmt, value);
+            check_spec(&sb, expected, snprintf(expected, sizeof(expected), fmt, value));
+        } else if (kind == 1) {
+            if (!strchr(fmt, '.')) n += sprintf(&fmt[n], ".%d", rand() % 20);
+            strcpy(&fmt[n], "f>");
+            if (strchr(fmt, '#')) continue; // # forces a '.' in printf, we don't do that
+            double value = (double)(s64)rand64() / (double)(1ll << (rand() % 62));
+            if (rand() % 8 == 0) value = rand() % 2 ? -0.0 : -1.0 / 0.0;
+            sb_appendf(&sb, fmt, value);
+            check_spec(&sb, expected, snprintf(expected, sizeof(expected), fmt, value));
+        } else if (kind == 3) {
+            // %g only means printf's significant digits with a precision, without one it's the shortest
+            if (!strchr(fmt, '.')) n += sprintf(&fmt[n], ".%d", rand() % 20);
+            fmt[n++] = "eEgG"[rand() % 4];
+            strcpy(&fmt[n], ">");
+            double value = (double)(s64)rand64() / (double)(1ll << (rand() % 62));
+            if (rand() % 2) value = rand() % 2 ? value * 1e-300 * (rand() % 1000) : value * 1e200 * (rand() % 1000);
+            if (rand() % 8 == 0) value = rand() % 2 ? -0.0 : 0.5 + rand() % 8;
+            if (rand() % 16 == 0) value = rand() % 2 ? 1.0 / 0.0 : 4.9e-324;
+            sb_appendf(&sb, fmt, value);
+            check_spec(&sb, expected, snprintf(expected, sizeof(expected), fmt, value));
+        } else {
+            strcpy(&fmt[n], "s>");
+            const char *value = strings[rand() % 4];
+            sb_appendf(&sb, fmt, (char *)value);
+            check_spec(&sb, expected, snprintf(expected, sizeof(expected), fmt, value));
+        }
+    }
+
+    // cached literals, dynamic * args and printf length modifiers
+    for (int i = 0; i < 2; i++) {
+        sb_appendf(&sb, "[%*d|%-*.*f|%.*s|%*s]", 6, 42, 10, 2, 3.14159, 3, "abcdef", -4, "ab");
+        check_spec(&sb, expected, snprintf(expected, sizeof(expected), "[%*d|%-*.*f|%.*s|%*s]", 6, 42, 10, 2, 3.14159, 3, "abcdef", -4, "ab"));
+        sb_appendf(&sb, "%lld %lu %hhd %zu", 1ll, 2ul, 3, (size_t)4);
+        check_spec(&sb, "1 2 3 4", 7);
+    }
+
+    // the things printf doesn't have
+    sb_appendf(&sb, "%b|%#b|%Us|%U|%5|%-5|%.3", 5, 5, "up", (bool)true, 1, 2, 2.0);
+    check_spec(&sb, "101|0b101|UP|TRUE|    1|2    |2.000", 35);
+    sb_appendf(&sb, "%x %o|%c%d", (signed char)-1, (short)-1, 65, 'A');
+    check_spec(&sb, "ff 177777|A65", 13);
+    sb_appendf(&sb, "%p %p|%08.3|%08", (void *)0x1234, (void *)0, -1.5, -1.0 / 0.0);
+    check_spec(&sb, "0x1234 (nil)|-001.500|    -inf", 30);
+
+    // %e and %g round on the exact value, ties to even, and 9.99 can carry into the exponent
+    double cases[] = { 1.5, 3.14159, 0.1, 2.5, 0.125, 9.9999999, 999999.5, 1e-5, 0.0001, 123456789.0, 1e100, 5e-324, 1.7976931348623157e308 };
+    const char *fmts[] = { "%e", "%.0e", "%.3e", "%.20E", "%.3g", "%.0g", "%.6g", "%.17g", "%#.3g", "%#.0e", "%-12.2G|", "%+.1e" };
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        for (size_t f = 0; f < sizeof(fmts) / sizeof(fmts[0]); f++) {
+            for (int sign = 0; sign < 2; sign++) {
+                double value = sign ? -cases[c] : cases[c];
+                sb_appendf(&sb, fmts[f], value);
+                check_spec(&sb, expected, snprintf(expected, sizeof(expected), fmts[f], value));
+            }
+        }
+    }
+    long double third = 1.0L / 3;
+    sb_appendf(&sb, "%.10e|%.5g|%e", third, third, (long double)0.5);
+    check_spec(&sb, expected, snprintf(expected, sizeof(expected), "%.10Le|%.5Lg|%Le", third, third, 0.5L));
+    sb_appendf(&sb, "%F|%.2F", 1.0 / 0.0, 1.5);
+    check_spec(&sb, "INF|1.50", 8);
+
+    // ones we don't do are left as they were written, and bare letters are still words
+    sb_appendf(&sb, "%.3a|%5n|%each|%Fahrenheit", 1, 2);
+    check_spec(&sb, "%.3a|%5n|1each|2Fahrenheit", 26);
+
+    // a space usually just ends the placeholder
+    sb_appendf(&sb, "% of %. % <- % d|%Users|%dms", 1, 2, 3, 4, 5, 6);
+    check_spec(&sb, "1 of 2. 3 <-  4|5Users|6ms", 26);
+    sb_appendf(&sb, "missing %-5d and %*d", 1);
+    check_spec(&sb, "missing 1     and %*d", 21);
+
+    // truncated and padded strings crossing chunk boundaries
+    static char big[10000];
+    memset(big, 'y', sizeof(big) - 1);
+    for (int i = 0; i < 2; i++) {
+        sb_appendf(&sb, "%.6000s|%1000s|", big, "z");
+        string flat = sb_take(&sb);
+        assert(flat.len == 6000 + 1 + 1000 + 1);
+        assert(flat.data[5999] == 'y' && flat.data[6000] == '|' && flat.data[6001] == ' ' && flat.data[7000] == 'z');
+        free(flat.data);
+    }
+    sb_free(&sb);
+    printf("ok\n");
+}
+
+// Points stdout at a temp file so we can see exactly when the writes happen
+static size_t stdout_written(int fd, char *out, size_t cap)
+{
+    off_t end = lseek(fd, 0, SEEK_END);
+    if (out) assert(pread(fd, out, cap, 0) == (ssize_t)(end < (off_t)cap ? end : (off_t)cap));
+    return (size_t)end;
+}
+
+static FILE *captured;
+static int   captured_saved;
+
+// Returns the temp file's fd for stdout_written
+static int capture_stdout(void)
+{
+    fflush(stdout);
+    captured = tmpfile();
+    assert(captured);
+    int fd = fileno(captured);
+    captured_saved = dup(1);
+    assert(dup2(fd, 1) == 1);
+    return fd;
+}
+
+static void restore_stdout(void)
+{
+    assert(dup2(captured_saved, 1) == 1);
+    close(captured_saved);
+    fclose(captured);
+    captured = NULL;
+}
+
+static void test_print_buffered(void)
+{
+    sep("buffered printing");
+    int fd = capture_stdout();
+    char out[256];
+
+    print_buffered(STDOUT, FLUSH_FULL);
+    my_printfln("line %", 1);
+    my_println("two", 2);
+    my_print("three");
+    assert(stdout_written(fd, NULL, 0) == 0);
+    print_flush();
+    size_t n = stdout_written(fd, out, sizeof(out));
+    assert(n == 19 && memcmp(out, "line 1\ntwo 2 \nthree", n) == 0);
+
+    // line mode writes once a print has put a newline in
+    print_buffered(STDOUT, FLUSH_LINE);
+    my_printf("% and ", 1);
+    print_write(STDOUT, "raw", 3);
+    assert(stdout_written(fd, NULL, 0) == 19);
+    my_printfln(" %", 2.5);
+    n = stdout_written(fd, out, sizeof(out));
+    assert(n == 19 + 14 && memcmp(&out[19], "1 and raw 2.5\n", 14) == 0);
+
+    // more than the buffer holds goes out in big writes as it fills
+    print_buffered(STDOUT, FLUSH_FULL);
+    for (int i = 0; i < 20000; i++) my_printf("<%>", i);
+    n = stdout_written(fd, NULL, 0);
+    size_t total = 19 + 14 + 10 * 3 + 90 * 4 + 900 * 5 + 9000 * 6 + 10000 * 7;
+    assert(n > 19 + 14 && n < total);
+    print_buffered(STDOUT, FLUSH_NONE); // turning it off flushes
+    n = stdout_written(fd, NULL, 0);
+    assert(n == total);
+
+    // big strings skip the buffer (and take whatever's in it with them)
+    static char big[3 * PRINT_BUFFER_SIZE / 2];
+    memset(big, 'q', sizeof(big) - 1);
+    print_buffered(STDOUT, FLUSH_FULL);
+    my_print("small");
+    my_printf("<%|%.2000s|%>", big, big, 1);
+    total += 5 + 1 + sizeof(big) - 1 + 1 + 2000 + 3;
+    n = stdout_written(fd, NULL, 0);
+    assert(n == total);
+    char *tail = malloc(n);
+    stdout_written(fd, tail, n);
+    assert(tail[n - 2000 - 4] == '|' && tail[n - 4] == 'q' && memcmp(&tail[n - 3], "|1>", 3) == 0);
+    assert(memcmp(&tail[n - 2009 - sizeof(big)], "small<q", 7) == 0);
+    free(tail);
+    print_buffered(STDOUT, FLUSH_NONE);
+
+    // long doubles past the double range are more digits than the print buffer holds
+    long double huge = 1e4000L;
+    static char expected[16384];
+    int len = snprintf(expected, sizeof(expected), "%.1000Lf|% .3Lf|", huge, huge * 1e900L);
+    assert(len > PRINT_BUF_SIZE);
+    my_printf("%.1000f|% .3f|", huge, huge * 1e900L);
+    n = stdout_written(fd, NULL, 0);
+    assert(n == total + len);
+    tail = malloc(n);
+    stdout_written(fd, tail, n);
+    assert(memcmp(&tail[total], expected, len) == 0);
+    free(tail);
+    string formatted = {0};
+    writef_string(&formatted, "%.1000f|% .3f|", huge, huge * 1e900L);
+    assert(formatted.len == (size_t)len && memcmp(formatted.data, expected, len) == 0);
+    free(formatted.data);
+    n = total += len;
+
+    // and unbuffered goes straight out
+    my_print("direct");
+    assert(stdout_written(fd, NULL, 0) == n + 6);
+
+    restore_stdout();
+    printf("ok\n");
+}
+
+#define LOG_TEST_THREADS 4
+#define LOG_TEST_LINES   20000
+
+static void *log_worker(void *arg)
+{
+    int id = (int)(intptr_t)arg;
+    for (int i = 0; i < LOG_TEST_LINES; i++) log_printfln("t% n%", id, i);
+    return NULL;
+}
+
+static void *log_short_worker(void *arg)
+{
+    (void)arg;
+    for (int i = 0; i < 10; i++) log_printfln("line");
+    return NULL;
+}
+
+// Checks every thread's lines since from came out whole and in order, returns how many
+static int check_thread_lines(int fd, size_t from, bool all)
+{
+    size_t n = stdout_written(fd, NULL, 0);
+    char *out = malloc(n + 1);
+    stdout_written(fd, out, n);
+    out[n] = 0;
+    int next[LOG_TEST_THREADS] = {0}, lines = 0;
+    for (char *line = &out[from]; *line; lines++) {
+        int id, i, len;
+        assert(sscanf(line, "t%d n%d\n%n", &id, &i, &len) == 2 && line[len - 1] == '\n');
+        assert(id >= 0 && id < LOG_TEST_THREADS && i >= next[id]);
+        if (all) assert(i == next[id]);
+        next[id] = i + 1;
+        line += len;
+    }
+    free(out);
+    return lines;
+}
+
+// Runs the workers then checks the lines
+static void check_log_policy(int fd, LogConfig config)
+{
+    size_t from = stdout_written(fd, NULL, 0);
+    assert(log_start(STDOUT, config));
+    assert(!log_start(STDOUT, config));
+    pthread_t threads[LOG_TEST_THREADS];
+    for (int i = 0; i < LOG_TEST_THREADS; i++) pthread_create(&threads[i], NULL, log_worker, (void *)(intptr_t)i);
+    for (int i = 0; i < LOG_TEST_THREADS; i++) pthread_join(threads[i], NULL);
+    log_stop();
+
+    int lines = check_thread_lines(fd, from, config.on_full != LOG_FULL_DROP);
+    assert((size_t)lines + log_dropped() == LOG_TEST_THREADS * LOG_TEST_LINES);
+    if (config.on_full != LOG_FULL_DROP) assert(log_dropped() == 0);
+}
+
+static void *print_worker(void *arg)
+{
+    int id = (int)(intptr_t)arg;
+    for (int i = 0; i < LOG_TEST_LINES; i++) my_printfln("t% n%", id, i);
+    return NULL;
+}
+
+static void test_log(void)
+{
+    sep("async logging");
+    int fd = capture_stdout();
+
+    // small rings so the full policies actually get used
+    check_log_policy(fd, (LogConfig){ .thread_buffer = 4096, .on_full = LOG_FULL_BLOCK });
+    check_log_policy(fd, (LogConfig){ .thread_buffer = 1024, .on_full = LOG_FULL_DROP });
+    check_log_policy(fd, (LogConfig){ .thread_buffer = 1024, .on_full = LOG_FULL_GROW });
+    check_log_policy(fd, (LogConfig){0});
+
+    // and buffered printing from as many threads, which writes outside the lock
+    for (FlushMode mode = FLUSH_LINE; mode <= FLUSH_FULL; mode++) {
+        size_t from = stdout_written(fd, NULL, 0);
+        print_buffered(STDOUT, mode);
+        pthread_t threads[LOG_TEST_THREADS];
+        for (int i = 0; i < LOG_TEST_THREADS; i++) pthread_create(&threads[i], NULL, print_worker, (void *)(intptr_t)i);
+        for (int i = 0; i < LOG_TEST_THREADS; i++) pthread_join(threads[i], NULL);
+        print_buffered(STDOUT, FLUSH_NONE);
+        assert(check_thread_lines(fd, from, true) == LOG_TEST_THREADS * LOG_TEST_LINES);
+    }
+
+    // rings are handed on as threads exit, so rounds of short lived threads
+    // only ever have as many as run at once
+    size_t from = stdout_written(fd, NULL, 0);
+    assert(log_start(STDOUT, (LogConfig){ .thread_buffer = 1024 }));
+    for (int round = 0; round < 8; round++) {
+        pthread_t threads[LOG_TEST_THREADS];
+        for (int i = 0; i < LOG_TEST_THREADS; i++) pthread_create(&threads[i], NULL, log_short_worker, NULL);
+        for (int i = 0; i < LOG_TEST_THREADS; i++) pthread_join(threads[i], NULL);
+    }
+    size_t rings = 0;
+    for (_LogThread *t = _log.threads; t; t = t->link) rings++;
+    assert(rings >= 1 && rings <= LOG_TEST_THREADS);
+    log_stop();
+    assert(stdout_written(fd, NULL, 0) == from + 8 * LOG_TEST_THREADS * 10 * 5);
+
+    // records bigger than the ring still make it through
+    static char big[8192];
+    memset(big, 'z', sizeof(big) - 1);
+    from = stdout_written(fd, NULL, 0);
+    assert(log_start(STDOUT, (LogConfig){ .thread_buffer = 4096 }));
+    log_printfln("<%>", big);
+    log_stop();
+    assert(stdout_written(fd, NULL, 0) == from + sizeof(big) + 2);
+
+    // not started is just printing
+    log_print("sync");
+    assert(stdout_written(fd, NULL, 0) == from + sizeof(big) + 2 + 4);
+
+    restore_stdout();
+    printf("ok\n");
+}
+
+static void log_binary_calls(void)
+{
+    char *dynamic = "dynamic % format";
+    for (int i = 0; i < 100; i++) {
+        log_printfln("i=% str=% d=% ld=% ok=%", i, "hey", 1.5, (long double)-2.25, i % 2 == 0);
+        log_println("plain", (short)-3, (unsigned char)200, -5LL, (char *)NULL, (size_t)7, 'c');
+        log_printfln("%5.2f|%-6d|%x|%*d|%.2s|%p", 3.14159, -42, 255u, 5, i, "abcdef", (void *)0);
+        log_printfln(dynamic, i);
+    }
+}
+
+static string read_log_file(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    assert(f);
+    string data = { ._owner = true, ._cap = 1 << 20 };
+    data.data = malloc(data._cap);
+    data.len = fread(data.data, 1, data._cap, f);
+    fclose(f);
+    return data;
+}
+
+static void test_log_binary(void)
+{
+    sep("binary logging");
+    char text_path[] = "/tmp/jp_log_text_XXXXXX", bin_path[] = "/tmp/jp_log_bin_XXXXXX";
+    close(mkstemp(text_path));
+    close(mkstemp(bin_path));
+
+    assert(log_start(STDOUT, (LogConfig){ .path = text_path }));
+    log_binary_calls();
+    log_binary_calls();
+    log_stop();
+    // twice to the same file, the second run writes its own header and sites
+    for (int run = 0; run < 2; run++) {
+        assert(log_start(STDOUT, (LogConfig){ .binary = true, .path = bin_path }));
+        log_binary_calls();
+        log_stop();
+    }
+    string text = read_log_file(text_path), bin = read_log_file(bin_path);
+    assert(text.len > 0 && bin.len > 0);
+
+    // all at once, then a few bytes at a time like reading a file as it's written
+    for (size_t step = bin.len; step >= 7; step = step == bin.len ? 7 : 0) {
+        LogDecoder d = {0};
+        StringBuilder out = {0};
+        size_t used = 0;
+        for (size_t have = step; used < bin.len; have = have + step > bin.len ? bin.len : have + step) {
+            used += log_decode(&d, (string){ .data = &bin.data[used], .len = have - used }, &out);
+            assert(!d.error);
+        }
+        string decoded = sb_flatten(&out);
+        assert(decoded.len == text.len && memcmp(decoded.data, text.data, text.len) == 0);
+        free(decoded.data);
+        sb_free(&out);
+        log_decoder_free(&d);
+    }
+
+    // not a binary log, and one that stops part way through a record
+    LogDecoder d = {0};
+    StringBuilder out = {0};
+    assert(log_decode(&d, text, &out) == 0 && d.error);
+    log_decoder_free(&d);
+    assert(log_decode(&d, (string){ .data = bin.data, .len = 40 }, &out) == 16 && !d.error);
+    assert(out.len == 0);
+    log_decoder_free(&d);
+
+    free(text.data);
+    free(bin.data);
+    unlink(text_path);
+    unlink(bin_path);
+    printf("ok\n");
+}
+
+static int log_side_effects;
+static int log_bump(void) { return ++log_side_effects; }
+
+static void test_log_levels(void)
+{
+    sep("log levels");
+    int fd = capture_stdout();
+    char out[64];
+
+    // logger isn't running so these print straight away
+    log_info("info %", log_bump());
+    log_debug("debug %", log_bump());
+    assert(log_side_effects == 1);
+    assert(stdout_written(fd, out, sizeof(out)) == 7 && memcmp(out, "info 1\n", 7) == 0);
+    assert(log_enabled(LOG_ERROR) && log_enabled(LOG_INFO) && !log_enabled(LOG_DEBUG));
+
+    log_set_level(LOG_TRACE);
+    log_trace("trace %", log_bump());
+    assert(log_side_effects == 2);
+    assert(stdout_written(fd, NULL, 0) == 15);
+
+    // compiled out, even though it's enabled at runtime
+#undef JP_LOG_LEVEL
+#define JP_LOG_LEVEL LOG_WARN
+    log_info("info %", log_bump());
+    log_warn("warn %", log_bump());
+    assert(!log_enabled(LOG_INFO));
+#undef JP_LOG_LEVEL
+#define JP_LOG_LEVEL LOG_TRACE
+    assert(log_side_effects == 3);
+    assert(stdout_written(fd, out, sizeof(out)) == 22 && memcmp(&out[15], "warn 3\n", 7) == 0);
+
+    log_set_level(LOG_OFF);
+    log_error("error %", log_bump());
+    assert(log_side_effects == 3 && stdout_written(fd, NULL, 0) == 22);
+    log_set_level(LOG_INFO);
+
+    restore_stdout();
+    printf("ok\n");
+}
+
+static void check_text(StringBuilder *sb, const char *expected)
+{
+    string text = sb_flatten(sb);
+    assert(text.len == strlen(expected) && memcmp(text.data, expected, text.len) == 0);
+    free(text.data);
+    sb_reset(sb);
+}
+
+static void test_format_types(void)
+{
+    sep("custom types");
+    StringBuilder sb = {0};
+
+    string slice = { .data = "hello world", .len = 5 };
+    sb_append(&sb, slice, 1);
+    check_text(&sb, "hello 1");
+    sb_appendf(&sb, "<%8>|<%-7.3>|<%U>", slice, slice, slice);
+    check_text(&sb, "<   hello>|<hel    >|<HELLO>");
+
+    StringList names = {0};
+    da_append(names, ((string){ .data = "ann", .len = 3 }));
+    da_append(names, ((string){ .data = "bob", .len = 3 }));
+    sb_appendf(&sb, "% %5 %", names, names, (StringList){0});
+    check_text(&sb, "[ann, bob] [  ann,   bob] []");
+
+    Vec2 v = { 1.5f, -2 };
+    sb_appendf(&sb, "v=% v=%.2f", &v, &v);
+    check_text(&sb, "v=(1.5, -2) v=(1.50, -2.00)");
+
+    Vec2 other = { 0, 0.25f };
+    Vec2List vecs = {0};
+    da_append(vecs, &v);
+    da_append(vecs, &other);
+    sb_append(&sb, &vecs);
+    check_text(&sb, "[(1.5, -2), (0, 0.25)]");
+
+    // big enough to go over several print buffers/builder chunks, so it gets resumed
+    IntList ints = {0};
+    size_t cap = 20000 * 16, n = 0;
+    char *want = malloc(cap);
+    n += sprintf(&want[n], "[");
+    for (int i = 0; i < 20000; i++) {
+        da_append(ints, i * 7 - 1000);
+        n += sprintf(&want[n], i ? ", %d" : "%d", i * 7 - 1000);
+    }
+    n += sprintf(&want[n], "]");
+    sb_append(&sb, &ints);
+    check_text(&sb, want);
+    string out = {0};
+    writef_string(&out, "%", &ints);
+    assert(out.len == n && memcmp(out.data, want, n) == 0);
+    free(out.data);
+
+    int fd = capture_stdout();
+    my_print(&ints);
+    char *printed = malloc(n + 1);
+    assert(stdout_written(fd, printed, n + 1) == n && memcmp(printed, want, n) == 0);
+    restore_stdout();
+    free(printed);
+    free(want);
+
+    // each refill of the print buffer carries on from the last item rather than
+    // running the list from the top, so 4x the items is about 4x the time (was 16x)
+    double took[2];
+    for (int k = 0; k < 2; k++) {
+        IntList many = {0};
+        for (int i = 0; i < 50000 << (2 * k); i++) da_append(many, i);
+        fd = capture_stdout();
+        clock_t start = clock();
+        my_print(&many);
+        took[k] = (double)(clock() - start) / CLOCKS_PER_SEC;
+        char ends[1];
+        size_t len = stdout_written(fd, ends, 1);
+        assert(len > 0 && ends[0] == '[');
+        restore_stdout();
+        free(many.data);
+    }
+    assert(took[1] < 8 * took[0] + 0.05);
+
+    free(ints.data);
+    free(names.data);
+    free(vecs.data);
+    sb_free(&sb);
+    printf("ok\n");
+}
+
+// writef_length has to agree with what writef_string actually writes
+#define check_length(...) \
+    do { \
+        size_t _len; \
+        string _out = {0}; \
+        write_length(&_len, __VA_ARGS__); \
+        write_string(&_out, __VA_ARGS__); \
+        assert(_len == _out.len); \
+        free(_out.data); \
+    } while (0)
+
+#define check_lengthf(...) \
+    do { \
+        size_t _len; \
+        string _out = {0}; \
+        writef_length(&_len, __VA_ARGS__); \
+        writef_string(&_out, __VA_ARGS__); \
+        assert(_len == _out.len); \
+        free(_out.data); \
+    } while (0)
+
+static void test_format_length(void)
+{
+    sep("format length");
+    char fmt[64];
+    const char *specs = "-+ 0#";
+    const char *convs = "dxXobcU";
+    Vec2 v = { 1.5f, -2 };
+    StringList names = {0};
+    da_append(names, ((string){ .data = "ann", .len = 3 }));
+
+    check_length("just a string");
+    check_length("a", 1, "b", 2.5, (char *)NULL);
+    check_length(1, -2, 3u, true, 'c', "done\n");
+    check_length(1, (void *)0, (void *)0x1234);
+    check_lengthf("");
+    check_lengthf("%% % %", -1ll, (long long)(-S64_MAX - 1));
+    check_lengthf("% % %", 1.0 / 3.0, (long double)2.5, 1e300);
+    check_lengthf("%*d|%-*.*f|%.*s|%*s", 6, 42, 10, 2, 3.14159, 3, "abcdef", -4, "ab");
+    check_lengthf("missing %-5d and %*d", 1);
+    check_lengthf("% and then", 1, 2, "more %", 3);
+    check_lengthf("%8|%.2|%", names, &v, (StringList){0});
+    check_lengthf("%p %p %s %c", (void *)0x1234, (void *)0, (char *)NULL, L'é');
+
+    for (int iter = 0; iter < 20000; iter++) {
+        int n = 0;
+        fmt[n++] = '<';
+        fmt[n++] = '%';
+        for (int i = 0; i < 5; i++) if (rand() % 3 == 0) fmt[n++] = specs[i];
+        if (rand() % 2) n += sprintf(&fmt[n], "%d", 1 + rand() % 30);
+        if (rand() % 3 == 0) n += sprintf(&fmt[n], ".%d", rand() % 25);
+        if (rand() % 2) fmt[n++] = convs[rand() % 7];
+        strcpy(&fmt[n], ">");
+        // the check macros use their args twice
+        u64 bits = rand64();
+        double d = (double)(s64)bits / (double)(1ll << (rand() % 62));
+        switch (rand() % 5) {
+            case 0: check_lengthf(fmt, (int)bits); break;
+            case 1: check_lengthf(fmt, bits); break;
+            case 2: check_lengthf(fmt, d); break;
+            case 3: check_lengthf(fmt, "some text", (bool)(bits & 1)); break;
+            case 4: check_lengthf(fmt, &v, (char)('a' + bits % 26)); break;
+        }
+    }
+
+    // runs out of the first buffer part way through, the rest is measured from
+    // there and the one grow is exactly what it needs
+    static char big[10000];
+    memset(big, 'y', sizeof(big) - 1);
+    string out = {0};
+    writef_string(&out, "%|", big);
+    assert(out.len == sizeof(big) && out._cap == sizeof(big));
+    free(out.data);
+
+    // stopping in a string, a custom type or a field comes out the same as the builder
+    IntList ints = {0};
+    for (int i = 0; i < 300; i++) da_append(ints, i * 31 - 500);
+    StringBuilder sb = {0};
+    for (int i = 0; i < 3; i++) {
+        out = (string){0};
+        const char *text = &big[sizeof(big) - 1 - i * 400];
+        writef_string(&out, "%|%|%1000|%.3|%", (char *)text, &ints, (char *)text, 2.5, names);
+        sb_appendf(&sb, "%|%|%1000|%.3|%", (char *)text, &ints, (char *)text, 2.5, names);
+        string flat = sb_take(&sb);
+        assert(out.len == flat.len && memcmp(out.data, flat.data, flat.len) == 0);
+        free(flat.data);
+        free(out.data);
+    }
+    sb_free(&sb);
+    free(ints.data);
+
+    free(names.data);
+    printf("ok\n");
+}
+
+// Every cap from nothing to more than enough, the output is always the front of
+// what writef_string gives and nothing past cap gets touched
+#define check_into(write_fn, into_fn, ...) \
+    do { \
+        string _want = {0}; \
+        write_fn(&_want, __VA_ARGS__); \
+        static char _buf[2048]; \
+        assert(_want.len + 8 < sizeof(_buf)); \
+        for (size_t _cap = 0; _cap <= _want.len + 4; _cap++) { \
+            size_t _need; \
+            memset(_buf, '#', sizeof(_buf)); \
+            into_fn(&_need, _buf, _cap, __VA_ARGS__); \
+            size_t _n = _cap < _want.len ? _cap : _want.len; \
+            assert(_need == _want.len && memcmp(_buf, _want.data, _n) == 0 && _buf[_n] == '#'); \
+        } \
+        free(_want.data); \
+    } while (0)
+
+static void test_format_into(void)
+{
+    sep("format into");
+    Vec2 v = { 1.5f, -2 };
+    IntList ints = {0};
+    for (int i = 0; i < 40; i++) da_append(ints, i * 31 - 500);
+    static char big[600];
+    memset(big, 'y', sizeof(big) - 1);
+
+    check_into(writef_string, writef_into, "id=% name=% x=%", 42, "someone", 1.25);
+    check_into(writef_string, writef_into, "%8|%-6.2f|%U|%p|%c", "ab", 3.14159, true, (void *)0x1234, 'z');
+    check_into(writef_string, writef_into, "% % %", &v, &ints, 1e300);
+    check_into(writef_string, writef_into, "%.500s|%100|%", big, "pad", (char *)NULL);
+    check_into(write_string, write_into, "a", 1, "b", 2.5, (char *)NULL, "\n");
+    check_into(write_string, write_into, big, 7, big);
+
+    // into a slice of a stack array
+    char header[16];
+    string slot = { .data = &header[4], .len = 8 };
+    size_t need;
+    writef_into_slice(&need, slot, "len=%", 123456);
+    assert(need == 10 && memcmp(&header[4], "len=1234", 8) == 0);
+    writef_into_slice(&need, slot, "len=%", 12);
+    assert(need == 6 && memcmp(&header[4], "len=12", 6) == 0);
+
+    free(ints.data);
+    printf("ok\n");
+}
+
+int main(void)
+{
+    test_cstrlen();
+    test_indexof();
+    test_indexof_any();
+    test_split();
+    test_classes();
+    test_hash();
+    test_hashmap();
+    test_small_string();
+    test_string_builder();
+    test_format_cache();
+    test_format_spec();
+    test_print_buffered();
+    test_log();
+    test_log_binary();
+    test_log_levels();
+    test_format_types();
+    test_format_length();
+    test_format_into();
+    test_nocase();
+    test_utf8();
+    test_parse();
+    test_format_int();
+    test_format_float();
+    return 0;
+}